@@ -0,0 +1,193 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_BENCH_BENCH_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_BENCH_BENCH_HPP
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+
+namespace blog::bench
+{
+
+// Every benchmark executable accepts:
+//
+//   --filter=<text>     only run benchmarks whose name contains text
+//   --baseline=<file>   the saved output of an earlier run; each result is
+//                       printed along with its change from the baseline
+//
+// Output is one JSON object per line, so a run can be saved with
+//
+//   ./bench_hot_paths > before.jsonl
+//
+// and a later build compared against it with --baseline=before.jsonl
+
+struct options
+{
+    std::string                     filter;
+    std::map< std::string, double > baseline;   // name -> ns_per_op or value
+};
+
+inline options &
+global_options()
+{
+    static options opts;
+    return opts;
+}
+
+inline void
+load_baseline(std::string const &path)
+{
+    auto ifs = std::ifstream(path);
+    if (!ifs)
+    {
+        fmt::print(stderr, "cannot open baseline {}\n", path);
+        std::exit(2);
+    }
+
+    // only needs to understand the lines that report() and report_value()
+    // write
+    auto const name_key  = std::string_view(R"("name":")");
+    auto const ns_key    = std::string_view(R"("ns_per_op":)");
+    auto const value_key = std::string_view(R"("value":)");
+    for (std::string line; std::getline(ifs, line);)
+    {
+        auto n = line.find(name_key);
+        auto t = line.find(ns_key);
+        auto k = ns_key.size();
+        if (t == line.npos)
+        {
+            t = line.find(value_key);
+            k = value_key.size();
+        }
+        if (n == line.npos || t == line.npos)
+            continue;
+        n += name_key.size();
+        auto name = line.substr(n, line.find('"', n) - n);
+        global_options().baseline[name] =
+            std::strtod(line.c_str() + t + k, nullptr);
+    }
+}
+
+inline void
+init(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        auto arg = std::string_view(argv[i]);
+        if (arg.starts_with("--filter="))
+            global_options().filter = arg.substr(9);
+        else if (arg.starts_with("--baseline="))
+            load_baseline(std::string(arg.substr(11)));
+        else
+        {
+            fmt::print(stderr,
+                       "usage: {} [--filter=<text>] [--baseline=<file>]\n",
+                       argv[0]);
+            std::exit(2);
+        }
+    }
+}
+
+/// True if the benchmark called name has been filtered out
+inline bool
+skip(std::string_view name)
+{
+    return name.find(global_options().filter) == name.npos;
+}
+
+/// Prevent the optimiser from discarding the computation of value.
+template < class T >
+inline void
+do_not_optimize(T const &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/// Print the result of a benchmark as a single line of JSON.
+inline void
+report(std::string_view                           name,
+       std::size_t                                iterations,
+       std::chrono::duration< double, std::nano > elapsed,
+       std::size_t                                items_per_op = 1)
+{
+    auto ns_per_op = elapsed.count() / double(iterations);
+    auto line      = fmt::format(
+        R"({{"name":"{}","iterations":{},"ns_per_op":{:.2f},)"
+        R"("items_per_sec":{:.0f})",
+        name,
+        iterations,
+        ns_per_op,
+        double(items_per_op) * 1e9 / ns_per_op);
+
+    auto &baseline = global_options().baseline;
+    if (auto it = baseline.find(std::string(name)); it != baseline.end())
+        line += fmt::format(
+            R"(,"baseline_ns_per_op":{:.2f},"change_pct":{:.1f})",
+            it->second,
+            (ns_per_op - it->second) * 100.0 / it->second);
+
+    fmt::print("{}}}\n", line);
+}
+
+/// Print a measurement that is not a time, such as a memory footprint, as a
+/// single line of JSON.
+inline void
+report_value(std::string_view name, std::string_view unit, double value)
+{
+    auto line = fmt::format(
+        R"({{"name":"{}","unit":"{}","value":{:.0f})", name, unit, value);
+
+    auto &baseline = global_options().baseline;
+    if (auto it = baseline.find(std::string(name)); it != baseline.end())
+        line += fmt::format(R"(,"baseline_value":{:.0f},"change_pct":{:.1f})",
+                            it->second,
+                            (value - it->second) * 100.0 / it->second);
+
+    fmt::print("{}}}\n", line);
+}
+
+/// Run f for a fixed number of iterations, after a short warmup, and report
+/// the result. Where one call of f does several units of work, such as
+/// delivering a message to many subscribers, pass the number as items_per_op
+/// to have the throughput reported as well.
+///
+/// Iteration counts are fixed rather than adaptive so that two runs of the same
+/// build always perform the same work.
+template < class F >
+void
+run(std::string_view name,
+    std::size_t      iterations,
+    F              &&f,
+    std::size_t      items_per_op = 1)
+{
+    using clock = std::chrono::steady_clock;
+
+    if (skip(name))
+        return;
+
+    for (std::size_t i = 0; i < iterations / 10 + 1; ++i)
+        f();
+
+    auto start = clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+        f();
+    report(name, iterations, clock::now() - start, items_per_op);
+}
+
+}   // namespace blog::bench
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_BENCH_BENCH_HPP
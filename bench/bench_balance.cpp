@@ -0,0 +1,179 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+// How evenly a redirecting server spreads websockets over a group of
+// backends that publish their load in a shared load table:
+//
+//   balance.<mode>.connect     time to open a websocket through the redirect
+//   balance.<mode>.backend N   connections backend N is serving at the end
+//   balance.<mode>.imbalance   the busiest backend's connections over the
+//                              mean; 1 is perfectly balanced
+//   balance.<mode>.unreleased  backends still in the table after the
+//                              connections are closed and the backends
+//                              stopped; anything but 0 is a bug
+//
+// where mode is
+//
+//   even       every backend starts idle
+//   preloaded  backend 0 already serves as many connections as the redirect
+//              will open, reached directly, so the redirect should send
+//              everything to the others until they catch up
+//
+// The front server and three backends run in child processes, sharing a load
+// table in a file. Connections are opened several at a time, so that choices
+// are made while earlier redirects are still on their way.
+
+#include "bench.hpp"
+#include "connect_websock.hpp"
+#include "load_table.hpp"
+#include "server_process.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace
+{
+using namespace blog;
+
+constexpr std::size_t backend_count = 3;
+constexpr std::size_t connections   = 600;
+constexpr std::size_t concurrency   = 16;
+
+using clock           = std::chrono::steady_clock;
+using connection_list = std::vector< std::unique_ptr< websock_connection > >;
+
+asio::awaitable< void >
+open_some(ssl::context     &sslctx,
+          std::string       url,
+          std::size_t      &remaining,
+          connection_list  &out)
+{
+    while (remaining)
+    {
+        --remaining;
+        out.push_back(co_await connect_websock(sslctx, url, 1, false));
+    }
+}
+
+// open n connections to url, concurrency at a time
+clock::duration
+open_connections(std::string const &url, std::size_t n, connection_list &out)
+{
+    auto ioc       = asio::io_context(1);
+    auto sslctx    = ssl::context(ssl::context::tls_client);
+    auto remaining = n;
+    auto start     = clock::now();
+    for (std::size_t i = 0; i < concurrency; ++i)
+        asio::co_spawn(ioc,
+                       open_some(sslctx, url, remaining, out),
+                       [](std::exception_ptr ep)
+                       {
+                           if (ep)
+                               std::rethrow_exception(ep);
+                       });
+    ioc.run();
+    return clock::now() - start;
+}
+
+void
+measure(std::string_view name, bool preload)
+{
+    if (bench::skip(name))
+        return;
+
+    auto table_path = fmt::format("bench_balance.{}.table", ::getpid());
+
+    auto backends = std::vector< std::unique_ptr< bench::server_process > >();
+    auto roots    = std::vector< std::string >();
+    for (std::size_t i = 0; i < backend_count; ++i)
+    {
+        auto options       = server_options();
+        options.load_table = table_path;
+        backends.push_back(
+            std::make_unique< bench::server_process >(std::move(options)));
+        roots.push_back(backends.back()->tls_root);
+    }
+
+    auto route_file = fmt::format("bench_balance.{}.routes", ::getpid());
+    std::ofstream(route_file)
+        << "https  /balanced{rest}  redirect  {backend}/websocket-0{rest}\n"
+        << "https  {any}            reply     404 not found\n";
+
+    auto options        = server_options();
+    options.route_file  = route_file;
+    options.load_table  = table_path;
+    options.backends    = roots;
+    options.report_load = false;
+    auto front          = bench::server_process(std::move(options));
+    std::remove(route_file.c_str());
+
+    auto conns = connection_list();
+    if (preload)
+        open_connections(roots[0] + "/websocket-0", connections, conns);
+
+    auto elapsed =
+        open_connections(front.tls_root + "/balanced", connections, conns);
+    bench::report(fmt::format("{}.connect", name), connections, elapsed);
+
+    auto table  = load_table(table_path);
+    auto loads  = table.snapshot(std::chrono::seconds(3));
+    auto active = std::vector< double >(backend_count);
+    for (auto &b : loads)
+    {
+        auto i = std::find(roots.begin(), roots.end(), b.root) - roots.begin();
+        if (std::size_t(i) < backend_count)
+            active[std::size_t(i)] = b.active;
+    }
+
+    auto total = 0.0;
+    for (std::size_t i = 0; i < backend_count; ++i)
+    {
+        bench::report_value(
+            fmt::format("{}.backend {}", name, i), "connections", active[i]);
+        total += active[i];
+    }
+    bench::report_value(
+        fmt::format("{}.imbalance", name),
+        "ratio",
+        *std::max_element(active.begin(), active.end()) /
+            std::max(total / backend_count, 1.0));
+
+    // a backend that stops gives its slot back
+    conns.clear();
+    for (auto &b : backends)
+        b->stop(std::chrono::seconds(5));
+    auto unreleased = 0.0;
+    for (auto &b : table.snapshot(std::chrono::seconds(3)))
+        if (std::find(roots.begin(), roots.end(), b.root) != roots.end())
+            ++unreleased;
+    bench::report_value(
+        fmt::format("{}.unreleased", name), "backends", unreleased);
+
+    std::remove(table_path.c_str());
+}
+
+}   // namespace
+
+int
+main(int argc, char **argv)
+{
+    bench::init(argc, argv);
+
+    measure("balance.even", false);
+    measure("balance.preloaded", true);
+}
@@ -0,0 +1,188 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+// The cost of opening many websockets to one wss:// authority, each over a
+// connection of its own and all as streams of shared HTTP/2 connections.
+//
+// The server runs in a child process with h2 enabled. For each mode the
+// parent opens the websockets, then counts:
+//
+//   h2_sharing.<mode>.tls_handshakes   TLS handshakes the client made
+//   h2_sharing.<mode>.client_fds       descriptors the client holds for them
+//   h2_sharing.<mode>.server_fds       descriptors the server holds for them
+//   h2_sharing.<mode>.setup            time to open them all
+//   h2_sharing.<mode>.echo             time for every websocket to echo one
+//                                      message, all at once
+//
+// where mode is http1 or http2. The first websocket is opened before the
+// rest, so that they find its connection in the pool.
+
+#include "bench.hpp"
+#include "connect_websock.hpp"
+#include "server_process.hpp"
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace
+{
+using namespace blog;
+
+constexpr std::size_t websockets   = 64;
+constexpr std::size_t message_size = 16 * 1024;
+
+using clock           = std::chrono::steady_clock;
+using connection_list = std::vector< std::unique_ptr< websock_connection > >;
+
+std::size_t
+open_fds(pid_t pid)
+{
+    auto dir = std::filesystem::path(fmt::format("/proc/{}/fd", pid));
+    auto ec  = std::error_code();
+    auto n   = std::size_t(0);
+    for (auto i = std::filesystem::directory_iterator(dir, ec);
+         !ec && i != std::filesystem::directory_iterator();
+         i.increment(ec))
+        ++n;
+    return n;
+}
+
+asio::awaitable< void >
+open_one(ssl::context    &sslctx,
+         std::string      url,
+         h2_pool         *pool,
+         connection_list &out)
+{
+    out.push_back(co_await connect_websock(sslctx, url, 0, false, {}, pool));
+}
+
+asio::awaitable< void >
+echo_one(websock_connection &conn)
+{
+    co_await conn.send_text(std::string(message_size, 'x'));
+    co_await conn.receive_view();
+}
+
+// Run n coroutines made by spawn to completion. The context is run until
+// they have finished rather than until it is out of work, since an HTTP/2
+// connection keeps a read outstanding for as long as it is open.
+template < class Spawn >
+std::chrono::nanoseconds
+timed(asio::io_context &ioc, std::size_t n, Spawn spawn)
+{
+    auto done   = std::size_t(0);
+    auto failed = std::size_t(0);
+    auto start  = clock::now();
+    for (std::size_t i = 0; i < n; ++i)
+        asio::co_spawn(ioc,
+                       spawn(i),
+                       [&](std::exception_ptr ep)
+                       {
+                           ++done;
+                           if (ep)
+                               ++failed;
+                       });
+    ioc.restart();
+    while (done < n)
+        ioc.run_one();
+    if (failed)
+        throw std::runtime_error(fmt::format("{} of {} failed", failed, n));
+    return clock::now() - start;
+}
+
+void
+measure(std::string_view             name,
+        bench::server_process const &child,
+        bool                         use_h2)
+{
+    if (bench::skip(name))
+        return;
+
+    auto ioc        = asio::io_context(1);
+    auto sslctx     = ssl::context(ssl::context::tls_client);
+    auto pool       = h2_pool();
+    auto conns      = connection_list();
+    auto url        = fmt::format("{}/websocket-0", child.tls_root);
+    auto client_fds = open_fds(::getpid());
+    auto server_fds = open_fds(child.pid);
+    auto open       = [&](std::size_t)
+    { return open_one(sslctx, url, use_h2 ? &pool : nullptr, conns); };
+
+    auto setup = timed(ioc, 1, open);
+    setup += timed(ioc, websockets - 1, open);
+
+    // let the server finish accepting
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    client_fds = open_fds(::getpid()) - client_fds;
+    server_fds = open_fds(child.pid) - server_fds;
+
+    auto handshakes = std::size_t(0);
+    for (auto &c : conns)
+        if (c->timings().tls.count() > 0)
+            ++handshakes;
+
+    auto echo = timed(ioc,
+                      conns.size(),
+                      [&](std::size_t i) { return echo_one(*conns[i]); });
+
+    bench::report_value(
+        fmt::format("{}.tls_handshakes", name), "count", double(handshakes));
+    bench::report_value(
+        fmt::format("{}.client_fds", name), "count", double(client_fds));
+    bench::report_value(
+        fmt::format("{}.server_fds", name), "count", double(server_fds));
+    bench::report_value(fmt::format("{}.setup", name),
+                        "us",
+                        double(setup.count()) / 1000);
+    bench::report_value(fmt::format("{}.echo", name),
+                        "us",
+                        double(echo.count()) / 1000);
+
+    timed(ioc,
+          conns.size(),
+          [&](std::size_t i)
+          { return conns[i]->close(beast::websocket::close_code::normal); });
+}
+
+void
+raise_fd_limit()
+{
+    auto lim = ::rlimit();
+    if (::getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max)
+    {
+        lim.rlim_cur = lim.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &lim);
+    }
+}
+
+}   // namespace
+
+int
+main(int argc, char **argv)
+{
+    bench::init(argc, argv);
+    raise_fd_limit();
+
+    auto options  = server_options();
+    options.http2 = true;
+    auto child    = bench::server_process(std::move(options));
+
+    measure("h2_sharing.http1", child, false);
+    measure("h2_sharing.http2", child, true);
+}
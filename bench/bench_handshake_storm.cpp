@@ -0,0 +1,177 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+// Echo latency on established websockets while the server is flooded with
+// new TLS connections, with the handshakes done on the server's one I/O
+// thread and with them offloaded to a handshake pool:
+//
+//   storm.<mode>.echo_p50, echo_p99, echo_p999   round trip percentiles, us
+//   storm.<mode>.connects                        handshakes completed by the
+//                                                storm, per second
+//
+// where mode is
+//
+//   quiet     no storm, handshakes inline; the latency to aim for
+//   inline    storm, handshakes on the server's I/O thread
+//   offload   storm, handshakes on a pool of handshake_threads threads
+//   upgrade   as offload, with the upgrade request read there too
+//
+// The server runs in a child process. The storm is driven from threads of
+// this process, each keeping several connections opening at once.
+
+#include "bench.hpp"
+#include "connect_websock.hpp"
+#include "connection_stats.hpp"
+#include "server_process.hpp"
+
+#include <fmt/format.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+using namespace blog;
+
+constexpr std::size_t echo_connections  = 16;
+constexpr std::size_t storm_threads     = 4;
+constexpr std::size_t storm_concurrency = 8;
+constexpr std::size_t handshake_threads = 2;
+constexpr auto        duration          = std::chrono::seconds(3);
+
+using clock           = std::chrono::steady_clock;
+using connection_list = std::vector< std::unique_ptr< websock_connection > >;
+
+asio::awaitable< void >
+open_echoes(ssl::context &sslctx, std::string url, connection_list &out)
+{
+    for (std::size_t i = 0; i < echo_connections; ++i)
+    {
+        out.push_back(co_await connect_websock(sslctx, url, 0, false));
+        out.back()->sock().set_option(tcp::no_delay(true));
+    }
+}
+
+asio::awaitable< void >
+echo_until(websock_connection &conn,
+           clock::time_point   until,
+           rtt_histogram      &latency)
+{
+    auto msg = std::string(64, 'x');
+    while (clock::now() < until)
+    {
+        auto start = clock::now();
+        co_await conn.send_text(msg);
+        bench::do_not_optimize(co_await conn.receive_view());
+        latency.record(std::chrono::duration_cast< std::chrono::microseconds >(
+            clock::now() - start));
+    }
+    co_await conn.close(beast::websocket::close_reason(
+        beast::websocket::close_code::normal));
+}
+
+// open and close connections one after another until the deadline
+asio::awaitable< void >
+storm(ssl::context                &sslctx,
+      std::string                  url,
+      clock::time_point            until,
+      std::atomic< std::size_t > &connects)
+{
+    while (clock::now() < until)
+    {
+        try
+        {
+            auto conn = co_await connect_websock(sslctx, url, 0, false);
+            connects.fetch_add(1, std::memory_order_relaxed);
+            co_await conn->close(beast::websocket::close_reason(
+                beast::websocket::close_code::normal));
+        }
+        catch (std::exception &)
+        {
+        }
+    }
+}
+
+void
+measure(std::string_view name,
+        bool             with_storm,
+        std::size_t      threads,
+        bool             offload_upgrade)
+{
+    if (bench::skip(name))
+        return;
+
+    auto options              = server_options();
+    options.handshake_threads = threads;
+    options.offload_upgrade   = offload_upgrade;
+    auto child                = bench::server_process(std::move(options));
+    auto url                  = child.tls_root + "/websocket-0";
+
+    auto ioc    = asio::io_context(1);
+    auto sslctx = ssl::context(ssl::context::tls_client);
+    auto conns  = connection_list();
+    asio::co_spawn(ioc,
+                   open_echoes(sslctx, url, conns),
+                   [](std::exception_ptr ep)
+                   {
+                       if (ep)
+                           std::rethrow_exception(ep);
+                   });
+    ioc.run();
+    ioc.restart();
+
+    auto until    = clock::now() + duration;
+    auto connects = std::atomic< std::size_t >(0);
+    auto stormers = std::vector< std::thread >();
+    for (std::size_t t = 0; with_storm && t < storm_threads; ++t)
+        stormers.emplace_back(
+            [&]
+            {
+                auto sioc = asio::io_context(1);
+                auto sctx = ssl::context(ssl::context::tls_client);
+                for (std::size_t i = 0; i < storm_concurrency; ++i)
+                    asio::co_spawn(
+                        sioc, storm(sctx, url, until, connects), asio::detached);
+                sioc.run();
+            });
+
+    auto latency = rtt_histogram();
+    for (auto &c : conns)
+        asio::co_spawn(ioc, echo_until(*c, until, latency), asio::detached);
+    ioc.run();
+    for (auto &t : stormers)
+        t.join();
+
+    auto us = [&](double p) { return double(latency.percentile(p).count()); };
+    bench::report_value(fmt::format("{}.echo_p50", name), "us", us(0.5));
+    bench::report_value(fmt::format("{}.echo_p99", name), "us", us(0.99));
+    bench::report_value(fmt::format("{}.echo_p999", name), "us", us(0.999));
+    bench::report_value(
+        fmt::format("{}.connects", name),
+        "per_sec",
+        double(connects.load()) /
+            std::chrono::duration< double >(duration).count());
+}
+
+}   // namespace
+
+int
+main(int argc, char **argv)
+{
+    bench::init(argc, argv);
+
+    measure("storm.quiet", false, 0, false);
+    measure("storm.inline", true, 0, false);
+    measure("storm.offload", true, handshake_threads, false);
+    measure("storm.upgrade", true, handshake_threads, true);
+}
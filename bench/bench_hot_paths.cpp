@@ -0,0 +1,174 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+// Microbenchmarks for the functions on the request handling path:
+// url decoding, diagnostic formatting, response construction and the copying
+// websocket receive. Route matching is covered by bench_routes.
+//
+// The websocket benchmarks run over beast's in-memory test stream, so no
+// network stack is involved.
+
+#include "bench.hpp"
+#include "fmt_describe.hpp"
+#include "responses.hpp"
+#include "stitch.hpp"
+#include "url.hpp"
+#include "websock_connection.hpp"
+
+#include <boost/asio/experimental/awaitable_operators.hpp>
+#include <boost/beast/_experimental/test/stream.hpp>
+#include <fmt/format.h>
+
+#include <chrono>
+#include <string>
+
+namespace
+{
+using namespace blog;
+
+using test_ws = beast::websocket::stream< beast::test::stream >;
+
+constexpr std::string_view urls[] = {
+    "ws://127.0.0.1:41234/websocket-4",
+    "wss://127.0.0.1:41235/websocket-3/chat?room=1#top",
+    "wss://backend-17.example.com/websocket-0",
+};
+
+asio::awaitable< void >
+handshake(test_ws &client, test_ws &server)
+{
+    using namespace asio::experimental::awaitable_operators;
+    using asio::use_awaitable;
+
+    co_await (server.async_accept(use_awaitable) &&
+              client.async_handshake("localhost", "/", use_awaitable));
+}
+
+// Each iteration writes a message from the server side and receives it on the
+// client side, so the difference between the two variants is the cost of
+// copying the message out of the receive buffer.
+template < class Read >
+asio::awaitable< void >
+time_receive(std::string_view name,
+             std::size_t      iterations,
+             std::size_t      size,
+             test_ws         &client,
+             test_ws         &server,
+             Read             read)
+{
+    using asio::use_awaitable;
+    using clock = std::chrono::steady_clock;
+
+    auto payload = std::string(size, 'x');
+    auto rxbuf   = beast::flat_buffer();
+
+    auto once = [&]() -> asio::awaitable< void >
+    {
+        server.text(true);
+        co_await server.async_write(asio::buffer(payload), use_awaitable);
+        bench::do_not_optimize(co_await read(client, rxbuf));
+    };
+
+    for (std::size_t i = 0; i < iterations / 10 + 1; ++i)
+        co_await once();
+
+    auto start = clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+        co_await once();
+    bench::report(name, iterations, clock::now() - start);
+}
+
+asio::awaitable< void >
+receive_benchmarks(asio::io_context &ioc)
+{
+    auto client = test_ws(ioc);
+    auto server = test_ws(ioc);
+    client.next_layer().connect(server.next_layer());
+    co_await handshake(client, server);
+
+    for (std::size_t size : { 64, 4096, 65536 })
+    {
+        auto iterations = std::size_t(20'000'000) / (size + 256);
+
+        auto copy_name = fmt::format("websock.read_text {}", size);
+        if (!bench::skip(copy_name))
+            co_await time_receive(
+                copy_name,
+                iterations,
+                size,
+                client,
+                server,
+                [](test_ws &ws, beast::flat_buffer &buf)
+                { return read_text(ws, buf); });
+
+        auto view_name = fmt::format("websock.read_view {}", size);
+        if (!bench::skip(view_name))
+            co_await time_receive(
+                view_name,
+                iterations,
+                size,
+                client,
+                server,
+                [](test_ws &ws, beast::flat_buffer &buf)
+                { return read_view(ws, buf); });
+    }
+}
+
+}   // namespace
+
+int
+main(int argc, char **argv)
+{
+    using bench::do_not_optimize;
+
+    bench::init(argc, argv);
+
+    auto const iterations = std::size_t(1'000'000);
+
+    for (auto url : urls)
+    {
+        auto str = std::string(url);
+        bench::run(fmt::format("url.decode_url {}", url),
+                   iterations / 10,
+                   [&] { do_not_optimize(decode_url(str)); });
+    }
+
+    auto parts = decode_url(std::string(urls[1]));
+    bench::run("format.url_parts",
+               iterations,
+               [&] { do_not_optimize(fmt::format("{}", parts)); });
+
+    auto const loc = std::string("wss://127.0.0.1:41235/websocket-3/chat");
+    bench::run("responses.make_redirect",
+               iterations,
+               [&] { do_not_optimize(make_redirect(loc)); });
+
+    bench::run("responses.make_error",
+               iterations,
+               [&]
+               {
+                   do_not_optimize(make_error(beast::http::status::not_found,
+                                              "try /websocket-5\r\n"));
+               });
+
+    auto redirect = make_redirect(loc);
+    bench::run("format.stitch_response_header",
+               iterations,
+               [&] { do_not_optimize(stitch(redirect.base())); });
+
+    auto ioc = asio::io_context();
+    asio::co_spawn(ioc,
+                   receive_benchmarks(ioc),
+                   [](std::exception_ptr ep)
+                   {
+                       if (ep)
+                           std::rethrow_exception(ep);
+                   });
+    ioc.run();
+}
@@ -0,0 +1,127 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+// Resident memory of the server per idle echo connection.
+//
+// The server runs in a child process so that its resident set can be measured
+// without the clients' memory mixed in. The parent opens many connections,
+// sends one large message on each so that every buffer has been grown at
+// least once, then leaves them idle and reads the child's RSS from
+// /proc/<pid>/statm.
+//
+// Each policy is measured in its own child:
+//
+//   idle_memory.release   the default server_options
+//   idle_memory.retain    buffers kept between messages, as before the idle
+//                         memory policy existed
+
+#include "bench.hpp"
+#include "connect_websock.hpp"
+#include "server_process.hpp"
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+namespace
+{
+using namespace blog;
+
+constexpr std::size_t connections  = 1000;
+constexpr std::size_t message_size = 64 * 1024;
+
+using connection_list = std::vector< std::unique_ptr< websock_connection > >;
+
+asio::awaitable< void >
+open_idle(ssl::context &sslctx, std::string url, connection_list &out)
+{
+    auto conn = co_await connect_websock(sslctx, url, 0, false);
+    co_await conn->send_text(std::string(message_size, 'x'));
+    co_await conn->receive_view();
+    out.push_back(std::move(conn));
+}
+
+void
+measure(std::string_view name, server_options options)
+{
+    if (bench::skip(name))
+        return;
+
+    auto child  = bench::server_process(std::move(options));
+    auto before = bench::resident_bytes(child.pid);
+
+    auto ioc    = asio::io_context(1);
+    auto sslctx = ssl::context(ssl::context::tls_client);
+    auto open   = connection_list();
+    auto failed = std::size_t(0);
+    for (std::size_t i = 0; i < connections; ++i)
+        asio::co_spawn(ioc,
+                       open_idle(sslctx,
+                                 fmt::format("{}/websocket-0", child.tls_root),
+                                 open),
+                       [&](std::exception_ptr ep)
+                       {
+                           if (ep)
+                               ++failed;
+                       });
+    ioc.run();
+
+    if (open.empty())
+    {
+        fmt::print(stderr, "{}: no connections could be opened\n", name);
+        return;
+    }
+    if (failed)
+        fmt::print(stderr, "{}: {} connections failed\n", name, failed);
+
+    // let the server settle into its idle state
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    auto after = bench::resident_bytes(child.pid);
+
+    bench::report_value(fmt::format("{}.rss_per_connection", name),
+                        "bytes",
+                        (double(after) - double(before)) /
+                            double(open.size()));
+    bench::report_value(
+        fmt::format("{}.rss_total", name), "bytes", double(after));
+}
+
+void
+raise_fd_limit()
+{
+    auto lim = ::rlimit();
+    if (::getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max)
+    {
+        lim.rlim_cur = lim.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &lim);
+    }
+}
+
+}   // namespace
+
+int
+main(int argc, char **argv)
+{
+    bench::init(argc, argv);
+    raise_fd_limit();
+
+    measure("idle_memory.release", server_options());
+
+    auto retain                = server_options();
+    retain.idle_buffer_limit   = std::numeric_limits< std::size_t >::max();
+    retain.release_ssl_buffers = false;
+    measure("idle_memory.retain", retain);
+}
@@ -0,0 +1,166 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+// What a client on the same host saves by reaching the server over a unix
+// domain socket rather than loopback TCP:
+//
+//   local.<mode>.connect       time to open a websocket, handshakes included
+//   local.<mode>.round_trip N  round trip time of an N byte echo;
+//                              items_per_sec is bytes echoed per second
+//
+// where mode is one of
+//
+//   tcp_tls    wss://       loopback TCP and TLS, as any remote client
+//   unix_tls   wss+unix://  a unix domain socket, still with TLS
+//   unix       ws+unix://   a unix domain socket in the clear
+//
+// Two servers run in child processes, one listening on a unix domain socket
+// in the clear and one with TLS. Both serve wss:// over TCP as well.
+
+#include "bench.hpp"
+#include "connect_websock.hpp"
+#include "server_process.hpp"
+#include "url.hpp"
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include <unistd.h>
+
+namespace
+{
+using namespace blog;
+
+using clock = std::chrono::steady_clock;
+
+asio::awaitable< std::unique_ptr< websock_connection > >
+open_connection(ssl::context &sslctx, std::string const &url)
+{
+    auto conn = co_await connect_websock(sslctx, url, 0, false);
+    if (!is_local(decode_url(url).transport))
+        conn->sock().set_option(tcp::no_delay(true));
+    co_return conn;
+}
+
+asio::awaitable< void >
+time_connects(std::string_view name,
+              ssl::context    &sslctx,
+              std::string      url,
+              std::size_t      iterations)
+{
+    if (bench::skip(name))
+        co_return;
+
+    auto start = clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        auto conn = co_await open_connection(sslctx, url);
+        co_await conn->close(beast::websocket::close_reason(
+            beast::websocket::close_code::normal));
+    }
+    bench::report(name, iterations, clock::now() - start);
+}
+
+asio::awaitable< void >
+time_round_trips(std::string_view name,
+                 ssl::context    &sslctx,
+                 std::string      url,
+                 std::size_t      size,
+                 std::size_t      iterations)
+{
+    if (bench::skip(name))
+        co_return;
+
+    auto conn = co_await open_connection(sslctx, url);
+    auto msg  = std::string(size, 'x');
+    for (std::size_t i = 0; i < iterations / 10 + 1; ++i)
+    {
+        co_await conn->send_text(msg);
+        co_await conn->receive_view();
+    }
+
+    auto start = clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        co_await conn->send_text(msg);
+        bench::do_not_optimize(co_await conn->receive_view());
+    }
+    bench::report(name, iterations, clock::now() - start, size);
+
+    co_await conn->close(beast::websocket::close_reason(
+        beast::websocket::close_code::normal));
+}
+
+asio::awaitable< void >
+run_all(std::string tls_root, std::string unix_tls_root, std::string unix_root)
+{
+    auto sslctx = ssl::context(ssl::context::tls_client);
+
+    struct mode
+    {
+        char const *name;
+        std::string url;
+    };
+    mode const modes[] = { { "tcp_tls", tls_root + "/websocket-0" },
+                           { "unix_tls", unix_tls_root + "/websocket-0" },
+                           { "unix", unix_root + "/websocket-0" } };
+
+    for (auto &m : modes)
+        co_await time_connects(
+            fmt::format("local.{}.connect", m.name), sslctx, m.url, 2'000);
+
+    for (std::size_t size : { 64, 65536 })
+    {
+        auto iterations = std::size_t(200'000'000) / (size + 20'000);
+        for (auto &m : modes)
+            co_await time_round_trips(
+                fmt::format("local.{}.round_trip {}", m.name, size),
+                sslctx,
+                m.url,
+                size,
+                iterations);
+    }
+}
+
+}   // namespace
+
+int
+main(int argc, char **argv)
+{
+    bench::init(argc, argv);
+
+    auto plain_path = fmt::format("bench_local.{}.sock", ::getpid());
+    auto tls_path   = fmt::format("bench_local.{}.tls.sock", ::getpid());
+
+    auto plain_options       = server_options();
+    plain_options.local_path = plain_path;
+    auto plain               = bench::server_process(std::move(plain_options));
+
+    auto tls_options       = server_options();
+    tls_options.local_path = tls_path;
+    tls_options.local_tls  = true;
+    auto tls               = bench::server_process(std::move(tls_options));
+
+    auto ioc = asio::io_context(1);
+    asio::co_spawn(ioc,
+                   run_all(tls.tls_root, tls.local_root, plain.local_root),
+                   [](std::exception_ptr ep)
+                   {
+                       if (ep)
+                           std::rethrow_exception(ep);
+                   });
+    ioc.run();
+
+    std::remove(plain_path.c_str());
+    std::remove(tls_path.c_str());
+}
@@ -0,0 +1,275 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+// Message handlers run on the worker pool, first driven directly by several
+// threads at once and then through the server by many websocket sessions:
+//
+//   offload.pool                    time per message offloaded by
+//                                   producer_threads threads, each keeping
+//                                   window messages queued
+//   offload.<echo mode>             time per message round trip, for sessions
+//                                   each keeping window messages in flight
+//
+// and for each of them, from the handler's statistics
+//
+//   .out_of_order   replies that overtook an earlier message of the same
+//                   producer or session; anything but 0 is a bug
+//   .peak_queued    most messages waiting for a worker at once
+//   .mean_wait      ns from queueing a message to a worker taking it
+//   .mean_service   ns spent in handle() per message
+//
+// The direct run has two producers per worker queue, so pushes race. The
+// server runs on a thread of this process so that its handler_report() can
+// be read.
+
+#include "bench.hpp"
+#include "connect_websock.hpp"
+#include "server.hpp"
+#include "worker_pool.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace
+{
+using namespace blog;
+
+constexpr std::size_t worker_threads   = 2;
+constexpr std::size_t producer_threads = 4;
+constexpr std::size_t window           = 8;
+constexpr std::size_t sessions         = 64;
+
+using clock = std::chrono::steady_clock;
+
+// Spins for a fixed time on each message and sends it back unchanged,
+// standing in for a handler with real work to do
+struct busy_handler final : message_handler
+{
+    explicit busy_handler(std::chrono::nanoseconds cost)
+    : cost_(cost)
+    {
+    }
+
+    bool
+    handle(ws_message &) override
+    {
+        auto until = clock::now() + cost_;
+        while (clock::now() < until)
+            ;
+        return true;
+    }
+
+    bool
+    offload() const override
+    {
+        return true;
+    }
+
+  private:
+    std::chrono::nanoseconds cost_;
+};
+
+void
+report_stats(std::string_view     name,
+             handler_stats const &stats,
+             std::size_t          out_of_order)
+{
+    bench::report_value(
+        fmt::format("{}.out_of_order", name), "messages", double(out_of_order));
+    bench::report_value(fmt::format("{}.peak_queued", name),
+                        "messages",
+                        double(stats.peak_queued));
+    bench::report_value(fmt::format("{}.mean_wait", name),
+                        "ns",
+                        double(stats.mean_wait().count()));
+    bench::report_value(fmt::format("{}.mean_service", name),
+                        "ns",
+                        double(stats.mean_service().count()));
+}
+
+// One thread's stream of messages to its worker, window at a time, with
+// each completion checked against the order of submission
+struct producer
+{
+    producer(asio::io_context   &ioc,
+             worker_pool        &pool,
+             registered_handler &h,
+             std::size_t         worker,
+             std::size_t         total)
+    : ioc(ioc)
+    , pool(pool)
+    , h(h)
+    , worker(worker)
+    , total(total)
+    , messages(window)
+    {
+    }
+
+    void
+    start()
+    {
+        while (sent < std::min(window, total))
+            send();
+    }
+
+    void
+    send()
+    {
+        auto seq = sent++;
+        pool.async_offload(worker,
+                           h,
+                           messages[seq % window],
+                           asio::bind_executor(
+                               ioc,
+                               [this, seq](std::exception_ptr, bool)
+                               {
+                                   if (seq != done)
+                                       ++out_of_order;
+                                   ++done;
+                                   if (sent < total)
+                                       send();
+                               }));
+    }
+
+    asio::io_context          &ioc;
+    worker_pool               &pool;
+    registered_handler        &h;
+    std::size_t                worker;
+    std::size_t                total;
+    std::vector< ws_message >  messages;
+    std::size_t                sent         = 0;
+    std::size_t                done         = 0;
+    std::size_t                out_of_order = 0;
+};
+
+void
+measure_pool(std::string_view name, std::size_t per_producer)
+{
+    if (bench::skip(name))
+        return;
+
+    auto pool         = worker_pool(worker_threads);
+    auto h            = registered_handler(
+        std::make_shared< busy_handler >(std::chrono::nanoseconds(0)));
+    auto out_of_order = std::vector< std::size_t >(producer_threads);
+    auto threads      = std::vector< std::thread >();
+    auto start        = clock::now();
+    for (std::size_t t = 0; t < producer_threads; ++t)
+        threads.emplace_back(
+            [&, t]
+            {
+                auto ioc = asio::io_context(1);
+                auto p   = producer(
+                    ioc, pool, h, t % worker_threads, per_producer);
+                p.start();
+                ioc.run();
+                out_of_order[t] = p.out_of_order;
+            });
+    for (auto &t : threads)
+        t.join();
+    auto elapsed = clock::now() - start;
+
+    auto total = std::size_t(0);
+    for (auto n : out_of_order)
+        total += n;
+    bench::report(name, per_producer * producer_threads, elapsed);
+    report_stats(name, h.stats(), total);
+}
+
+asio::awaitable< void >
+run_session(ssl::context &sslctx,
+            std::string   url,
+            std::size_t   messages,
+            std::size_t  &out_of_order)
+{
+    auto conn = co_await connect_websock(sslctx, url, 0, false);
+    auto sent = std::size_t(0);
+    while (sent < std::min(window, messages))
+        co_await conn->send_text(std::to_string(sent++));
+
+    for (std::size_t received = 0; received < messages; ++received)
+    {
+        if (co_await conn->receive_view() != std::to_string(received))
+            ++out_of_order;
+        if (sent < messages)
+            co_await conn->send_text(std::to_string(sent++));
+    }
+    co_await conn->close(beast::websocket::close_reason(
+        beast::websocket::close_code::normal));
+}
+
+void
+measure_server(std::string_view name, echo_mode mode, std::size_t messages)
+{
+    if (bench::skip(name))
+        return;
+
+    auto route_file = fmt::format("bench_offload.{}.routes", ::getpid());
+    std::ofstream(route_file) << "https  /work{rest}  upgrade  work\n";
+
+    auto options           = server_options();
+    options.route_file     = route_file;
+    options.echo           = mode;
+    options.pipeline_depth = window;
+    options.worker_threads = worker_threads;
+
+    auto ioc  = asio::io_context(1);
+    auto svr  = server(ioc.get_executor(), std::move(options));
+    auto stop = asio::cancellation_signal();
+    std::remove(route_file.c_str());
+    svr.add_handler("work",
+                    std::make_shared< busy_handler >(
+                        std::chrono::microseconds(20)));
+    svr.run(stop.slot());
+    auto server_thread = std::thread([&] { ioc.run(); });
+
+    auto cioc         = asio::io_context(1);
+    auto sslctx       = ssl::context(ssl::context::tls_client);
+    auto out_of_order = std::size_t(0);
+    auto url          = svr.tls_root() + "/work";
+    auto start        = clock::now();
+    for (std::size_t i = 0; i < sessions; ++i)
+        asio::co_spawn(cioc,
+                       run_session(sslctx, url, messages, out_of_order),
+                       [](std::exception_ptr ep)
+                       {
+                           if (ep)
+                               std::rethrow_exception(ep);
+                       });
+    cioc.run();
+    auto elapsed = clock::now() - start;
+
+    asio::post(ioc, [&] { stop.emit(asio::cancellation_type::all); });
+    server_thread.join();
+
+    bench::report(name, sessions * messages, elapsed);
+    report_stats(name, svr.handler_report().at("work"), out_of_order);
+}
+
+}   // namespace
+
+int
+main(int argc, char **argv)
+{
+    bench::init(argc, argv);
+
+    measure_pool("offload.pool", 500'000);
+    measure_server("offload.sequential", echo_mode::sequential, 2'000);
+    measure_server("offload.pipelined", echo_mode::pipelined, 2'000);
+}
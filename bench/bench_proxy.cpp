@@ -0,0 +1,177 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+// Round trip time and throughput of websocket messages relayed by the
+// server's proxy mode, against the same messages sent straight to the backend
+// and echoed by the server itself:
+//
+//   relay.direct        client -> backend
+//   relay.server_echo   client -> server                  (tls)
+//   relay.proxy         client -> server -> backend       (tls, then plain)
+//
+// relay.proxy less relay.server_echo is the latency the relay adds.
+// items_per_sec is bytes echoed per second.
+//
+// The backend is a plain websocket echo server on a thread of this process.
+// The server runs in a child process, with a route table written for it.
+
+#include "bench.hpp"
+#include "connect_websock.hpp"
+#include "server_process.hpp"
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+
+namespace
+{
+using namespace blog;
+
+asio::awaitable< void >
+backend_session(tcp::socket sock)
+{
+    using asio::use_awaitable;
+
+    auto ws  = beast::websocket::stream< tcp::socket >(std::move(sock));
+    auto buf = beast::flat_buffer();
+    try
+    {
+        co_await ws.async_accept(use_awaitable);
+        for (;;)
+        {
+            co_await ws.async_read(buf, use_awaitable);
+            ws.text(ws.got_text());
+            co_await ws.async_write(buf.cdata(), use_awaitable);
+            buf.consume(buf.size());
+        }
+    }
+    catch (system_error &)
+    {
+    }
+}
+
+asio::awaitable< void >
+backend(tcp::acceptor &acceptor)
+{
+    using asio::use_awaitable;
+
+    for (;;)
+    {
+        auto sock = co_await acceptor.async_accept(use_awaitable);
+        sock.set_option(tcp::no_delay(true));
+        asio::co_spawn(acceptor.get_executor(),
+                       backend_session(std::move(sock)),
+                       asio::detached);
+    }
+}
+
+asio::awaitable< void >
+time_round_trips(std::string_view name,
+                 ssl::context    &sslctx,
+                 std::string      url,
+                 std::size_t      size,
+                 std::size_t      iterations)
+{
+    using clock = std::chrono::steady_clock;
+
+    if (bench::skip(name))
+        co_return;
+
+    auto conn = co_await connect_websock(sslctx, url, 0, false);
+    conn->sock().set_option(tcp::no_delay(true));
+
+    auto msg = std::string(size, 'x');
+    for (std::size_t i = 0; i < iterations / 10 + 1; ++i)
+    {
+        co_await conn->send_text(msg);
+        co_await conn->receive_view();
+    }
+
+    auto start = clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        co_await conn->send_text(msg);
+        bench::do_not_optimize(co_await conn->receive_view());
+    }
+    bench::report(name, iterations, clock::now() - start, size);
+
+    co_await conn->close(beast::websocket::close_reason(
+        beast::websocket::close_code::normal));
+}
+
+asio::awaitable< void >
+run_all(std::string backend_url, std::string tls_root)
+{
+    auto sslctx = ssl::context(ssl::context::tls_client);
+
+    for (std::size_t size : { 64, 65536 })
+    {
+        auto iterations = std::size_t(200'000'000) / (size + 20'000);
+        co_await time_round_trips(fmt::format("relay.direct {}", size),
+                                  sslctx,
+                                  backend_url,
+                                  size,
+                                  iterations);
+        co_await time_round_trips(fmt::format("relay.server_echo {}", size),
+                                  sslctx,
+                                  tls_root + "/websocket-0",
+                                  size,
+                                  iterations);
+        co_await time_round_trips(fmt::format("relay.proxy {}", size),
+                                  sslctx,
+                                  tls_root + "/proxy",
+                                  size,
+                                  iterations);
+    }
+}
+
+}   // namespace
+
+int
+main(int argc, char **argv)
+{
+    bench::init(argc, argv);
+
+    auto backend_ioc = asio::io_context(1);
+    auto acceptor    = tcp::acceptor(
+        backend_ioc, tcp::endpoint(ip::address_v4::loopback(), 0));
+    auto backend_url =
+        fmt::format("ws://127.0.0.1:{}/echo", acceptor.local_endpoint().port());
+
+    auto route_file = std::string("bench_proxy.routes");
+    std::ofstream(route_file)
+        << "https  /websocket-0{rest}  upgrade  echo\n"
+        << "https  /proxy{rest}        upgrade  proxy  " << backend_url << "\n"
+        << "https  {any}               reply    404 not found\n";
+
+    auto options       = server_options();
+    options.route_file = route_file;
+    auto child         = bench::server_process(std::move(options));
+    std::remove(route_file.c_str());
+
+    asio::co_spawn(backend_ioc, backend(acceptor), asio::detached);
+    auto backend_thread = std::thread([&] { backend_ioc.run(); });
+
+    auto ioc = asio::io_context(1);
+    asio::co_spawn(ioc,
+                   run_all(backend_url, child.tls_root),
+                   [](std::exception_ptr ep)
+                   {
+                       if (ep)
+                           std::rethrow_exception(ep);
+                   });
+    ioc.run();
+
+    backend_ioc.stop();
+    backend_thread.join();
+}
@@ -0,0 +1,64 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+// Measures the rate at which the pubsub hub delivers messages to large numbers
+// of subscribers. Each iteration publishes one message and drains every
+// subscriber's queue, as the subscribers' writers would.
+
+#include "bench.hpp"
+#include "pubsub.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+int
+main(int argc, char **argv)
+{
+    using namespace blog;
+    using bench::do_not_optimize;
+
+    bench::init(argc, argv);
+
+    auto ioc = asio::io_context();
+
+    for (std::size_t subscribers : { 1'000, 10'000 })
+    {
+        auto hub  = pubsub_hub();
+        auto subs = std::vector< std::unique_ptr< subscription > >();
+        for (std::size_t i = 0; i < subscribers; ++i)
+        {
+            subs.push_back(std::make_unique< subscription >(
+                ioc.get_executor(), 1024, drop_policy::drop_oldest));
+            hub.subscribe("bench", *subs.back());
+        }
+
+        auto msg = std::make_shared< published_message >();
+        auto buf = msg->buffer.prepare(64);
+        std::fill_n(static_cast< char * >(buf.data()), buf.size(), 'x');
+        msg->buffer.commit(buf.size());
+        auto shared = message_ptr(std::move(msg));
+
+        bench::run(
+            fmt::format("pubsub.fanout{}", subscribers),
+            10'000'000 / subscribers,
+            [&]
+            {
+                hub.publish("bench", shared);
+                for (auto &sub : subs)
+                    do_not_optimize(sub->try_pop());
+            },
+            subscribers);
+
+        for (auto &sub : subs)
+            hub.unsubscribe("bench", *sub);
+    }
+}
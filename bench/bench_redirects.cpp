@@ -0,0 +1,106 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+// Time for a client to get from ws://.../websocket-5 to an open websocket,
+// following the whole redirect chain: one plain http hop, then five tls ones,
+// each on a new connection.
+//
+//   redirect_chain.system     sockets as the system creates them, on both
+//                             the client and the server
+//   redirect_chain.tuned      the default socket_profile on both sides
+//   redirect_chain.resolved   tuned, with the server following its own
+//                             redirects, so only the http hop is visible
+//
+// Fast Open only takes effect where net.ipv4.tcp_fastopen allows it; see
+// socket_profile.hpp.
+
+#include "bench.hpp"
+#include "connect_websock.hpp"
+#include "server_process.hpp"
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <string>
+
+namespace
+{
+using namespace blog;
+
+asio::awaitable< void >
+time_chain(std::string_view name,
+           std::string      url,
+           socket_profile   profile,
+           std::size_t      iterations)
+{
+    using clock = std::chrono::steady_clock;
+
+    auto sslctx = ssl::context(ssl::context::tls_client);
+
+    auto once = [&]() -> asio::awaitable< void >
+    {
+        auto conn = co_await connect_websock(sslctx, url, 6, false, profile);
+        co_await conn->close(beast::websocket::close_reason(
+            beast::websocket::close_code::normal));
+    };
+
+    // the warmup also collects the Fast Open cookies
+    for (std::size_t i = 0; i < iterations / 10 + 1; ++i)
+        co_await once();
+
+    auto start = clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+        co_await once();
+    bench::report(name, iterations, clock::now() - start);
+}
+
+void
+measure(std::string_view name,
+        socket_profile   profile,
+        bool             resolve,
+        std::size_t      iterations)
+{
+    if (bench::skip(name))
+        return;
+
+    auto options              = server_options();
+    options.socket            = profile;
+    options.resolve_redirects = resolve;
+    auto child                = bench::server_process(std::move(options));
+
+    auto ioc = asio::io_context(1);
+    asio::co_spawn(ioc,
+                   time_chain(name,
+                              child.tcp_root + "/websocket-5",
+                              profile,
+                              iterations),
+                   [](std::exception_ptr ep)
+                   {
+                       if (ep)
+                           std::rethrow_exception(ep);
+                   });
+    ioc.run();
+}
+
+}   // namespace
+
+int
+main(int argc, char **argv)
+{
+    bench::init(argc, argv);
+
+    auto const iterations = std::size_t(200);
+
+    measure("redirect_chain.system",
+            socket_profile::system_default(),
+            false,
+            iterations);
+    measure("redirect_chain.tuned", socket_profile(), false, iterations);
+    measure("redirect_chain.resolved", socket_profile(), true, iterations);
+}
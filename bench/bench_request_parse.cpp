@@ -0,0 +1,159 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+// The cost of parsing a websocket upgrade request as the server reads it:
+//
+//   parse.<mode>              time per request parsed
+//   parse.<mode>.allocations  heap allocations per request parsed
+//
+// where mode is
+//
+//   string_body  a fresh flat_buffer and request<string_body> per request,
+//                as serve_upgrade used to read it
+//   pooled       a request_slot from the thread's pool, as it reads it now
+//
+// The bytes are copied into the buffer in the chunks that http::async_read
+// would ask for, so only the network is missing. Allocations are counted by
+// replacing the global operator new.
+
+#include "bench.hpp"
+#include "request_pool.hpp"
+
+#include <boost/beast/core/read_size.hpp>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string_view>
+
+namespace
+{
+std::size_t allocations = 0;
+}
+
+void *
+operator new(std::size_t n)
+{
+    ++allocations;
+    if (auto p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void
+operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void
+operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+using namespace blog;
+
+using clock = std::chrono::steady_clock;
+
+constexpr std::string_view upgrade_request =
+    "GET /websocket-0/chat?room=1 HTTP/1.1\r\n"
+    "Host: backend-17.example.com:8443\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:104.0) Gecko/20100101 "
+    "Firefox/104.0\r\n"
+    "Accept: */*\r\n"
+    "Accept-Language: en-GB,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "Origin: https://www.example.com\r\n"
+    "Sec-WebSocket-Extensions: permessage-deflate\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Connection: keep-alive, Upgrade\r\n"
+    "Pragma: no-cache\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Upgrade: websocket\r\n"
+    "\r\n";
+
+// what http::read does, with wire standing in for the stream
+template < class DynamicBuffer, class Parser >
+void
+parse(std::string_view wire, DynamicBuffer &buffer, Parser &parser)
+{
+    while (!parser.is_header_done())
+    {
+        auto n = std::min(wire.size(), beast::read_size(buffer, 65536));
+        std::memcpy(buffer.prepare(n).data(), wire.data(), n);
+        buffer.commit(n);
+        wire.remove_prefix(n);
+
+        auto ec = error_code();
+        buffer.consume(parser.put(buffer.data(), ec));
+        if (ec && ec != beast::http::error::need_more)
+            throw system_error(ec);
+    }
+}
+
+template < class Parse >
+void
+measure(std::string_view name, std::size_t iterations, Parse parse_one)
+{
+    if (bench::skip(name))
+        return;
+
+    parse_one();
+
+    auto before = allocations;
+    auto start  = clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+        parse_one();
+    auto elapsed = clock::now() - start;
+    auto allocs  = allocations - before;
+
+    bench::report(name, iterations, elapsed);
+    bench::report_value(fmt::format("{}.allocations", name),
+                        "per_op",
+                        double(allocs) / double(iterations));
+}
+
+}   // namespace
+
+int
+main(int argc, char **argv)
+{
+    bench::init(argc, argv);
+
+    constexpr std::size_t iterations = 1'000'000;
+
+    measure("parse.string_body",
+            iterations,
+            []
+            {
+                auto buffer = beast::flat_buffer();
+                auto parser =
+                    beast::http::request_parser< beast::http::string_body >();
+                parse(upgrade_request, buffer, parser);
+                bench::do_not_optimize(
+                    beast::websocket::is_upgrade(parser.get()));
+            });
+
+    measure("parse.pooled",
+            iterations,
+            []
+            {
+                auto slot = acquire_request();
+                parse(upgrade_request, slot->buffer, slot->parser());
+                bench::do_not_optimize(
+                    beast::websocket::is_upgrade(slot->request()));
+            });
+}
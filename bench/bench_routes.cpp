@@ -0,0 +1,121 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+// Compares the compiled route table against the std::regex matching that
+// serve_http and serve_https used to perform.
+
+#include "bench.hpp"
+#include "route_table.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr auto default_routes = std::string_view(R"(
+http   /websocket-{n}{rest}  redirect  {tls_root}{target}
+http   {any}                 reply     404 resource {target} is not recognised
+https  /websocket-0{rest}    upgrade   echo
+https  /websocket-{n}{rest}  redirect  {tls_root}/websocket-{n-1}{rest}
+https  {any}                 reply     404 try /websocket-5
+)");
+
+constexpr std::string_view targets[] = { "/websocket-5",
+                                         "/websocket-0/chat/room-1",
+                                         "/favicon.ico" };
+
+}   // namespace
+
+int
+main(int argc, char **argv)
+{
+    using namespace blog;
+    using bench::do_not_optimize;
+
+    bench::init(argc, argv);
+
+    auto const iterations = std::size_t(1'000'000);
+
+    // the regex that serve_https used
+    static const auto https_re = std::regex(
+        "/websocket-(\\d+)(/.*)?",
+        std::regex_constants::icase | std::regex_constants::optimize);
+
+    auto routes = parse_routes(default_routes);
+
+    for (auto target : targets)
+    {
+        bench::run(fmt::format("routes.regex.https {}", target),
+                   iterations,
+                   [&]
+                   {
+                       auto match = std::cmatch();
+                       auto index = -1;
+                       if (std::regex_match(target.begin(),
+                                            target.end(),
+                                            match,
+                                            https_re))
+                           index = ::atoi(match[1].str().c_str());
+                       do_not_optimize(index);
+                   });
+
+        bench::run(fmt::format("routes.trie.https {}", target),
+                   iterations,
+                   [&]
+                   {
+                       auto match = routes.https.match(target);
+                       do_not_optimize(match);
+                   });
+    }
+
+    // A large table, as might be generated for thousands of tenants. A regex
+    // router has no choice but to try each pattern in turn.
+    auto const route_count = 5000;
+    auto       big         = route_table();
+    auto       regexes     = std::vector< std::regex >();
+    for (int i = 0; i < route_count; ++i)
+    {
+        big.add(fmt::format("/tenant-{}/websocket-{{n}}{{rest}}", i),
+                route { .action = route_action::upgrade, .behaviour = "echo" });
+        regexes.emplace_back(
+            fmt::format("/tenant-{}/websocket-(\\d+)(/.*)?", i),
+            std::regex_constants::icase | std::regex_constants::optimize);
+    }
+
+    auto const big_target = std::string_view("/tenant-4321/websocket-17/chat");
+
+    bench::run(fmt::format("routes.regex.scan{} {}", route_count, big_target),
+               iterations / 1000,
+               [&]
+               {
+                   auto match = std::cmatch();
+                   auto found = std::find_if(
+                       regexes.begin(),
+                       regexes.end(),
+                       [&](auto &re)
+                       {
+                           return std::regex_match(
+                               big_target.begin(), big_target.end(), match, re);
+                       });
+                   do_not_optimize(found);
+               });
+
+    bench::run(fmt::format("routes.trie{} {}", route_count, big_target),
+               iterations,
+               [&]
+               {
+                   auto match = big.match(big_target);
+                   do_not_optimize(match);
+               });
+}
@@ -0,0 +1,166 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_BENCH_SERVER_PROCESS_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_BENCH_SERVER_PROCESS_HPP
+
+#include "server.hpp"
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace blog::bench
+{
+
+/// A blog::server running in a child process, so that it has a core and a
+/// resident set of its own, and its diagnostics stay out of the benchmark's
+/// output. The child is killed when the object is destroyed, unless it has
+/// been stopped first.
+///
+/// Run benchmarks from the build directory, which holds routes.conf and the
+/// certificates the server loads.
+struct server_process
+{
+    explicit server_process(server_options options)
+    {
+        int fds[2];
+        if (::pipe(fds) != 0)
+            throw std::runtime_error("pipe failed");
+
+        pid = ::fork();
+        if (pid < 0)
+            throw std::runtime_error("fork failed");
+        if (pid == 0)
+        {
+            ::close(fds[0]);
+            run(fds[1], std::move(options));
+        }
+
+        ::close(fds[1]);
+        auto roots = std::string(512, '\0');
+        auto n     = ::read(fds[0], roots.data(), roots.size());
+        ::close(fds[0]);
+        if (n <= 0)
+            throw std::runtime_error("server failed to start");
+        roots.resize(std::size_t(n));
+
+        auto nl    = roots.find('\n');
+        auto nl2   = roots.find('\n', nl + 1);
+        tcp_root   = roots.substr(0, nl);
+        tls_root   = roots.substr(nl + 1, nl2 - nl - 1);
+        local_root = roots.substr(nl2 + 1);
+    }
+
+    server_process(server_process const &) = delete;
+
+    ~server_process()
+    {
+        if (pid <= 0)
+            return;
+        ::kill(pid, SIGKILL);
+        ::waitpid(pid, nullptr, 0);
+    }
+
+    /// Ask the server to stop, as it would on shutdown, and wait up to grace
+    /// for it to finish its sessions and exit. Returns whether it exited
+    /// cleanly; if not it is killed later, as if never stopped.
+    bool
+    stop(std::chrono::milliseconds grace)
+    {
+        ::kill(pid, SIGTERM);
+        auto deadline = std::chrono::steady_clock::now() + grace;
+        auto status   = 0;
+        while (::waitpid(pid, &status, WNOHANG) == 0)
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+                return false;
+            ::usleep(10'000);
+        }
+        pid = -1;
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    pid_t       pid = -1;
+    std::string tcp_root;
+    std::string tls_root;
+    std::string local_root;   // empty unless options.local_path was set
+
+  private:
+    // Runs in the child. Writes the server's roots to out once it is listening.
+    // SIGTERM stops the server, and the child exits with 0 once its sessions
+    // have finished and the server has been destroyed.
+    [[noreturn]] static void
+    run(int out, server_options options)
+    {
+        auto devnull = ::open("/dev/null", O_WRONLY);
+        ::dup2(devnull, STDOUT_FILENO);
+
+        auto status = 1;
+        try
+        {
+            auto ioc  = asio::io_context(1);
+            auto svr  = server(ioc.get_executor(), std::move(options));
+            auto stop = asio::cancellation_signal();
+            svr.run(stop.slot());
+
+            auto term = asio::signal_set(ioc, SIGTERM);
+            term.async_wait(
+                [&](error_code ec, int)
+                {
+                    if (!ec)
+                        stop.emit(asio::cancellation_type::all);
+                });
+
+            auto roots = fmt::format(
+                "{}\n{}\n{}", svr.tcp_root(), svr.tls_root(), svr.local_root());
+            if (::write(out, roots.data(), roots.size()) !=
+                ssize_t(roots.size()))
+                std::_Exit(1);
+            ::close(out);
+
+            ioc.run();
+            status = 0;
+        }
+        catch (std::exception &e)
+        {
+            fmt::print(stderr, "server: {}\n", e.what());
+        }
+        std::_Exit(status);
+    }
+};
+
+/// The resident set size of process pid, in bytes
+inline std::size_t
+resident_bytes(pid_t pid)
+{
+    auto path = fmt::format("/proc/{}/statm", pid);
+    auto f    = std::fopen(path.c_str(), "r");
+    if (!f)
+        return 0;
+
+    auto size = 0ul, resident = 0ul;
+    if (std::fscanf(f, "%lu %lu", &size, &resident) != 2)
+        resident = 0;
+    std::fclose(f);
+    return resident * std::size_t(::sysconf(_SC_PAGESIZE));
+}
+
+}   // namespace blog::bench
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_BENCH_SERVER_PROCESS_HPP
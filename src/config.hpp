@@ -10,11 +10,12 @@
 
 namespace blog
 {
-namespace asio  = ::boost::asio;
-namespace beast = ::boost::beast;
-namespace ssl   = asio::ssl;
-namespace ip    = asio::ip;
-using tcp       = ip::tcp;
+namespace asio     = ::boost::asio;
+namespace beast    = ::boost::beast;
+namespace ssl      = asio::ssl;
+namespace ip       = asio::ip;
+using tcp          = ip::tcp;
+using local_stream = asio::local::stream_protocol;
 
 using ::boost::system::error_code;
 using ::boost::system::system_error;
@@ -0,0 +1,237 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "connect_websock.hpp"
+
+#include "h2_websocket.hpp"
+#include "stitch.hpp"
+#include "url.hpp"
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <stdexcept>
+
+namespace blog
+{
+namespace
+{
+// tell the server which host we want, for servers that host several
+void
+set_sni(SSL *ssl, std::string const &hostname)
+{
+    if (!SSL_set_tlsext_host_name(ssl, hostname.c_str()))
+        throw system_error(
+            error_code { static_cast< int >(::ERR_get_error()),
+                         asio::error::get_ssl_category() });
+}
+}   // namespace
+
+asio::awaitable< std::unique_ptr< websock_connection > >
+connect_websock(ssl::context         &sslctx,
+                std::string           urlstr,
+                int const             redirect_limit,
+                bool                  verbose,
+                socket_profile const &profile,
+                h2_pool              *http2)
+{
+    using asio::experimental::deferred;
+
+    // for convenience, take a copy of the current executor
+    auto ex = co_await asio::this_coro::executor;
+
+    // number of redirects detected so far
+    int redirects = 0;
+
+    // build a resolver in order tp decode te FQDNs in urls
+    auto resolver = tcp::resolver(ex);
+
+    // the time taken by each step, summed over every hop
+    using clock  = std::chrono::steady_clock;
+    auto timings = connect_timings();
+    auto start   = clock::now();
+    auto mark    = start;
+    auto lap     = [&mark]
+    {
+        auto now = clock::now();
+        auto d =
+            std::chrono::duration_cast< std::chrono::microseconds >(now - mark);
+        mark = now;
+        return d;
+    };
+
+    // in the case of a redirect, we will resume processing here
+again:
+    if (verbose)
+        fmt::print("attempting connection: {}\n", urlstr);
+
+    // decode the URL into components
+    auto decoded = decode_url(urlstr);
+
+    // whether to try for a websocket over a shared HTTP/2 connection
+    auto authority = decoded.hostname + ':' + decoded.service;
+    auto use_h2    = http2 && decoded.transport == transport_type::tls &&
+                  !http2->http1_only(authority);
+
+    // an open connection to the same authority needs no connecting at all
+    auto result = std::unique_ptr< websock_connection >();
+    if (use_h2)
+        if (auto session = http2->find(authority, ex))
+        {
+            if (verbose)
+                fmt::print("...sharing http2 connection\n");
+            result = std::make_unique< websock_connection >(
+                h2_websocket(std::move(session)));
+        }
+
+    if (is_local(decoded.transport))
+    {
+        // a unix domain socket needs no resolving, and nothing tuned
+        result = decoded.transport == transport_type::local_tls
+                     ? std::make_unique< websock_connection >(
+                           ssl::stream< local_stream::socket >(ex, sslctx))
+                     : std::make_unique< websock_connection >(
+                           local_stream::socket(ex));
+        co_await result->local_sock().async_connect(
+            local_stream::endpoint(decoded.service), deferred);
+        timings.connect += lap();
+    }
+    else if (!result)
+    {
+        // build the appropriate websocket stream type depending on whether
+        // the URL indicates a TCP or TLS transport
+        result = decoded.transport == transport_type::tls
+                     ? std::make_unique< websock_connection >(
+                           ssl::stream< tcp::socket >(ex, sslctx))
+                     : std::make_unique< websock_connection >(tcp::socket(ex));
+
+        // connect the underlying socket of the websocket stream to the first
+        // reachable resolved endpoint
+        auto endpoints = co_await resolver.async_resolve(
+            decoded.hostname, decoded.service, deferred);
+        timings.resolve += lap();
+        co_await connect_with(result->sock(), endpoints, profile);
+        timings.connect += lap();
+    }
+
+    // if the connection is TLS, we will want to update the hostname
+    if (auto *tls = result->query_local_ssl(); tls)
+    {
+        set_sni(tls->native_handle(), decoded.hostname);
+        co_await tls->async_handshake(ssl::stream_base::client, deferred);
+        timings.tls += lap();
+    }
+    else if (auto *tls = result->query_ssl(); tls)
+    {
+        set_sni(tls->native_handle(), decoded.hostname);
+        if (use_h2)
+            offer_h2(*tls);
+        co_await tls->async_handshake(ssl::stream_base::client, deferred);
+        timings.tls += lap();
+
+        // the server chose h2, so the TLS stream becomes a connection that
+        // this and later websockets to the authority are streams of
+        if (use_h2 && negotiated_h2(*tls))
+        {
+            auto session = std::make_shared< h2_session >(
+                std::move(*tls), h2_session::role::client, http2->options());
+            co_await session->start();
+            if (!session->supports_websockets())
+            {
+                if (verbose)
+                    fmt::print("...no websockets over http2, retrying\n");
+                session->close();
+                http2->mark_http1_only(authority);
+                goto again;
+            }
+            http2->add(authority, session);
+            result = std::make_unique< websock_connection >(
+                h2_websocket(std::move(session)));
+        }
+    }
+
+    // some variables to receive the result of the handshake attempt
+    auto ec       = error_code();
+    auto response = beast::websocket::response_type();
+
+    // attempt a websocket handshake, preserving the response
+    if (verbose)
+        fmt::print("...handshake\n");
+    co_await result->try_handshake(
+        ec, response, decoded.hostname, decoded.path_etc);
+    timings.handshake += lap();
+
+    // in case of error, we have three scenarios, detailed below:
+    if (ec)
+    {
+        if (verbose)
+            fmt::print(
+                "...error: {}\n{}", ec.message(), stitch(response.base()));
+        auto http_result = response.result_int();
+        switch (response.result())
+        {
+        case beast::http::status::permanent_redirect:
+        case beast::http::status::temporary_redirect:
+        case beast::http::status::multiple_choices:
+        case beast::http::status::found:
+        case beast::http::status::see_other:
+        case beast::http::status::moved_permanently:
+            //
+            // Scenario 1: We have been redirected
+            //
+            if (response.count(beast::http::field::location))
+            {
+                if (++redirects <= redirect_limit)
+                {
+                    // perform the redirect by updating the URL and jumping to
+                    // the goto label above.
+                    auto &loc = response[beast::http::field::location];
+                    urlstr.assign(loc.begin(), loc.end());
+                    goto again;
+                }
+                else
+                {
+                    throw std::runtime_error("too many redirects");
+                }
+            }
+            else
+            {
+                //
+                // Scenario 2: we have some other HTTP response which is not an
+                // upgrade
+                //
+                throw system_error(ec,
+                                   stitch("malformed redirect\r\n", response));
+            }
+            break;
+
+        default:
+            //
+            // Scenario 3: Some other transport error
+            //
+            throw system_error(ec, stitch(response));
+        }
+    }
+    else
+    {
+        //
+        // successful handshake
+        //
+        if (verbose)
+            fmt::print("...success\n{}", stitch(response.base()));
+    }
+
+    timings.redirects = std::uint32_t(redirects);
+    timings.total =
+        std::chrono::duration_cast< std::chrono::microseconds >(mark - start);
+    result->timings_ = timings;
+    co_return result;
+}
+
+}   // namespace blog
@@ -0,0 +1,47 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_CONNECT_WEBSOCK_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_CONNECT_WEBSOCK_HPP
+
+#include "config.hpp"
+#include "h2_session.hpp"
+#include "socket_profile.hpp"
+#include "websock_connection.hpp"
+
+#include <memory>
+#include <string>
+
+namespace blog
+{
+
+/// Connect a websocket to urlstr, following up to redirect_limit redirects.
+/// The connection's I/O objects use the calling coroutine's executor.
+/// When verbose is set, each step of the connection is printed. Every TCP
+/// connection made along the way is given the options in profile.
+///
+/// A ws+unix:// or wss+unix:// url is reached over the unix domain socket it
+/// names, skipping the resolver and the TCP stack. See decode_url.
+///
+/// If http2 is given, wss:// websockets are opened as streams of HTTP/2
+/// connections held in the pool, which is offered h2 through ALPN when a new
+/// connection is needed. Websockets to the same authority then share one TLS
+/// session rather than each making its own. Servers that do not take
+/// websockets over h2 are reached over HTTP/1.1 as before.
+asio::awaitable< std::unique_ptr< websock_connection > >
+connect_websock(ssl::context         &sslctx,
+                std::string           urlstr,
+                int const             redirect_limit = 5,
+                bool                  verbose        = true,
+                socket_profile const &profile        = {},
+                h2_pool              *http2          = nullptr);
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_CONNECT_WEBSOCK_HPP
@@ -0,0 +1,186 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "connection_stats.hpp"
+
+#include "counter.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace blog
+{
+namespace
+{
+// values below this each have a bucket of their own
+constexpr auto linear_limit = std::uint64_t(1) << rtt_histogram::sub_bits;
+
+template < class T >
+std::uint64_t
+read(std::atomic< T > const &counter)
+{
+    return counter.load(std::memory_order_relaxed);
+}
+
+std::uint64_t
+microseconds(std::chrono::microseconds d)
+{
+    return std::uint64_t(std::max< std::int64_t >(d.count(), 0));
+}
+}   // namespace
+
+std::size_t
+rtt_histogram::bucket_of(std::uint64_t us)
+{
+    if (us < linear_limit)
+        return std::size_t(us);
+
+    auto top = std::bit_width(us) - 1;
+    if (top >= max_bits)
+        return bucket_count - 1;
+    auto sub = (us >> (top - sub_bits)) & (linear_limit - 1);
+    return (std::size_t(top - sub_bits + 1) << sub_bits) + sub;
+}
+
+std::uint64_t
+rtt_histogram::lower_bound(std::size_t b)
+{
+    if (b < linear_limit)
+        return b;
+
+    auto top = int(b >> sub_bits) + sub_bits - 1;
+    auto sub = b & (linear_limit - 1);
+    return (linear_limit + sub) << (top - sub_bits);
+}
+
+void
+rtt_histogram::record(std::chrono::microseconds rtt)
+{
+    ++counts[bucket_of(microseconds(rtt))];
+}
+
+std::uint64_t
+rtt_histogram::count() const
+{
+    auto total = std::uint64_t(0);
+    for (auto c : counts)
+        total += c;
+    return total;
+}
+
+std::chrono::microseconds
+rtt_histogram::percentile(double p) const
+{
+    auto total = count();
+    if (!total)
+        return std::chrono::microseconds(0);
+
+    auto rank = std::max< std::uint64_t >(
+        1, std::uint64_t(std::ceil(std::clamp(p, 0.0, 1.0) * double(total))));
+    auto seen = std::uint64_t(0);
+    for (std::size_t b = 0; b < bucket_count; ++b)
+    {
+        seen += counts[b];
+        if (seen >= rank)
+        {
+            // the middle of the bucket is within half its width of any
+            // value that was counted in it
+            auto lo = lower_bound(b);
+            auto hi = b + 1 < bucket_count ? lower_bound(b + 1) : lo + 1;
+            return std::chrono::microseconds(lo + (hi - lo) / 2);
+        }
+    }
+    return std::chrono::microseconds(lower_bound(bucket_count - 1));
+}
+
+rtt_histogram &
+rtt_histogram::operator+=(rtt_histogram const &other)
+{
+    for (std::size_t b = 0; b < bucket_count; ++b)
+        counts[b] += other.counts[b];
+    return *this;
+}
+
+connection_stats &
+connection_stats::operator+=(connection_stats const &other)
+{
+    connections += other.connections;
+    messages_in += other.messages_in;
+    messages_out += other.messages_out;
+    bytes_in += other.bytes_in;
+    bytes_out += other.bytes_out;
+    redirects += other.redirects;
+    resolve_us += other.resolve_us;
+    connect_us += other.connect_us;
+    tls_us += other.tls_us;
+    handshake_us += other.handshake_us;
+    setup_us += other.setup_us;
+    pongs += other.pongs;
+    rtt_total_us += other.rtt_total_us;
+    rtt += other.rtt;
+    return *this;
+}
+
+void
+connection_metrics::on_open(connect_timings const &timings)
+{
+    bump(connections_);
+    bump(redirects_, timings.redirects);
+    bump(resolve_us_, microseconds(timings.resolve));
+    bump(connect_us_, microseconds(timings.connect));
+    bump(tls_us_, microseconds(timings.tls));
+    bump(handshake_us_, microseconds(timings.handshake));
+    bump(setup_us_, microseconds(timings.total));
+}
+
+void
+connection_metrics::on_message_in(std::size_t bytes)
+{
+    bump(messages_in_);
+    bump(bytes_in_, bytes);
+}
+
+void
+connection_metrics::on_message_out(std::size_t bytes)
+{
+    bump(messages_out_);
+    bump(bytes_out_, bytes);
+}
+
+void
+connection_metrics::on_rtt(std::chrono::microseconds rtt)
+{
+    bump(pongs_);
+    bump(rtt_total_us_, microseconds(rtt));
+    bump(rtt_[rtt_histogram::bucket_of(microseconds(rtt))]);
+}
+
+connection_stats
+connection_metrics::snapshot() const
+{
+    auto s = connection_stats { .connections  = read(connections_),
+                                .messages_in  = read(messages_in_),
+                                .messages_out = read(messages_out_),
+                                .bytes_in     = read(bytes_in_),
+                                .bytes_out    = read(bytes_out_),
+                                .redirects    = read(redirects_),
+                                .resolve_us   = read(resolve_us_),
+                                .connect_us   = read(connect_us_),
+                                .tls_us       = read(tls_us_),
+                                .handshake_us = read(handshake_us_),
+                                .setup_us     = read(setup_us_),
+                                .pongs        = read(pongs_),
+                                .rtt_total_us = read(rtt_total_us_) };
+    for (std::size_t b = 0; b < rtt_histogram::bucket_count; ++b)
+        s.rtt.counts[b] = std::uint32_t(read(rtt_[b]));
+    return s;
+}
+
+}   // namespace blog
@@ -0,0 +1,168 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_CONNECTION_STATS_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_CONNECTION_STATS_HPP
+
+#include <boost/describe.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace blog
+{
+
+/// A histogram of round trip times in microseconds, with buckets spaced
+/// log-linearly: 8 to each power of two, so any value is placed within 12.5%.
+/// Times from 0 to 16.7s take 176 counters; longer ones share the last.
+struct rtt_histogram
+{
+    static constexpr int         sub_bits     = 3;
+    static constexpr int         max_bits     = 24;
+    static constexpr std::size_t bucket_count = (max_bits - sub_bits + 1)
+                                                << sub_bits;
+
+    static std::size_t
+    bucket_of(std::uint64_t us);
+
+    /// The smallest value counted in bucket b
+    static std::uint64_t
+    lower_bound(std::size_t b);
+
+    void
+    record(std::chrono::microseconds rtt);
+
+    std::uint64_t
+    count() const;
+
+    /// The time under which fraction p of the samples fall, to the bucket
+    std::chrono::microseconds
+    percentile(double p) const;
+
+    rtt_histogram &
+    operator+=(rtt_histogram const &other);
+
+    std::array< std::uint32_t, bucket_count > counts {};
+};
+
+/// How long it took to open one connection, summed over every hop of any
+/// redirects that were followed
+struct connect_timings
+{
+    std::chrono::microseconds resolve { 0 };
+    std::chrono::microseconds connect { 0 };     // TCP
+    std::chrono::microseconds tls { 0 };         // TLS handshakes
+    std::chrono::microseconds handshake { 0 };   // websocket handshakes
+    std::chrono::microseconds total { 0 };
+    std::uint32_t             redirects = 0;
+};
+
+/// A snapshot of a connection_metrics, or the sum of several. Timings are
+/// totals over the connections counted; divide by connections for a mean.
+struct connection_stats
+{
+    std::uint64_t connections  = 0;
+    std::uint64_t messages_in  = 0;
+    std::uint64_t messages_out = 0;
+    std::uint64_t bytes_in     = 0;
+    std::uint64_t bytes_out    = 0;
+    std::uint64_t redirects    = 0;
+    std::uint64_t resolve_us   = 0;
+    std::uint64_t connect_us   = 0;
+    std::uint64_t tls_us       = 0;
+    std::uint64_t handshake_us = 0;
+    std::uint64_t setup_us     = 0;   // from first resolve to open websocket
+    std::uint64_t pongs        = 0;
+    std::uint64_t rtt_total_us = 0;
+    rtt_histogram rtt;
+
+    std::chrono::microseconds
+    mean_setup() const
+    {
+        return std::chrono::microseconds(
+            connections ? setup_us / connections : 0);
+    }
+
+    std::chrono::microseconds
+    mean_rtt() const
+    {
+        return std::chrono::microseconds(pongs ? rtt_total_us / pongs : 0);
+    }
+
+    connection_stats &
+    operator+=(connection_stats const &other);
+};
+
+BOOST_DESCRIBE_STRUCT(connection_stats,
+                      (),
+                      (connections,
+                       messages_in,
+                       messages_out,
+                       bytes_in,
+                       bytes_out,
+                       redirects,
+                       resolve_us,
+                       connect_us,
+                       tls_us,
+                       handshake_us,
+                       setup_us,
+                       pongs,
+                       rtt_total_us))
+
+/// Live counters for one client connection, or for a group of them.
+///
+/// There must be only one writer at a time, such as the single thread of the
+/// io_context on which the connections run, so that counting a message is a
+/// plain load and store rather than a locked read-modify-write. Any thread
+/// may take a snapshot, at the cost of a relaxed load per counter.
+struct connection_metrics
+{
+    /// A connection has been opened, taking timings to do so
+    void
+    on_open(connect_timings const &timings);
+
+    void
+    on_message_in(std::size_t bytes);
+
+    void
+    on_message_out(std::size_t bytes);
+
+    void
+    on_rtt(std::chrono::microseconds rtt);
+
+    connection_stats
+    snapshot() const;
+
+  private:
+    using counter = std::atomic< std::uint64_t >;
+
+    counter connections_ { 0 };
+    counter messages_in_ { 0 };
+    counter messages_out_ { 0 };
+    counter bytes_in_ { 0 };
+    counter bytes_out_ { 0 };
+    counter redirects_ { 0 };
+    counter resolve_us_ { 0 };
+    counter connect_us_ { 0 };
+    counter tls_us_ { 0 };
+    counter handshake_us_ { 0 };
+    counter setup_us_ { 0 };
+    counter pongs_ { 0 };
+    counter rtt_total_us_ { 0 };
+
+    std::array< std::atomic< std::uint32_t >, rtt_histogram::bucket_count >
+        rtt_ {};
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_CONNECTION_STATS_HPP
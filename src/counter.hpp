@@ -0,0 +1,33 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_COUNTER_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_COUNTER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace blog
+{
+
+/// Add n to a statistics counter that other threads only read.
+///
+/// Counters have a single writer, so a plain load and store is enough and
+/// avoids a locked read-modify-write on every message.
+template < class T >
+inline void
+bump(std::atomic< T > &counter, std::uint64_t n = 1)
+{
+    counter.store(T(counter.load(std::memory_order_relaxed) + n),
+                  std::memory_order_relaxed);
+}
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_COUNTER_HPP
@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "echo_pipeline.hpp"
+
+#include <algorithm>
+
+namespace blog
+{
+
+echo_pipeline::echo_pipeline(asio::any_io_executor exec,
+                             std::size_t           depth,
+                             std::size_t           keep)
+: keep_(keep)
+, space_signal_(exec)
+, ready_signal_(exec)
+{
+    depth = std::max< std::size_t >(depth, 1);
+    for (std::size_t i = 0; i < depth; ++i)
+    {
+        storage_.push_back(std::make_unique< message >());
+        free_.push_back(storage_.back().get());
+    }
+}
+
+asio::awaitable< echo_pipeline::message * >
+echo_pipeline::acquire()
+{
+    while (free_.empty())
+        co_await space_signal_.wait();
+
+    auto *m = free_.back();
+    free_.pop_back();
+    co_return m;
+}
+
+void
+echo_pipeline::push(message *m)
+{
+    queue_.push_back(m);
+    ready_signal_.wake();
+}
+
+asio::awaitable< echo_pipeline::message * >
+echo_pipeline::pop()
+{
+    while (queue_.empty())
+        co_await ready_signal_.wait();
+
+    auto *m = queue_.front();
+    queue_.pop_front();
+    co_return m;
+}
+
+void
+echo_pipeline::release(message *m)
+{
+    m->buffer.clear();
+    if (m->buffer.capacity() > keep_)
+        m->buffer.shrink_to_fit();
+    free_.push_back(m);
+    space_signal_.wake();
+}
+
+std::size_t
+echo_pipeline::capacity() const
+{
+    auto total = std::size_t(0);
+    for (auto &m : storage_)
+        total += m->buffer.capacity();
+    return total;
+}
+
+}   // namespace blog
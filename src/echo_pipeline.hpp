@@ -0,0 +1,96 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_ECHO_PIPELINE_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_ECHO_PIPELINE_HPP
+
+#include "config.hpp"
+#include "message_handler.hpp"
+#include "wake_signal.hpp"
+
+#include <boost/describe.hpp>
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace blog
+{
+
+/// How the server echoes websocket messages
+enum class echo_mode
+{
+    sequential,   // read a message, write it back, then read the next
+    pipelined     // read and write concurrently, through an echo_pipeline
+};
+
+BOOST_DESCRIBE_ENUM(echo_mode, sequential, pipelined)
+
+/// A bounded queue of messages between one reader and one writer, whose
+/// buffers are recycled so that a steady stream of messages allocates
+/// nothing.
+///
+/// There are exactly depth buffers. The reader takes a free one with
+/// acquire(), fills it and push()es it; the writer pop()s it, sends it and
+/// release()s it. When the writer falls behind, every buffer ends up queued
+/// and acquire() waits, so the reader stops reading and TCP flow control
+/// pushes back on the peer.
+///
+/// Like the rest of the server it is not thread safe, and must only be used
+/// from the connection's executor.
+struct echo_pipeline
+{
+    using message = ws_message;
+
+    /// Buffers grown past keep bytes by a large message are shrunk again
+    /// when they are released.
+    echo_pipeline(asio::any_io_executor exec,
+                  std::size_t           depth,
+                  std::size_t           keep);
+
+    /// Wait for a free buffer
+    asio::awaitable< message * >
+    acquire();
+
+    /// Queue a filled buffer for the writer
+    void
+    push(message *m);
+
+    /// Wait for the next queued message
+    asio::awaitable< message * >
+    pop();
+
+    /// Return a buffer that has been written to the free list
+    void
+    release(message *m);
+
+    /// Messages read but not yet written
+    std::size_t
+    queued() const
+    {
+        return queue_.size();
+    }
+
+    /// Bytes allocated by all the buffers
+    std::size_t
+    capacity() const;
+
+  private:
+    std::vector< std::unique_ptr< message > > storage_;
+    std::vector< message * >                  free_;
+    std::deque< message * >                   queue_;
+    std::size_t                               keep_;
+    wake_signal                               space_signal_;
+    wake_signal                               ready_signal_;
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_ECHO_PIPELINE_HPP
@@ -0,0 +1,108 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "h2_frame.hpp"
+
+namespace blog
+{
+namespace
+{
+struct h2_category_impl : boost::system::error_category
+{
+    char const *
+    name() const noexcept override
+    {
+        return "http2";
+    }
+
+    std::string
+    message(int ev) const override
+    {
+        switch (static_cast< h2_error >(ev))
+        {
+        case h2_error::no_error:
+            return "no error";
+        case h2_error::protocol_error:
+            return "protocol error";
+        case h2_error::internal_error:
+            return "internal error";
+        case h2_error::flow_control_error:
+            return "flow control error";
+        case h2_error::settings_timeout:
+            return "settings timeout";
+        case h2_error::stream_closed:
+            return "stream closed";
+        case h2_error::frame_size_error:
+            return "frame size error";
+        case h2_error::refused_stream:
+            return "stream refused";
+        case h2_error::cancel:
+            return "stream cancelled";
+        case h2_error::compression_error:
+            return "header compression error";
+        case h2_error::connect_error:
+            return "connect error";
+        case h2_error::enhance_your_calm:
+            return "enhance your calm";
+        case h2_error::inadequate_security:
+            return "inadequate security";
+        case h2_error::http_1_1_required:
+            return "HTTP/1.1 required";
+        }
+        return "unknown http2 error";
+    }
+};
+}   // namespace
+
+boost::system::error_category const &
+h2_category()
+{
+    static h2_category_impl const category;
+    return category;
+}
+
+h2_frame_header
+h2_frame_header::parse(unsigned char const *p)
+{
+    auto h   = h2_frame_header();
+    h.length = std::uint32_t(p[0]) << 16 | std::uint32_t(p[1]) << 8 | p[2];
+    h.type   = static_cast< h2_frame_type >(p[3]);
+    h.flags  = p[4];
+    h.stream = read_u32(p + 5) & 0x7fffffff;
+    return h;
+}
+
+void
+h2_frame_header::append_to(std::string &out) const
+{
+    out.push_back(char(length >> 16));
+    out.push_back(char(length >> 8));
+    out.push_back(char(length));
+    out.push_back(char(type));
+    out.push_back(char(flags));
+    append_u32(out, stream);
+}
+
+void
+append_u16(std::string &out, std::uint16_t v)
+{
+    out.push_back(char(v >> 8));
+    out.push_back(char(v));
+}
+
+void
+append_u32(std::string &out, std::uint32_t v)
+{
+    out.push_back(char(v >> 24));
+    out.push_back(char(v >> 16));
+    out.push_back(char(v >> 8));
+    out.push_back(char(v));
+}
+
+}   // namespace blog
@@ -0,0 +1,160 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_H2_FRAME_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_H2_FRAME_HPP
+
+#include "config.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace blog
+{
+
+/// What every HTTP/2 client sends before its first frame (RFC 9113 3.4)
+constexpr std::string_view h2_client_preface =
+    "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+/// The protocol identifier offered and selected through ALPN
+constexpr std::string_view h2_alpn = "h2";
+
+enum class h2_frame_type : std::uint8_t
+{
+    data          = 0x0,
+    headers       = 0x1,
+    priority      = 0x2,
+    rst_stream    = 0x3,
+    settings      = 0x4,
+    push_promise  = 0x5,
+    ping          = 0x6,
+    goaway        = 0x7,
+    window_update = 0x8,
+    continuation  = 0x9
+};
+
+namespace h2_flag
+{
+constexpr std::uint8_t end_stream  = 0x1;
+constexpr std::uint8_t ack         = 0x1;   // settings and ping
+constexpr std::uint8_t end_headers = 0x4;
+constexpr std::uint8_t padded      = 0x8;
+constexpr std::uint8_t priority    = 0x20;
+}   // namespace h2_flag
+
+enum class h2_setting : std::uint16_t
+{
+    header_table_size       = 0x1,
+    enable_push             = 0x2,
+    max_concurrent_streams  = 0x3,
+    initial_window_size     = 0x4,
+    max_frame_size          = 0x5,
+    max_header_list_size    = 0x6,
+    enable_connect_protocol = 0x8   // RFC 8441
+};
+
+/// The error codes of RST_STREAM and GOAWAY frames. A failed stream or
+/// connection completes its operations with one of these.
+enum class h2_error : std::uint32_t
+{
+    no_error            = 0x0,
+    protocol_error      = 0x1,
+    internal_error      = 0x2,
+    flow_control_error  = 0x3,
+    settings_timeout    = 0x4,
+    stream_closed       = 0x5,
+    frame_size_error    = 0x6,
+    refused_stream      = 0x7,
+    cancel              = 0x8,
+    compression_error   = 0x9,
+    connect_error       = 0xa,
+    enhance_your_calm   = 0xb,
+    inadequate_security = 0xc,
+    http_1_1_required   = 0xd
+};
+
+boost::system::error_category const &
+h2_category();
+
+inline error_code
+make_error_code(h2_error e)
+{
+    return error_code(static_cast< int >(e), h2_category());
+}
+
+/// The largest flow control window, and the default frame size limit
+constexpr std::uint32_t h2_max_window        = 0x7fffffff;
+constexpr std::uint32_t h2_default_frame_max = 16384;
+constexpr std::uint32_t h2_default_window    = 65535;
+
+/// The nine bytes in front of every frame
+struct h2_frame_header
+{
+    static constexpr std::size_t size = 9;
+
+    std::uint32_t length = 0;
+    h2_frame_type type   = h2_frame_type::data;
+    std::uint8_t  flags  = 0;
+    std::uint32_t stream = 0;
+
+    bool
+    has(std::uint8_t flag) const
+    {
+        return (flags & flag) != 0;
+    }
+
+    /// p must point to size bytes
+    static h2_frame_header
+    parse(unsigned char const *p);
+
+    /// Append the header to out. The payload of length bytes must follow.
+    void
+    append_to(std::string &out) const;
+};
+
+/// The settings one side of a connection has announced, with the defaults
+/// that apply until it does
+struct h2_settings
+{
+    std::uint32_t header_table_size       = 4096;
+    std::uint32_t max_concurrent_streams  = 0xffffffff;
+    std::uint32_t initial_window_size     = h2_default_window;
+    std::uint32_t max_frame_size          = h2_default_frame_max;
+    std::uint32_t max_header_list_size    = 0xffffffff;
+    bool          enable_push             = true;
+    bool          enable_connect_protocol = false;
+};
+
+void
+append_u16(std::string &out, std::uint16_t v);
+
+void
+append_u32(std::string &out, std::uint32_t v);
+
+inline std::uint32_t
+read_u32(unsigned char const *p)
+{
+    return std::uint32_t(p[0]) << 24 | std::uint32_t(p[1]) << 16 |
+           std::uint32_t(p[2]) << 8 | std::uint32_t(p[3]);
+}
+
+}   // namespace blog
+
+namespace boost::system
+{
+template <>
+struct is_error_code_enum< blog::h2_error >
+{
+    static constexpr bool value = true;
+};
+}   // namespace boost::system
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_H2_FRAME_HPP
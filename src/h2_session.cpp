@@ -0,0 +1,1056 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "h2_session.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace blog
+{
+namespace
+{
+// how much the writer gathers into one write, control frames aside
+constexpr std::size_t write_batch = 256 * 1024;
+
+constexpr unsigned char alpn_protos[] = { 2,   'h', '2', 8,   'h', 't',
+                                          't', 'p', '/', '1', '.', '1' };
+
+[[noreturn]] void
+fail_connection(h2_error e)
+{
+    throw system_error(e);
+}
+
+// the payload of a DATA or HEADERS frame without its padding
+std::string_view
+unpad(h2_frame_header const &h, std::string_view payload)
+{
+    if (!h.has(h2_flag::padded))
+        return payload;
+    if (payload.empty())
+        fail_connection(h2_error::protocol_error);
+    auto pad = std::size_t(static_cast< unsigned char >(payload[0]));
+    if (pad >= payload.size())
+        fail_connection(h2_error::protocol_error);
+    return payload.substr(1, payload.size() - 1 - pad);
+}
+
+void
+append_setting(std::string &out, h2_setting id, std::uint32_t value)
+{
+    append_u16(out, static_cast< std::uint16_t >(id));
+    append_u32(out, value);
+}
+
+int
+select_alpn(SSL *,
+            unsigned char const **out,
+            unsigned char        *outlen,
+            unsigned char const  *in,
+            unsigned int          inlen,
+            void *)
+{
+    if (SSL_select_next_proto(const_cast< unsigned char ** >(out),
+                              outlen,
+                              alpn_protos,
+                              sizeof(alpn_protos),
+                              in,
+                              inlen) != OPENSSL_NPN_NEGOTIATED)
+        return SSL_TLSEXT_ERR_NOACK;
+    return SSL_TLSEXT_ERR_OK;
+}
+}   // namespace
+
+void
+offer_h2(ssl::stream< tcp::socket > &stream)
+{
+    if (SSL_set_alpn_protos(
+            stream.native_handle(), alpn_protos, sizeof(alpn_protos)) != 0)
+        throw system_error(
+            error_code { static_cast< int >(::ERR_get_error()),
+                         asio::error::get_ssl_category() });
+}
+
+void
+select_h2(ssl::context &ctx)
+{
+    SSL_CTX_set_alpn_select_cb(ctx.native_handle(), select_alpn, nullptr);
+}
+
+bool
+negotiated_h2(ssl::stream< tcp::socket > &stream)
+{
+    unsigned char const *proto = nullptr;
+    unsigned int         len   = 0;
+    SSL_get0_alpn_selected(stream.native_handle(), &proto, &len);
+    return std::string_view(reinterpret_cast< char const * >(proto), len) ==
+           h2_alpn;
+}
+
+// h2_stream
+
+h2_stream::h2_stream(h2_session &session, std::uint32_t id)
+: session_(session)
+, id_(id)
+, rx_window_(session.options_.stream_window)
+, tx_window_(session.peer_.initial_window_size)
+, rx_signal_(session.get_executor())
+, tx_signal_(session.get_executor())
+{
+}
+
+asio::awaitable< void >
+h2_stream::fill(std::size_t n)
+{
+    while (rx_.size() < n)
+    {
+        if (ec_)
+            throw system_error(ec_);
+        if (rx_fin_)
+            throw system_error(asio::error::eof);
+        co_await rx_signal_.wait();
+    }
+}
+
+void
+h2_stream::consume(std::size_t n)
+{
+    rx_.consume(n);
+    session_.consumed(*this, n);
+}
+
+void
+h2_stream::send(std::string_view bytes)
+{
+    if (ec_ || tx_fin_)
+        return;
+    tx_.append(bytes);
+    session_.schedule(*this);
+}
+
+asio::awaitable< void >
+h2_stream::drained()
+{
+    while (!ec_ && backlog() >= session_.options_.write_limit)
+        co_await tx_signal_.wait();
+    if (ec_)
+        throw system_error(ec_);
+}
+
+void
+h2_stream::end()
+{
+    if (ec_ || tx_fin_)
+        return;
+    tx_fin_ = true;
+    session_.schedule(*this);
+}
+
+void
+h2_stream::reset(h2_error e)
+{
+    if (ec_ || (rx_fin_ && tx_fin_sent_))
+        return;
+    session_.queue_rst(id_, e);
+    fail(e);
+    session_.retire(*this);
+}
+
+void
+h2_stream::fail(error_code ec)
+{
+    if (ec_)
+        return;
+    // no_error has the value 0, and a reset with it is still the end of the
+    // stream, so it is recorded as the cancel it amounts to
+    ec_ = ec == h2_error::no_error ? make_error_code(h2_error::cancel) : ec;
+    rx_signal_.wake();
+    tx_signal_.wake();
+}
+
+// h2_session
+
+h2_session::h2_session(ssl::stream< tcp::socket > stream,
+                       role                       r,
+                       h2_session_options         options)
+: stream_(std::move(stream))
+, role_(r)
+, options_(options)
+, decoder_(4096, options.max_header_block)
+, next_stream_id_(r == role::client ? 1 : 2)
+, writer_signal_(stream_.get_executor())
+, event_signal_(stream_.get_executor())
+{
+    options_.max_frame_size = std::clamp< std::uint32_t >(
+        options_.max_frame_size, h2_default_frame_max, 0xffffff);
+    options_.stream_window =
+        std::min< std::uint32_t >(options_.stream_window, h2_max_window);
+    options_.connection_window = std::clamp< std::uint32_t >(
+        options_.connection_window, h2_default_window, h2_max_window);
+}
+
+asio::awaitable< void >
+h2_session::start()
+{
+    using asio::detached;
+
+    auto settings = std::string();
+    append_setting(
+        settings, h2_setting::initial_window_size, options_.stream_window);
+    append_setting(
+        settings, h2_setting::max_frame_size, options_.max_frame_size);
+    if (role_ == role::client)
+    {
+        control_.append(h2_client_preface);
+        append_setting(settings, h2_setting::enable_push, 0);
+    }
+    else
+    {
+        append_setting(
+            settings, h2_setting::max_concurrent_streams, options_.max_streams);
+        append_setting(settings, h2_setting::enable_connect_protocol, 1);
+    }
+    queue_frame(h2_frame_type::settings, 0, 0, settings);
+
+    if (options_.connection_window > h2_default_window)
+    {
+        queue_window_update(0, options_.connection_window - h2_default_window);
+        recv_window_ = options_.connection_window;
+    }
+
+    auto self = shared_from_this();
+    asio::co_spawn(get_executor(), run_reader(self), detached);
+    asio::co_spawn(get_executor(), run_writer(self), detached);
+
+    while (!settings_received_ && !error_)
+        co_await event_signal_.wait();
+    if (!settings_received_)
+        throw system_error(error_);
+}
+
+asio::awaitable< std::shared_ptr< h2_stream > >
+h2_session::request(header_list const &headers, bool end_stream)
+{
+    if (!can_open())
+        throw system_error(h2_error::refused_stream);
+
+    auto s = std::make_shared< h2_stream >(*this, next_stream_id_);
+    next_stream_id_ += 2;
+    streams_.emplace(s->id_, s);
+    queue_headers(*s, headers, end_stream);
+
+    auto cancelled = false;
+    try
+    {
+        while (!s->headers_done_ && !s->ec_)
+            co_await s->rx_signal_.wait();
+    }
+    catch (system_error &)
+    {
+        cancelled = true;
+    }
+    if (cancelled)
+    {
+        s->reset(h2_error::cancel);
+        throw system_error(asio::error::operation_aborted);
+    }
+    if (!s->headers_done_)
+        throw system_error(s->ec_);
+    co_return s;
+}
+
+asio::awaitable< std::shared_ptr< h2_stream > >
+h2_session::accept()
+{
+    while (incoming_.empty() && !error_)
+        co_await event_signal_.wait();
+    if (incoming_.empty())
+        co_return nullptr;
+
+    auto s = std::move(incoming_.front());
+    incoming_.pop_front();
+    co_return s;
+}
+
+void
+h2_session::respond(h2_stream         &s,
+                    header_list const &headers,
+                    std::string_view   body,
+                    bool               end_stream)
+{
+    if (s.ec_)
+        return;
+    queue_headers(s, headers, end_stream && body.empty());
+    if (!body.empty())
+    {
+        s.send(body);
+        if (end_stream)
+            s.end();
+    }
+}
+
+bool
+h2_session::can_open() const
+{
+    return role_ == role::client && !error_ && !goaway_received_ &&
+           !close_when_idle_ && next_stream_id_ < 0x7fffffff &&
+           streams_.size() < peer_.max_concurrent_streams;
+}
+
+void
+h2_session::close_when_idle()
+{
+    close_when_idle_ = true;
+    if (streams_.empty())
+        close();
+}
+
+void
+h2_session::close(h2_error e)
+{
+    fail(e);
+}
+
+asio::awaitable< void >
+h2_session::run_reader(std::shared_ptr< h2_session > self)
+{
+    try
+    {
+        co_await self->read_frames();
+    }
+    catch (system_error &e)
+    {
+        self->fail(e.code());
+    }
+}
+
+asio::awaitable< void >
+h2_session::run_writer(std::shared_ptr< h2_session > self)
+{
+    try
+    {
+        co_await self->write_frames();
+    }
+    catch (system_error &e)
+    {
+        self->fail(e.code());
+    }
+
+    // closing the socket also ends the reader
+    auto ec = error_code();
+    self->socket().shutdown(asio::socket_base::shutdown_both, ec);
+    self->socket().close(ec);
+}
+
+asio::awaitable< void >
+h2_session::fill(std::size_t n)
+{
+    using asio::experimental::deferred;
+
+    while (in_.size() < n)
+    {
+        auto want = std::max< std::size_t >(n - in_.size(), 16 * 1024);
+        in_.commit(
+            co_await stream_.async_read_some(in_.prepare(want), deferred));
+    }
+}
+
+asio::awaitable< void >
+h2_session::read_frames()
+{
+    auto bytes = [this]
+    { return static_cast< char const * >(in_.cdata().data()); };
+
+    if (role_ == role::server)
+    {
+        co_await fill(h2_client_preface.size());
+        if (std::string_view(bytes(), h2_client_preface.size()) !=
+            h2_client_preface)
+            fail_connection(h2_error::protocol_error);
+        in_.consume(h2_client_preface.size());
+    }
+
+    while (!error_)
+    {
+        co_await fill(h2_frame_header::size);
+        auto h = h2_frame_header::parse(
+            reinterpret_cast< unsigned char const * >(bytes()));
+        if (h.length > options_.max_frame_size)
+            fail_connection(h2_error::frame_size_error);
+        if (!settings_received_ && h.type != h2_frame_type::settings)
+            fail_connection(h2_error::protocol_error);
+
+        auto size = h2_frame_header::size + h.length;
+        co_await fill(size);
+        on_frame(h,
+                 std::string_view(bytes() + h2_frame_header::size, h.length));
+        in_.consume(size);
+    }
+}
+
+asio::awaitable< void >
+h2_session::write_frames()
+{
+    using asio::experimental::deferred;
+
+    for (;;)
+    {
+        // control frames go first, so that settings, window updates and
+        // resets are never stuck behind data
+        out_.clear();
+        std::swap(out_, control_);
+        if (!error_)
+            schedule_data();
+
+        if (out_.empty())
+        {
+            if (error_)
+                break;
+            co_await writer_signal_.wait();
+            continue;
+        }
+        co_await asio::async_write(stream_, asio::buffer(out_), deferred);
+    }
+}
+
+void
+h2_session::on_frame(h2_frame_header const &h, std::string_view payload)
+{
+    // a header block must be finished before anything else is sent
+    if (header_stream_ && (h.type != h2_frame_type::continuation ||
+                           h.stream != header_stream_))
+        fail_connection(h2_error::protocol_error);
+
+    switch (h.type)
+    {
+    case h2_frame_type::data:
+        on_data(h, payload);
+        break;
+
+    case h2_frame_type::headers:
+        on_headers(h, payload);
+        break;
+
+    case h2_frame_type::continuation:
+        if (!header_stream_)
+            fail_connection(h2_error::protocol_error);
+        header_block_.append(payload);
+        if (header_block_.size() > options_.max_header_block)
+            fail_connection(h2_error::enhance_your_calm);
+        if (h.has(h2_flag::end_headers))
+            on_header_block(header_stream_, header_end_stream_);
+        break;
+
+    case h2_frame_type::priority:
+        if (h.stream == 0)
+            fail_connection(h2_error::protocol_error);
+        if (h.length != 5)
+            fail_connection(h2_error::frame_size_error);
+        break;
+
+    case h2_frame_type::rst_stream:
+        if (h.stream == 0)
+            fail_connection(h2_error::protocol_error);
+        if (h.length != 4)
+            fail_connection(h2_error::frame_size_error);
+        if (auto s = find(h.stream))
+        {
+            auto code = read_u32(
+                reinterpret_cast< unsigned char const * >(payload.data()));
+            s->fail(static_cast< h2_error >(code));
+            retire(*s);
+        }
+        break;
+
+    case h2_frame_type::settings:
+        on_settings(h, payload);
+        break;
+
+    case h2_frame_type::push_promise:
+        // disabled in our settings
+        fail_connection(h2_error::protocol_error);
+
+    case h2_frame_type::ping:
+        if (h.stream != 0)
+            fail_connection(h2_error::protocol_error);
+        if (h.length != 8)
+            fail_connection(h2_error::frame_size_error);
+        if (!h.has(h2_flag::ack))
+            queue_frame(h2_frame_type::ping, h2_flag::ack, 0, payload);
+        break;
+
+    case h2_frame_type::goaway:
+        if (h.stream != 0)
+            fail_connection(h2_error::protocol_error);
+        on_goaway(payload);
+        break;
+
+    case h2_frame_type::window_update:
+        on_window_update(h, payload);
+        break;
+
+    default:
+        // unknown frame types are ignored
+        break;
+    }
+}
+
+void
+h2_session::on_data(h2_frame_header const &h, std::string_view payload)
+{
+    if (h.stream == 0)
+        fail_connection(h2_error::protocol_error);
+
+    // the whole frame counts against the windows, padding included
+    recv_window_ -= h.length;
+    if (recv_window_ < 0)
+        fail_connection(h2_error::flow_control_error);
+
+    auto data = unpad(h, payload);
+    auto s    = find(h.stream);
+    if (!s || s->rx_fin_)
+    {
+        if (!s && idle(h.stream))
+            fail_connection(h2_error::protocol_error);
+        if (s)
+            s->reset(h2_error::stream_closed);
+        credit_connection(h.length);
+        return;
+    }
+
+    s->rx_window_ -= h.length;
+    if (s->rx_window_ < 0)
+    {
+        s->reset(h2_error::flow_control_error);
+        credit_connection(h.length);
+        return;
+    }
+
+    s->rx_.commit(asio::buffer_copy(s->rx_.prepare(data.size()),
+                                    asio::buffer(data.data(), data.size())));
+    if (auto padding = h.length - data.size())
+        consumed(*s, padding);
+    if (h.has(h2_flag::end_stream))
+    {
+        s->rx_fin_ = true;
+        finish_if_done(*s);
+    }
+    s->rx_signal_.wake();
+}
+
+void
+h2_session::on_headers(h2_frame_header const &h, std::string_view payload)
+{
+    if (h.stream == 0)
+        fail_connection(h2_error::protocol_error);
+
+    auto block = unpad(h, payload);
+    if (h.has(h2_flag::priority))
+    {
+        if (block.size() < 5)
+            fail_connection(h2_error::protocol_error);
+        block.remove_prefix(5);
+    }
+    if (block.size() > options_.max_header_block)
+        fail_connection(h2_error::enhance_your_calm);
+
+    header_block_.assign(block);
+    header_stream_     = h.stream;
+    header_end_stream_ = h.has(h2_flag::end_stream);
+    if (h.has(h2_flag::end_headers))
+        on_header_block(header_stream_, header_end_stream_);
+}
+
+void
+h2_session::on_header_block(std::uint32_t id, bool end_stream)
+{
+    // every block is decoded, wanted or not, to keep the table in step
+    auto headers = decoder_.decode(header_block_);
+    header_block_.clear();
+    header_stream_ = 0;
+
+    auto s = find(id);
+    if (!s && role_ == role::server && id > last_peer_stream_)
+    {
+        if ((id & 1) == 0)
+            fail_connection(h2_error::protocol_error);
+        last_peer_stream_ = id;
+        if (goaway_sent_ || close_when_idle_ ||
+            streams_.size() >= options_.max_streams)
+        {
+            queue_rst(id, h2_error::refused_stream);
+            return;
+        }
+
+        s = std::make_shared< h2_stream >(*this, id);
+        s->headers_      = std::move(headers);
+        s->headers_done_ = true;
+        s->rx_fin_       = end_stream;
+        streams_.emplace(id, s);
+        incoming_.push_back(std::move(s));
+        event_signal_.wake();
+        return;
+    }
+
+    if (!s)
+    {
+        // the late headers of a stream already finished with
+        if (idle(id))
+            fail_connection(h2_error::protocol_error);
+        return;
+    }
+
+    // an informational response is followed by the real one; anything after
+    // that is trailers, which carry nothing wanted here
+    auto status = find_header(headers, ":status");
+    if (!s->headers_done_ && !status.starts_with('1'))
+    {
+        s->headers_      = std::move(headers);
+        s->headers_done_ = true;
+    }
+    if (end_stream)
+    {
+        s->rx_fin_ = true;
+        finish_if_done(*s);
+    }
+    s->rx_signal_.wake();
+}
+
+void
+h2_session::on_settings(h2_frame_header const &h, std::string_view payload)
+{
+    if (h.stream != 0)
+        fail_connection(h2_error::protocol_error);
+    if (h.has(h2_flag::ack))
+    {
+        if (h.length)
+            fail_connection(h2_error::frame_size_error);
+        return;
+    }
+    if (h.length % 6)
+        fail_connection(h2_error::frame_size_error);
+
+    auto const *p = reinterpret_cast< unsigned char const * >(payload.data());
+    for (std::size_t i = 0; i < payload.size(); i += 6)
+    {
+        auto id    = static_cast< h2_setting >(p[i] << 8 | p[i + 1]);
+        auto value = read_u32(p + i + 2);
+        switch (id)
+        {
+        case h2_setting::header_table_size:
+            // the encoder never adds to the table, so any size will do
+            peer_.header_table_size = value;
+            break;
+        case h2_setting::enable_push:
+            if (value > 1)
+                fail_connection(h2_error::protocol_error);
+            peer_.enable_push = value == 1;
+            break;
+        case h2_setting::max_concurrent_streams:
+            peer_.max_concurrent_streams = value;
+            break;
+        case h2_setting::initial_window_size:
+        {
+            if (value > h2_max_window)
+                fail_connection(h2_error::flow_control_error);
+            auto delta =
+                std::int64_t(value) - std::int64_t(peer_.initial_window_size);
+            for (auto &[sid, s] : streams_)
+            {
+                s->tx_window_ += delta;
+                if (s->tx_window_ > h2_max_window)
+                    fail_connection(h2_error::flow_control_error);
+            }
+            peer_.initial_window_size = value;
+            break;
+        }
+        case h2_setting::max_frame_size:
+            if (value < h2_default_frame_max || value > 0xffffff)
+                fail_connection(h2_error::protocol_error);
+            peer_.max_frame_size = value;
+            break;
+        case h2_setting::max_header_list_size:
+            peer_.max_header_list_size = value;
+            break;
+        case h2_setting::enable_connect_protocol:
+            if (value > 1)
+                fail_connection(h2_error::protocol_error);
+            peer_.enable_connect_protocol = value == 1;
+            break;
+        default:
+            // unknown settings are ignored
+            break;
+        }
+    }
+    queue_frame(h2_frame_type::settings, h2_flag::ack, 0);
+
+    if (!settings_received_)
+    {
+        settings_received_ = true;
+        event_signal_.wake();
+    }
+
+    // stream windows may have grown
+    for (auto &[sid, s] : streams_)
+        schedule(*s);
+}
+
+void
+h2_session::on_window_update(h2_frame_header const &h,
+                             std::string_view       payload)
+{
+    if (h.length != 4)
+        fail_connection(h2_error::frame_size_error);
+    auto increment =
+        read_u32(reinterpret_cast< unsigned char const * >(payload.data())) &
+        0x7fffffff;
+
+    if (h.stream == 0)
+    {
+        if (increment == 0)
+            fail_connection(h2_error::protocol_error);
+        send_window_ += increment;
+        if (send_window_ > h2_max_window)
+            fail_connection(h2_error::flow_control_error);
+        wake_writer();
+        return;
+    }
+
+    auto s = find(h.stream);
+    if (!s)
+    {
+        if (idle(h.stream))
+            fail_connection(h2_error::protocol_error);
+        return;
+    }
+    if (increment == 0)
+    {
+        s->reset(h2_error::protocol_error);
+        return;
+    }
+    s->tx_window_ += increment;
+    if (s->tx_window_ > h2_max_window)
+    {
+        s->reset(h2_error::flow_control_error);
+        return;
+    }
+    schedule(*s);
+}
+
+void
+h2_session::on_goaway(std::string_view payload)
+{
+    if (payload.size() < 8)
+        fail_connection(h2_error::frame_size_error);
+    auto last =
+        read_u32(reinterpret_cast< unsigned char const * >(payload.data())) &
+        0x7fffffff;
+    goaway_received_ = true;
+
+    // streams we opened after last were never seen by the peer, so they can
+    // safely be tried again elsewhere
+    auto unseen = std::vector< std::shared_ptr< h2_stream > >();
+    for (auto &[id, s] : streams_)
+        if (id > last && !idle(id) && (id & 1) == (next_stream_id_ & 1))
+            unseen.push_back(s);
+    for (auto &s : unseen)
+    {
+        s->fail(h2_error::refused_stream);
+        retire(*s);
+    }
+
+    if (streams_.empty())
+        close();
+}
+
+bool
+h2_session::idle(std::uint32_t id) const
+{
+    // a stream of either side that has not been opened yet
+    return (id & 1) == (next_stream_id_ & 1) ? id >= next_stream_id_
+                                             : id > last_peer_stream_;
+}
+
+std::shared_ptr< h2_stream >
+h2_session::find(std::uint32_t id) const
+{
+    auto i = streams_.find(id);
+    return i == streams_.end() ? nullptr : i->second;
+}
+
+void
+h2_session::queue_frame(h2_frame_type    type,
+                        std::uint8_t     flags,
+                        std::uint32_t    stream,
+                        std::string_view payload)
+{
+    auto h = h2_frame_header { .length = std::uint32_t(payload.size()),
+                               .type   = type,
+                               .flags  = flags,
+                               .stream = stream };
+    h.append_to(control_);
+    control_.append(payload);
+    wake_writer();
+}
+
+void
+h2_session::queue_headers(h2_stream         &s,
+                          header_list const &headers,
+                          bool               end_stream)
+{
+    auto block = std::string();
+    hpack_encode(headers, block);
+
+    // a block too big for one frame continues in CONTINUATION frames
+    auto rest  = std::string_view(block);
+    auto first = rest.substr(0, peer_.max_frame_size);
+    rest.remove_prefix(first.size());
+    queue_frame(h2_frame_type::headers,
+                std::uint8_t((end_stream ? h2_flag::end_stream : 0) |
+                             (rest.empty() ? h2_flag::end_headers : 0)),
+                s.id_,
+                first);
+    while (!rest.empty())
+    {
+        auto part = rest.substr(0, peer_.max_frame_size);
+        rest.remove_prefix(part.size());
+        queue_frame(h2_frame_type::continuation,
+                    rest.empty() ? h2_flag::end_headers : 0,
+                    s.id_,
+                    part);
+    }
+
+    if (end_stream)
+    {
+        s.tx_fin_      = true;
+        s.tx_fin_sent_ = true;
+        finish_if_done(s);
+    }
+}
+
+void
+h2_session::queue_window_update(std::uint32_t stream, std::uint32_t increment)
+{
+    auto payload = std::string();
+    append_u32(payload, increment);
+    queue_frame(h2_frame_type::window_update, 0, stream, payload);
+}
+
+void
+h2_session::queue_rst(std::uint32_t stream, h2_error e)
+{
+    auto payload = std::string();
+    append_u32(payload, static_cast< std::uint32_t >(e));
+    queue_frame(h2_frame_type::rst_stream, 0, stream, payload);
+}
+
+void
+h2_session::schedule(h2_stream &s)
+{
+    if (s.tx_scheduled_ || s.ec_ || s.tx_fin_sent_)
+        return;
+    if (!s.backlog() && !s.tx_fin_)
+        return;
+    if (auto p = find(s.id_))
+    {
+        s.tx_scheduled_ = true;
+        ready_.push_back(std::move(p));
+        wake_writer();
+    }
+}
+
+void
+h2_session::schedule_data()
+{
+    while (!ready_.empty() && send_window_ > 0 && out_.size() < write_batch)
+    {
+        auto s = std::move(ready_.front());
+        ready_.pop_front();
+        s->tx_scheduled_ = false;
+        if (s->ec_ || s->tx_fin_sent_)
+            continue;
+
+        auto backlog = std::int64_t(s->backlog());
+        auto n       = std::min({ backlog,
+                            s->tx_window_,
+                            send_window_,
+                            std::int64_t(peer_.max_frame_size) });
+        auto fin     = s->tx_fin_ && n == backlog;
+
+        // a stream out of window waits for the peer to open it again
+        if (n <= 0 && !fin)
+            continue;
+
+        auto h = h2_frame_header { .length = std::uint32_t(n),
+                                   .type   = h2_frame_type::data,
+                                   .flags  = fin ? h2_flag::end_stream
+                                                 : std::uint8_t(0),
+                                   .stream = s->id_ };
+        h.append_to(out_);
+        out_.append(s->tx_, s->tx_sent_, std::size_t(n));
+        s->tx_sent_ += std::size_t(n);
+        s->tx_window_ -= n;
+        send_window_ -= n;
+
+        if (s->tx_sent_ == s->tx_.size())
+        {
+            s->tx_.clear();
+            s->tx_sent_ = 0;
+        }
+        else if (s->tx_sent_ >= s->tx_.size() / 2)
+        {
+            s->tx_.erase(0, s->tx_sent_);
+            s->tx_sent_ = 0;
+        }
+        if (s->backlog() < options_.write_limit)
+            s->tx_signal_.wake();
+
+        if (fin)
+        {
+            s->tx_fin_sent_ = true;
+            finish_if_done(*s);
+        }
+        else
+        {
+            // to the back of the queue, taking turns with the other streams
+            schedule(*s);
+        }
+    }
+}
+
+void
+h2_session::consumed(h2_stream &s, std::size_t n)
+{
+    s.rx_credit_ += n;
+    if (!s.rx_fin_ && !s.ec_ && s.rx_credit_ >= options_.stream_window / 2)
+    {
+        queue_window_update(s.id_, std::uint32_t(s.rx_credit_));
+        s.rx_window_ += std::int64_t(s.rx_credit_);
+        s.rx_credit_ = 0;
+    }
+    credit_connection(n);
+}
+
+void
+h2_session::credit_connection(std::size_t n)
+{
+    recv_credit_ += n;
+    if (!error_ && recv_credit_ >= options_.connection_window / 2)
+    {
+        queue_window_update(0, std::uint32_t(recv_credit_));
+        recv_window_ += std::int64_t(recv_credit_);
+        recv_credit_ = 0;
+    }
+}
+
+void
+h2_session::finish_if_done(h2_stream &s)
+{
+    if (s.rx_fin_ && s.tx_fin_sent_)
+        retire(s);
+}
+
+void
+h2_session::retire(h2_stream &s)
+{
+    streams_.erase(s.id_);
+    if ((close_when_idle_ || goaway_received_) && streams_.empty())
+        close();
+}
+
+void
+h2_session::fail(error_code ec)
+{
+    if (error_)
+        return;
+
+    // tell the peer why, if it is a protocol matter. The writer sends this
+    // before it closes the socket.
+    if (ec.category() == h2_category() && !goaway_sent_)
+    {
+        auto payload = std::string();
+        append_u32(payload, last_peer_stream_);
+        append_u32(payload, std::uint32_t(ec.value()));
+        queue_frame(h2_frame_type::goaway, 0, 0, payload);
+        goaway_sent_ = true;
+    }
+
+    // no_error has the value 0, so a clean close is recorded as cancelling
+    // whatever is still open, which is also what those streams are told
+    error_ = ec == h2_error::no_error ? make_error_code(h2_error::cancel) : ec;
+
+    auto streams = std::move(streams_);
+    streams_.clear();
+    ready_.clear();
+    for (auto &[id, s] : streams)
+        s->fail(error_);
+
+    event_signal_.wake();
+    wake_writer();
+}
+
+void
+h2_session::wake_writer()
+{
+    writer_signal_.wake();
+}
+
+// h2_pool
+
+h2_pool::h2_pool(h2_session_options options)
+: options_(options)
+{
+}
+
+h2_pool::~h2_pool()
+{
+    for (auto &[authority, session] : sessions_)
+        session->close_when_idle();
+}
+
+std::shared_ptr< h2_session >
+h2_pool::find(std::string const &authority, asio::any_io_executor const &ex)
+{
+    auto [first, last] = sessions_.equal_range(authority);
+    while (first != last)
+    {
+        if (first->second->closed())
+        {
+            first = sessions_.erase(first);
+            continue;
+        }
+        if (first->second->get_executor() == ex && first->second->can_open())
+            return first->second;
+        ++first;
+    }
+    return nullptr;
+}
+
+void
+h2_pool::add(std::string const &authority, std::shared_ptr< h2_session > s)
+{
+    sessions_.emplace(authority, std::move(s));
+    ++opened_;
+}
+
+bool
+h2_pool::http1_only(std::string const &authority) const
+{
+    return http1_only_.contains(authority);
+}
+
+void
+h2_pool::mark_http1_only(std::string const &authority)
+{
+    http1_only_.insert(authority);
+}
+
+}   // namespace blog
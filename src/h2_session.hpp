@@ -0,0 +1,459 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_H2_SESSION_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_H2_SESSION_HPP
+
+#include "config.hpp"
+#include "h2_frame.hpp"
+#include "hpack.hpp"
+#include "wake_signal.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace blog
+{
+
+struct h2_session;
+
+/// Offer h2 ahead of http/1.1 through ALPN on a client stream, before its
+/// handshake
+void
+offer_h2(ssl::stream< tcp::socket > &stream);
+
+/// Have a server context select h2 through ALPN when the client offers it
+void
+select_h2(ssl::context &ctx);
+
+/// Whether the handshake on stream settled on h2
+bool
+negotiated_h2(ssl::stream< tcp::socket > &stream);
+
+/// One stream of an h2_session: a request and its response, or, for an
+/// extended CONNECT (RFC 8441), a websocket.
+///
+/// Data received is held in a buffer of the stream's own, up to the window
+/// the session grants the peer for it, and the window is only reopened as
+/// the data is consumed. Each stream is therefore flow controlled on its
+/// own, and a websocket that is not being read stops its sender without
+/// holding up the others on the connection.
+///
+/// Data sent is copied to an outgoing buffer, from which the session
+/// writes as the peer's windows allow, taking turns between streams frame by
+/// frame.
+///
+/// Streams belong to their session's executor and, like the session, must
+/// only be used from it.
+struct h2_stream
+{
+    h2_stream(h2_session &session, std::uint32_t id);
+
+    h2_stream(h2_stream const &) = delete;
+
+    std::uint32_t
+    id() const
+    {
+        return id_;
+    }
+
+    /// The request headers on a server, the response headers on a client
+    header_list const &
+    headers() const
+    {
+        return headers_;
+    }
+
+    /// Data received and not yet consumed
+    beast::flat_buffer::const_buffers_type
+    received() const
+    {
+        return rx_.cdata();
+    }
+
+    /// Wait until at least n bytes have been received. Throws if the stream
+    /// fails, or if the peer ends it before n bytes arrive.
+    asio::awaitable< void >
+    fill(std::size_t n);
+
+    /// Discard n received bytes, reopening the peer's window by as much
+    void
+    consume(std::size_t n);
+
+    /// Queue bytes to be sent
+    void
+    send(std::string_view bytes);
+
+    /// Wait until the bytes queued are below the session's write limit. This
+    /// is what pushes back on a sender when the peer does not keep up.
+    asio::awaitable< void >
+    drained();
+
+    /// Whether the peer has ended its side of the stream
+    bool
+    remote_ended() const
+    {
+        return rx_fin_;
+    }
+
+    /// End this side of the stream once everything queued has been sent
+    void
+    end();
+
+    /// Abandon the stream, telling the peer why. Pending operations fail
+    /// with the error.
+    void
+    reset(h2_error e);
+
+    /// Why the stream failed, if it has
+    error_code const &
+    error() const
+    {
+        return ec_;
+    }
+
+  private:
+    friend h2_session;
+
+    void
+    fail(error_code ec);
+
+    std::size_t
+    backlog() const
+    {
+        return tx_.size() - tx_sent_;
+    }
+
+    h2_session   &session_;
+    std::uint32_t id_;
+    header_list   headers_;
+    bool          headers_done_ = false;
+
+    beast::flat_buffer rx_;
+    bool               rx_fin_    = false;
+    std::int64_t       rx_window_ = 0;   // what the peer may still send
+    std::size_t        rx_credit_ = 0;   // consumed but not yet reopened
+
+    std::string  tx_;
+    std::size_t  tx_sent_       = 0;
+    std::int64_t tx_window_     = 0;   // what we may still send
+    bool         tx_fin_        = false;
+    bool         tx_fin_sent_   = false;
+    bool         tx_scheduled_  = false;
+    bool         reset_         = false;
+    error_code   ec_;
+
+    wake_signal rx_signal_;
+    wake_signal tx_signal_;
+};
+
+struct h2_session_options
+{
+    /// The window each stream's peer is given, which is also the most that
+    /// one stream can have buffered but not consumed
+    std::uint32_t stream_window = 256 * 1024;
+
+    /// The window for all the streams of the connection together
+    std::uint32_t connection_window = 16 * 1024 * 1024;
+
+    /// Largest frame accepted
+    std::uint32_t max_frame_size = 64 * 1024;
+
+    /// Streams a server lets a client have open at once
+    std::uint32_t max_streams = 256;
+
+    /// Bytes a stream may have queued to send before drained() waits
+    std::size_t write_limit = 256 * 1024;
+
+    /// Largest header block accepted, before and after decompression
+    std::size_t max_header_block = 64 * 1024;
+};
+
+/// An HTTP/2 connection (RFC 9113) carrying many streams over one TLS
+/// session. It implements what is needed to carry websockets by extended
+/// CONNECT (RFC 8441) and to answer the odd plain request: settings, flow
+/// control per stream and for the connection, header blocks, resets, pings
+/// and GOAWAY. Priorities are ignored and nothing is pushed.
+///
+/// A reader and a writer coroutine run for the life of the connection, each
+/// holding a reference to the session, so the session lives until the
+/// connection ends. Call close() to end it.
+///
+/// Not thread safe: the session and its streams must only be used from the
+/// executor of the TLS stream.
+struct h2_session : std::enable_shared_from_this< h2_session >
+{
+    enum class role
+    {
+        client,
+        server
+    };
+
+    h2_session(ssl::stream< tcp::socket > stream,
+               role                       r,
+               h2_session_options         options = {});
+
+    h2_session(h2_session const &) = delete;
+
+    asio::any_io_executor
+    get_executor()
+    {
+        return stream_.get_executor();
+    }
+
+    tcp::socket &
+    socket()
+    {
+        return stream_.next_layer();
+    }
+
+    /// Exchange prefaces and settings with the peer, the handshake having
+    /// already been done, and start the reader and writer. Completes once
+    /// the peer's settings have arrived.
+    asio::awaitable< void >
+    start();
+
+    /// Client: open a stream with the given request headers and wait for the
+    /// response headers, which are then the stream's headers(). The stream
+    /// stays open for data in both directions unless end_stream is set.
+    asio::awaitable< std::shared_ptr< h2_stream > >
+    request(header_list const &headers, bool end_stream = false);
+
+    /// Server: wait for the next stream the client opens. Returns null once
+    /// the connection has ended.
+    asio::awaitable< std::shared_ptr< h2_stream > >
+    accept();
+
+    /// Server: send the response headers of s, followed by body if it is not
+    /// empty. The stream is ended after the body, or after the headers if
+    /// end_stream is set.
+    void
+    respond(h2_stream        &s,
+            header_list const &headers,
+            std::string_view  body       = {},
+            bool              end_stream = true);
+
+    /// Whether another stream can be opened on this connection
+    bool
+    can_open() const;
+
+    /// Whether the peer accepts extended CONNECT, and so websockets
+    bool
+    supports_websockets() const
+    {
+        return peer_.enable_connect_protocol;
+    }
+
+    /// Streams currently open
+    std::size_t
+    stream_count() const
+    {
+        return streams_.size();
+    }
+
+    /// Whether the connection has ended
+    bool
+    closed() const
+    {
+        return bool(error_);
+    }
+
+    /// Tell the peer that no more streams will be opened, and close the
+    /// connection once the open ones have finished
+    void
+    close_when_idle();
+
+    /// Tell the peer the connection is ending and end it, failing any
+    /// streams still open
+    void
+    close(h2_error e = h2_error::no_error);
+
+  private:
+    friend h2_stream;
+
+    static asio::awaitable< void >
+    run_reader(std::shared_ptr< h2_session > self);
+
+    static asio::awaitable< void >
+    run_writer(std::shared_ptr< h2_session > self);
+
+    asio::awaitable< void >
+    read_frames();
+
+    asio::awaitable< void >
+    write_frames();
+
+    asio::awaitable< void >
+    fill(std::size_t n);
+
+    void
+    on_frame(h2_frame_header const &h, std::string_view payload);
+
+    void
+    on_data(h2_frame_header const &h, std::string_view payload);
+
+    void
+    on_headers(h2_frame_header const &h, std::string_view payload);
+
+    void
+    on_header_block(std::uint32_t id, bool end_stream);
+
+    void
+    on_settings(h2_frame_header const &h, std::string_view payload);
+
+    void
+    on_window_update(h2_frame_header const &h, std::string_view payload);
+
+    void
+    on_goaway(std::string_view payload);
+
+    std::shared_ptr< h2_stream >
+    find(std::uint32_t id) const;
+
+    bool
+    idle(std::uint32_t id) const;
+
+    void
+    queue_frame(h2_frame_type    type,
+                std::uint8_t     flags,
+                std::uint32_t    stream,
+                std::string_view payload = {});
+
+    void
+    queue_headers(h2_stream &s, header_list const &headers, bool end_stream);
+
+    void
+    queue_window_update(std::uint32_t stream, std::uint32_t increment);
+
+    void
+    queue_rst(std::uint32_t stream, h2_error e);
+
+    void
+    schedule(h2_stream &s);
+
+    void
+    schedule_data();
+
+    void
+    consumed(h2_stream &s, std::size_t n);
+
+    void
+    credit_connection(std::size_t n);
+
+    void
+    finish_if_done(h2_stream &s);
+
+    void
+    retire(h2_stream &s);
+
+    void
+    fail(error_code ec);
+
+    void
+    wake_writer();
+
+    ssl::stream< tcp::socket > stream_;
+    role                       role_;
+    h2_session_options         options_;
+    h2_settings                peer_;
+    hpack_decoder              decoder_;
+
+    std::unordered_map< std::uint32_t, std::shared_ptr< h2_stream > >
+                  streams_;
+    std::uint32_t next_stream_id_;
+    std::uint32_t last_peer_stream_ = 0;
+    std::uint32_t goaway_after_     = 0x7fffffff;
+    bool          goaway_sent_      = false;
+    bool          goaway_received_  = false;
+    bool          close_when_idle_  = false;
+
+    // the header block being gathered from HEADERS and CONTINUATION frames
+    std::string   header_block_;
+    std::uint32_t header_stream_     = 0;
+    bool          header_end_stream_ = false;
+
+    std::int64_t send_window_ = h2_default_window;
+    std::int64_t recv_window_ = h2_default_window;
+    std::size_t  recv_credit_ = 0;
+
+    beast::flat_buffer                         in_;
+    std::string                                control_;
+    std::string                                out_;
+    std::deque< std::shared_ptr< h2_stream > > ready_;
+
+    std::deque< std::shared_ptr< h2_stream > > incoming_;
+    bool                                       settings_received_ = false;
+    error_code                                 error_;
+
+    wake_signal writer_signal_;
+    wake_signal event_signal_;   // settings, incoming, failure
+};
+
+/// HTTP/2 connections opened by connect_websock, kept so that further
+/// websockets to the same authority become streams of a connection that is
+/// already open rather than connections of their own. Authorities that turn
+/// out not to carry websockets over h2 are remembered, and reached over
+/// HTTP/1.1 from then on.
+///
+/// Not thread safe. A session is only reused on the executor it was
+/// opened on.
+struct h2_pool
+{
+    explicit h2_pool(h2_session_options options = {});
+
+    h2_pool(h2_pool const &) = delete;
+
+    /// Closes each connection once its last stream has finished
+    ~h2_pool();
+
+    h2_session_options const &
+    options() const
+    {
+        return options_;
+    }
+
+    /// An open connection to authority on ex with room for another stream,
+    /// or null
+    std::shared_ptr< h2_session >
+    find(std::string const &authority, asio::any_io_executor const &ex);
+
+    void
+    add(std::string const &authority, std::shared_ptr< h2_session > session);
+
+    /// Whether authority is known not to take websockets over h2
+    bool
+    http1_only(std::string const &authority) const;
+
+    void
+    mark_http1_only(std::string const &authority);
+
+    /// Connections opened through the pool so far
+    std::size_t
+    sessions_opened() const
+    {
+        return opened_;
+    }
+
+  private:
+    h2_session_options options_;
+    std::unordered_multimap< std::string, std::shared_ptr< h2_session > >
+                                      sessions_;
+    std::unordered_set< std::string > http1_only_;
+    std::size_t                       opened_ = 0;
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_H2_SESSION_HPP
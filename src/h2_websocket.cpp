@@ -0,0 +1,405 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "h2_websocket.hpp"
+
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+namespace blog
+{
+namespace
+{
+unsigned char const *
+bytes_of(h2_stream const &s)
+{
+    return static_cast< unsigned char const * >(s.received().data());
+}
+}   // namespace
+
+h2_websocket::h2_websocket(std::shared_ptr< h2_session > session)
+: session_(std::move(session))
+, client_(true)
+, close_signal_(session_->get_executor())
+{
+}
+
+h2_websocket::h2_websocket(std::shared_ptr< h2_session > session,
+                           std::shared_ptr< h2_stream >  stream)
+: session_(std::move(session))
+, stream_(std::move(stream))
+, client_(false)
+, close_signal_(session_->get_executor())
+{
+}
+
+h2_websocket::~h2_websocket()
+{
+    if (stream_ && !(close_sent_ && closed_))
+        stream_->reset(h2_error::cancel);
+}
+
+h2_websocket::read_guard::read_guard(h2_websocket &ws)
+: ws(ws)
+{
+    ws.reading_ = true;
+}
+
+h2_websocket::read_guard::~read_guard()
+{
+    ws.reading_ = false;
+    ws.close_signal_.wake();
+}
+
+std::string
+h2_websocket::frame_header(opcode op, bool fin, std::size_t size)
+{
+    // clients mask what they send, as RFC 8441 keeps RFC 6455's framing
+    auto const mask_bit = client_ ? 0x80 : 0x00;
+
+    auto h = std::string();
+    h.reserve(14 + size);
+    h.push_back(char((fin ? 0x80 : 0x00) | static_cast< int >(op)));
+    if (size < 126)
+        h.push_back(char(mask_bit | int(size)));
+    else if (size <= 0xffff)
+    {
+        h.push_back(char(mask_bit | 126));
+        append_u16(h, std::uint16_t(size));
+    }
+    else
+    {
+        h.push_back(char(mask_bit | 127));
+        append_u32(h, std::uint32_t(std::uint64_t(size) >> 32));
+        append_u32(h, std::uint32_t(size));
+    }
+
+    if (client_)
+    {
+        unsigned char key[4];
+        RAND_bytes(key, sizeof(key));
+        h.append(reinterpret_cast< char const * >(key), sizeof(key));
+    }
+    return h;
+}
+
+void
+h2_websocket::mask_payload(std::string &frame, std::size_t header_size)
+{
+    if (!client_)
+        return;
+
+    auto const *key = frame.data() + header_size - 4;
+    for (auto i = header_size; i < frame.size(); ++i)
+        frame[i] ^= key[(i - header_size) & 3];
+}
+
+std::string
+h2_websocket::close_frame(beast::websocket::close_reason const &reason)
+{
+    auto payload = std::string();
+    if (reason.code != beast::websocket::close_code::none)
+    {
+        append_u16(payload, reason.code);
+        payload.append(reason.reason.data(), reason.reason.size());
+    }
+    return frame(opcode::close, true, asio::buffer(payload));
+}
+
+asio::awaitable< void >
+h2_websocket::handshake(beast::websocket::response_type &response,
+                        std::string                      host,
+                        std::string                      target)
+{
+    if (!session_->supports_websockets())
+        throw system_error(h2_error::connect_error);
+
+    auto request = header_list();
+    request.push_back({ ":method", "CONNECT" });
+    request.push_back({ ":protocol", "websocket" });
+    request.push_back({ ":scheme", "https" });
+    request.push_back({ ":path", std::move(target) });
+    request.push_back({ ":authority", std::move(host) });
+    request.push_back({ "sec-websocket-version", "13" });
+    auto s = co_await session_->request(request);
+
+    auto status = find_header(s->headers(), ":status");
+    auto code   = 0u;
+    std::from_chars(status.data(), status.data() + status.size(), code);
+    response.version(20);
+    response.result(code);
+    for (auto &f : s->headers())
+        if (!f.name.starts_with(':'))
+            response.insert(f.name, f.value);
+
+    if (code != 200)
+    {
+        s->reset(h2_error::cancel);
+        throw system_error(beast::websocket::error::upgrade_declined);
+    }
+    stream_ = std::move(s);
+}
+
+asio::awaitable< std::uint64_t >
+h2_websocket::next_payload()
+{
+    if (closed_)
+        throw system_error(beast::websocket::error::closed);
+    if (!stream_)
+        throw system_error(asio::error::not_connected);
+
+    while (frame_left_ == 0)
+    {
+        co_await next_frame();
+        if (frame_left_ == 0 && frame_fin_)
+        {
+            message_done_ = true;
+            co_return 0;
+        }
+    }
+    co_return frame_left_;
+}
+
+asio::awaitable< void >
+h2_websocket::next_frame()
+{
+    using beast::websocket::error;
+
+    for (;;)
+    {
+        co_await stream_->fill(2);
+        auto const *p      = bytes_of(*stream_);
+        auto        fin    = (p[0] & 0x80) != 0;
+        auto        op     = static_cast< opcode >(p[0] & 0x0f);
+        auto        masked = (p[1] & 0x80) != 0;
+        auto        len    = std::uint64_t(p[1] & 0x7f);
+        if (p[0] & 0x70)
+            fail(error::bad_reserved_bits);
+        if (masked == client_)
+            fail(client_ ? error::bad_masked_frame : error::bad_unmasked_frame);
+
+        auto size = std::size_t(2) + (len == 126 ? 2 : len == 127 ? 8 : 0) +
+                    (masked ? 4 : 0);
+        co_await stream_->fill(size);
+        p = bytes_of(*stream_);
+        if (len == 126)
+            len = std::uint64_t(p[2]) << 8 | p[3];
+        else if (len == 127)
+            len = std::uint64_t(read_u32(p + 2)) << 32 | read_u32(p + 6);
+        rx_masked_   = masked;
+        rx_mask_pos_ = 0;
+        if (masked)
+            std::memcpy(rx_mask_, p + size - 4, 4);
+        stream_->consume(size);
+
+        if (static_cast< int >(op) & 0x8)
+        {
+            if (!fin)
+                fail(error::bad_control_fragment);
+            if (len > 125)
+                fail(error::bad_control_size);
+            co_await stream_->fill(len);
+            auto payload = std::string(
+                reinterpret_cast< char const * >(bytes_of(*stream_)), len);
+            stream_->consume(len);
+            unmask(payload.data(), payload.size());
+            on_control(op, payload);
+            continue;
+        }
+
+        switch (op)
+        {
+        case opcode::cont:
+            if (message_done_)
+                fail(error::bad_continuation);
+            break;
+        case opcode::text:
+        case opcode::binary:
+            if (!message_done_)
+                fail(error::bad_data_frame);
+            got_text_     = op == opcode::text;
+            message_done_ = false;
+            break;
+        default:
+            fail(error::bad_opcode);
+        }
+        frame_left_ = len;
+        frame_fin_  = fin;
+        co_return;
+    }
+}
+
+asio::awaitable< std::size_t >
+h2_websocket::read_payload(asio::mutable_buffer dst)
+{
+    co_await stream_->fill(1);
+    auto n = std::size_t(std::min< std::uint64_t >(
+        { dst.size(), frame_left_, stream_->received().size() }));
+    std::memcpy(dst.data(), bytes_of(*stream_), n);
+    unmask(static_cast< char * >(dst.data()), n);
+    stream_->consume(n);
+
+    frame_left_ -= n;
+    if (frame_left_ == 0 && frame_fin_)
+        message_done_ = true;
+    co_return n;
+}
+
+void
+h2_websocket::unmask(char *p, std::size_t n)
+{
+    if (!rx_masked_)
+        return;
+    for (std::size_t i = 0; i < n; ++i)
+        p[i] ^= char(rx_mask_[rx_mask_pos_++ & 3]);
+}
+
+void
+h2_websocket::on_control(opcode op, std::string &payload)
+{
+    using beast::websocket::frame_type;
+
+    switch (op)
+    {
+    case opcode::ping:
+        if (!close_sent_)
+            stream_->send(frame(opcode::pong, true, asio::buffer(payload)));
+        if (control_)
+            control_(frame_type::ping, payload);
+        break;
+
+    case opcode::pong:
+        if (control_)
+            control_(frame_type::pong, payload);
+        break;
+
+    case opcode::close:
+    {
+        if (payload.size() == 1)
+            fail(beast::websocket::error::bad_close_size);
+        reason_ = {};
+        if (payload.size() >= 2)
+        {
+            auto const *p = reinterpret_cast< unsigned char const * >(
+                payload.data());
+            reason_.code   = std::uint16_t(p[0] << 8 | p[1]);
+            reason_.reason = payload.substr(2);
+        }
+        if (control_)
+            control_(frame_type::close,
+                     beast::string_view(reason_.reason.data(),
+                                        reason_.reason.size()));
+
+        // answer the close and end our side of the stream
+        closed_ = true;
+        if (!close_sent_)
+        {
+            close_sent_ = true;
+            stream_->send(close_frame(reason_));
+        }
+        stream_->end();
+        close_signal_.wake();
+        throw system_error(beast::websocket::error::closed);
+    }
+
+    default:
+        fail(beast::websocket::error::bad_opcode);
+    }
+}
+
+asio::awaitable< std::size_t >
+h2_websocket::send(std::string frame, std::size_t size)
+{
+    if (!stream_)
+        throw system_error(asio::error::not_connected);
+    if (close_sent_)
+        throw system_error(beast::websocket::error::closed);
+
+    stream_->send(frame);
+    co_await stream_->drained();
+    co_return size;
+}
+
+asio::awaitable< void >
+h2_websocket::send_control(std::string frame)
+{
+    if (!stream_)
+        throw system_error(asio::error::not_connected);
+    if (stream_->error())
+        throw system_error(stream_->error());
+    if (!close_sent_)
+        stream_->send(frame);
+    co_return;
+}
+
+asio::awaitable< void >
+h2_websocket::close(std::string frame)
+{
+    if (!stream_)
+        throw system_error(asio::error::not_connected);
+    if (!close_sent_)
+    {
+        close_sent_ = true;
+        stream_->send(frame);
+    }
+
+    // wait for the peer's close, which an outstanding read will see first if
+    // there is one, and otherwise must be read here
+    while (!closed_)
+    {
+        if (stream_->error())
+            throw system_error(stream_->error());
+        if (reading_)
+        {
+            co_await close_signal_.wait();
+            continue;
+        }
+
+        try
+        {
+            auto guard = read_guard(*this);
+            co_await next_payload();
+            while (frame_left_)
+            {
+                co_await stream_->fill(1);
+                auto n = std::size_t(std::min< std::uint64_t >(
+                    frame_left_, stream_->received().size()));
+                stream_->consume(n);
+                frame_left_ -= n;
+            }
+            if (frame_fin_)
+                message_done_ = true;
+        }
+        catch (system_error &e)
+        {
+            if (e.code() != beast::websocket::error::closed)
+                throw;
+        }
+    }
+    stream_->end();
+}
+
+void
+h2_websocket::fail(beast::websocket::error e)
+{
+    // as beast does, close with a protocol error before giving up
+    if (stream_ && !close_sent_)
+    {
+        close_sent_ = true;
+        stream_->send(
+            close_frame(beast::websocket::close_code::protocol_error));
+        stream_->end();
+    }
+    throw system_error(e);
+}
+
+}   // namespace blog
@@ -0,0 +1,401 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_H2_WEBSOCKET_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_H2_WEBSOCKET_HPP
+
+#include "config.hpp"
+#include "h2_session.hpp"
+#include "wake_signal.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+
+namespace blog
+{
+
+/// A websocket carried on one stream of an HTTP/2 connection, opened by
+/// extended CONNECT (RFC 8441) rather than by an upgrade, and framed as RFC
+/// 6455 describes within the stream's data.
+///
+/// It has the part of beast::websocket::stream's interface that this program
+/// uses, so that websock_connection, the relay and the server's sessions
+/// work on it unchanged. Operations complete on the session's executor, take
+/// any completion token, and may be cancelled through the token's
+/// cancellation slot.
+///
+/// Like a beast stream it allows one read and one write to be outstanding
+/// at a time, plus pings and a close. Each frame written is queued whole on
+/// the stream, so frames from concurrent writers never interleave.
+struct h2_websocket
+{
+    using executor_type = asio::any_io_executor;
+    using control_fn    = std::function< void(beast::websocket::frame_type,
+                                           beast::string_view) >;
+
+    /// A client websocket, to be opened by async_handshake on a new stream
+    /// of session
+    explicit h2_websocket(std::shared_ptr< h2_session > session);
+
+    /// A server websocket on a stream whose CONNECT has been answered with a
+    /// 200
+    h2_websocket(std::shared_ptr< h2_session > session,
+                 std::shared_ptr< h2_stream >  stream);
+
+    h2_websocket(h2_websocket &&) = default;
+
+    /// Resets the stream unless the websocket was closed cleanly
+    ~h2_websocket();
+
+    executor_type
+    get_executor() const
+    {
+        return session_->get_executor();
+    }
+
+    h2_session &
+    session() const
+    {
+        return *session_;
+    }
+
+    void
+    text(bool value)
+    {
+        text_ = value;
+    }
+
+    bool
+    text() const
+    {
+        return text_;
+    }
+
+    bool
+    got_text() const
+    {
+        return got_text_;
+    }
+
+    bool
+    is_message_done() const
+    {
+        return message_done_;
+    }
+
+    beast::websocket::close_reason const &
+    reason() const
+    {
+        return reason_;
+    }
+
+    void
+    read_message_max(std::size_t n)
+    {
+        read_message_max_ = n ? n : std::numeric_limits< std::size_t >::max();
+    }
+
+    void
+    control_callback(control_fn f)
+    {
+        control_ = std::move(f);
+    }
+
+    void
+    control_callback()
+    {
+        control_ = nullptr;
+    }
+
+    /// Open the stream with an extended CONNECT to target, filling in
+    /// response with the server's reply. Anything but a 200 fails with
+    /// upgrade_declined, like a refused upgrade.
+    template < class CompletionToken >
+    auto
+    async_handshake(beast::websocket::response_type &response,
+                    beast::string_view               host,
+                    beast::string_view               target,
+                    CompletionToken                &&token)
+    {
+        return run_op< void(error_code) >(
+            [this,
+             &response,
+             host   = std::string(host),
+             target = std::string(target)]() mutable
+            { return handshake(response, std::move(host), std::move(target)); },
+            token);
+    }
+
+    /// Read a whole message, appending it to buffer
+    template < class DynamicBuffer, class CompletionToken >
+    auto
+    async_read(DynamicBuffer &buffer, CompletionToken &&token)
+    {
+        return run_op< void(error_code, std::size_t) >(
+            [this, &buffer]
+            { return read_message(buffer, read_message_max_, true); },
+            token);
+    }
+
+    /// Read up to limit bytes of the current message, or of the next if the
+    /// last is done
+    template < class DynamicBuffer, class CompletionToken >
+    auto
+    async_read_some(DynamicBuffer  &buffer,
+                    std::size_t     limit,
+                    CompletionToken &&token)
+    {
+        return run_op< void(error_code, std::size_t) >(
+            [this, &buffer, limit]
+            { return read_message(buffer, limit, false); },
+            token);
+    }
+
+    template < class ConstBufferSequence, class CompletionToken >
+    auto
+    async_write(ConstBufferSequence const &buffers, CompletionToken &&token)
+    {
+        return async_write_some(true, buffers, token);
+    }
+
+    /// Write buffers as one frame of a message, which is finished if fin is
+    /// set
+    template < class ConstBufferSequence, class CompletionToken >
+    auto
+    async_write_some(bool                       fin,
+                     ConstBufferSequence const &buffers,
+                     CompletionToken          &&token)
+    {
+        auto size = beast::buffer_bytes(buffers);
+        return run_op< void(error_code, std::size_t) >(
+            [this, fin, buffers, size]
+            {
+                auto op = continuing_ ? opcode::cont
+                          : text_     ? opcode::text
+                                      : opcode::binary;
+                continuing_ = !fin;
+                return send(frame(op, fin, buffers), size);
+            },
+            token);
+    }
+
+    template < class CompletionToken >
+    auto
+    async_ping(beast::websocket::ping_data const &payload,
+               CompletionToken                  &&token)
+    {
+        return run_op< void(error_code) >(
+            [this, payload]
+            {
+                auto data = asio::buffer(payload.data(), payload.size());
+                return send_control(frame(opcode::ping, true, data));
+            },
+            token);
+    }
+
+    /// Send a close frame and wait for the peer's, then end the stream
+    template < class CompletionToken >
+    auto
+    async_close(beast::websocket::close_reason const &reason,
+                CompletionToken                     &&token)
+    {
+        return run_op< void(error_code) >(
+            [this, reason] { return close(close_frame(reason)); }, token);
+    }
+
+    /// What beast::close_socket does to a websocket on a shared connection:
+    /// reset its stream, failing anything outstanding on it
+    friend void
+    beast_close_socket(h2_websocket &ws)
+    {
+        if (ws.stream_)
+            ws.stream_->reset(h2_error::cancel);
+    }
+
+  private:
+    enum class opcode : std::uint8_t
+    {
+        cont   = 0x0,
+        text   = 0x1,
+        binary = 0x2,
+        close  = 0x8,
+        ping   = 0x9,
+        pong   = 0xa
+    };
+
+    // Run op, a function returning an awaitable, as an asynchronous operation
+    // with the given signature. An exception from the awaitable becomes the
+    // error_code.
+    template < class Signature, class Op, class CompletionToken >
+    auto
+    run_op(Op op, CompletionToken &&token)
+    {
+        return asio::async_initiate< CompletionToken, Signature >(
+            [ex = get_executor()](auto handler, Op op)
+            {
+                auto slot = asio::get_associated_cancellation_slot(handler);
+                auto hex  = asio::get_associated_executor(handler, ex);
+                auto done = [h = std::move(handler)](std::exception_ptr ep,
+                                                     auto... result) mutable
+                {
+                    auto ec = error_code();
+                    try
+                    {
+                        if (ep)
+                            std::rethrow_exception(ep);
+                    }
+                    catch (system_error &e)
+                    {
+                        ec = e.code();
+                    }
+                    std::move(h)(ec, result...);
+                };
+                asio::co_spawn(
+                    ex,
+                    op(),
+                    asio::bind_cancellation_slot(
+                        slot, asio::bind_executor(hex, std::move(done))));
+            },
+            token,
+            std::move(op));
+    }
+
+    // The header and mask of a frame of size bytes
+    std::string
+    frame_header(opcode op, bool fin, std::size_t size);
+
+    // Mask the payload that follows the header in frame
+    void
+    mask_payload(std::string &frame, std::size_t header_size);
+
+    template < class ConstBufferSequence >
+    std::string
+    frame(opcode op, bool fin, ConstBufferSequence const &buffers)
+    {
+        auto size   = beast::buffer_bytes(buffers);
+        auto result = frame_header(op, fin, size);
+        auto start  = result.size();
+        result.resize(start + size);
+        asio::buffer_copy(asio::buffer(result.data() + start, size), buffers);
+        mask_payload(result, start);
+        return result;
+    }
+
+    std::string
+    close_frame(beast::websocket::close_reason const &reason);
+
+    asio::awaitable< void >
+    handshake(beast::websocket::response_type &response,
+              std::string                      host,
+              std::string                      target);
+
+    template < class DynamicBuffer >
+    asio::awaitable< std::size_t >
+    read_message(DynamicBuffer &buffer, std::size_t limit, bool whole)
+    {
+        auto guard = read_guard(*this);
+        auto total = std::size_t(0);
+        do
+        {
+            auto left = co_await next_payload();
+            if (!left)
+                break;
+            if (total == limit)
+            {
+                if (whole)
+                    fail(beast::websocket::error::message_too_big);
+                break;
+            }
+            auto room = std::min< std::uint64_t >(left, limit - total);
+            auto mb   = buffer.prepare(std::size_t(room));
+            auto n    = co_await read_payload(*asio::buffer_sequence_begin(mb));
+            buffer.commit(n);
+            total += n;
+        } while (whole && !message_done_);
+        co_return total;
+    }
+
+    // Read frame headers until there is payload to read, handling control
+    // frames on the way. Returns the payload left in the frame, or 0 if the
+    // message has ended.
+    asio::awaitable< std::uint64_t >
+    next_payload();
+
+    asio::awaitable< void >
+    next_frame();
+
+    // Copy payload that has arrived into dst, without waiting for more than
+    // the first byte
+    asio::awaitable< std::size_t >
+    read_payload(asio::mutable_buffer dst);
+
+    void
+    unmask(char *p, std::size_t n);
+
+    // handle a ping, pong or close. A close throws error::closed.
+    void
+    on_control(opcode op, std::string &payload);
+
+    asio::awaitable< std::size_t >
+    send(std::string frame, std::size_t size);
+
+    asio::awaitable< void >
+    send_control(std::string frame);
+
+    asio::awaitable< void >
+    close(std::string frame);
+
+    [[noreturn]] void
+    fail(beast::websocket::error e);
+
+    // marks a read as outstanding, for the benefit of a concurrent close
+    struct read_guard
+    {
+        explicit read_guard(h2_websocket &ws);
+
+        read_guard(read_guard const &) = delete;
+
+        ~read_guard();
+
+        h2_websocket &ws;
+    };
+
+    std::shared_ptr< h2_session >  session_;
+    std::shared_ptr< h2_stream >   stream_;
+    bool                           client_;
+    control_fn                     control_;
+    beast::websocket::close_reason reason_;
+    std::size_t read_message_max_ = 16 * 1024 * 1024;
+
+    // the frame being read
+    std::uint64_t frame_left_   = 0;
+    bool          frame_fin_    = false;
+    bool          message_done_ = true;
+    bool          got_text_     = false;
+    unsigned char rx_mask_[4]   = {};
+    bool          rx_masked_    = false;
+    std::size_t   rx_mask_pos_  = 0;
+
+    bool text_       = true;
+    bool continuing_ = false;
+    bool reading_    = false;
+    bool close_sent_ = false;
+    bool closed_     = false;
+
+    wake_signal close_signal_;
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_H2_WEBSOCKET_HPP
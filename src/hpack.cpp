@@ -0,0 +1,493 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "hpack.hpp"
+
+#include "h2_frame.hpp"
+
+#include <array>
+#include <cstdint>
+#include <utility>
+
+namespace blog
+{
+namespace
+{
+struct static_entry
+{
+    std::string_view name;
+    std::string_view value;
+};
+
+// RFC 7541 Appendix A, indexed from 1
+constexpr static_entry static_table[] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+constexpr std::size_t static_size = std::size(static_table);
+
+// RFC 7541 Appendix B: the code and bit length of each octet, then of EOS
+struct huffman_code
+{
+    std::uint32_t bits;
+    int           length;
+};
+
+constexpr huffman_code huffman_codes[257] = {
+    { 0x1ff8, 13 }, { 0x7fffd8, 23 }, { 0xfffffe2, 28 }, { 0xfffffe3, 28 },
+    { 0xfffffe4, 28 }, { 0xfffffe5, 28 }, { 0xfffffe6, 28 }, { 0xfffffe7, 28 },
+    { 0xfffffe8, 28 }, { 0xffffea, 24 }, { 0x3ffffffc, 30 }, { 0xfffffe9, 28 },
+    { 0xfffffea, 28 }, { 0x3ffffffd, 30 }, { 0xfffffeb, 28 }, { 0xfffffec, 28 },
+    { 0xfffffed, 28 }, { 0xfffffee, 28 }, { 0xfffffef, 28 }, { 0xffffff0, 28 },
+    { 0xffffff1, 28 }, { 0xffffff2, 28 }, { 0x3ffffffe, 30 }, { 0xffffff3, 28 },
+    { 0xffffff4, 28 }, { 0xffffff5, 28 }, { 0xffffff6, 28 }, { 0xffffff7, 28 },
+    { 0xffffff8, 28 }, { 0xffffff9, 28 }, { 0xffffffa, 28 }, { 0xffffffb, 28 },
+    { 0x14, 6 }, { 0x3f8, 10 }, { 0x3f9, 10 }, { 0xffa, 12 }, { 0x1ff9, 13 },
+    { 0x15, 6 }, { 0xf8, 8 }, { 0x7fa, 11 }, { 0x3fa, 10 }, { 0x3fb, 10 },
+    { 0xf9, 8 }, { 0x7fb, 11 }, { 0xfa, 8 }, { 0x16, 6 }, { 0x17, 6 },
+    { 0x18, 6 }, { 0x0, 5 }, { 0x1, 5 }, { 0x2, 5 }, { 0x19, 6 }, { 0x1a, 6 },
+    { 0x1b, 6 }, { 0x1c, 6 }, { 0x1d, 6 }, { 0x1e, 6 }, { 0x1f, 6 },
+    { 0x5c, 7 }, { 0xfb, 8 }, { 0x7ffc, 15 }, { 0x20, 6 }, { 0xffb, 12 },
+    { 0x3fc, 10 }, { 0x1ffa, 13 }, { 0x21, 6 }, { 0x5d, 7 }, { 0x5e, 7 },
+    { 0x5f, 7 }, { 0x60, 7 }, { 0x61, 7 }, { 0x62, 7 }, { 0x63, 7 },
+    { 0x64, 7 }, { 0x65, 7 }, { 0x66, 7 }, { 0x67, 7 }, { 0x68, 7 },
+    { 0x69, 7 }, { 0x6a, 7 }, { 0x6b, 7 }, { 0x6c, 7 }, { 0x6d, 7 },
+    { 0x6e, 7 }, { 0x6f, 7 }, { 0x70, 7 }, { 0x71, 7 }, { 0x72, 7 },
+    { 0xfc, 8 }, { 0x73, 7 }, { 0xfd, 8 }, { 0x1ffb, 13 }, { 0x7fff0, 19 },
+    { 0x1ffc, 13 }, { 0x3ffc, 14 }, { 0x22, 6 }, { 0x7ffd, 15 }, { 0x3, 5 },
+    { 0x23, 6 }, { 0x4, 5 }, { 0x24, 6 }, { 0x5, 5 }, { 0x25, 6 }, { 0x26, 6 },
+    { 0x27, 6 }, { 0x6, 5 }, { 0x74, 7 }, { 0x75, 7 }, { 0x28, 6 }, { 0x29, 6 },
+    { 0x2a, 6 }, { 0x7, 5 }, { 0x2b, 6 }, { 0x76, 7 }, { 0x2c, 6 }, { 0x8, 5 },
+    { 0x9, 5 }, { 0x2d, 6 }, { 0x77, 7 }, { 0x78, 7 }, { 0x79, 7 }, { 0x7a, 7 },
+    { 0x7b, 7 }, { 0x7ffe, 15 }, { 0x7fc, 11 }, { 0x3ffd, 14 }, { 0x1ffd, 13 },
+    { 0xffffffc, 28 }, { 0xfffe6, 20 }, { 0x3fffd2, 22 }, { 0xfffe7, 20 },
+    { 0xfffe8, 20 }, { 0x3fffd3, 22 }, { 0x3fffd4, 22 }, { 0x3fffd5, 22 },
+    { 0x7fffd9, 23 }, { 0x3fffd6, 22 }, { 0x7fffda, 23 }, { 0x7fffdb, 23 },
+    { 0x7fffdc, 23 }, { 0x7fffdd, 23 }, { 0x7fffde, 23 }, { 0xffffeb, 24 },
+    { 0x7fffdf, 23 }, { 0xffffec, 24 }, { 0xffffed, 24 }, { 0x3fffd7, 22 },
+    { 0x7fffe0, 23 }, { 0xffffee, 24 }, { 0x7fffe1, 23 }, { 0x7fffe2, 23 },
+    { 0x7fffe3, 23 }, { 0x7fffe4, 23 }, { 0x1fffdc, 21 }, { 0x3fffd8, 22 },
+    { 0x7fffe5, 23 }, { 0x3fffd9, 22 }, { 0x7fffe6, 23 }, { 0x7fffe7, 23 },
+    { 0xffffef, 24 }, { 0x3fffda, 22 }, { 0x1fffdd, 21 }, { 0xfffe9, 20 },
+    { 0x3fffdb, 22 }, { 0x3fffdc, 22 }, { 0x7fffe8, 23 }, { 0x7fffe9, 23 },
+    { 0x1fffde, 21 }, { 0x7fffea, 23 }, { 0x3fffdd, 22 }, { 0x3fffde, 22 },
+    { 0xfffff0, 24 }, { 0x1fffdf, 21 }, { 0x3fffdf, 22 }, { 0x7fffeb, 23 },
+    { 0x7fffec, 23 }, { 0x1fffe0, 21 }, { 0x1fffe1, 21 }, { 0x3fffe0, 22 },
+    { 0x1fffe2, 21 }, { 0x7fffed, 23 }, { 0x3fffe1, 22 }, { 0x7fffee, 23 },
+    { 0x7fffef, 23 }, { 0xfffea, 20 }, { 0x3fffe2, 22 }, { 0x3fffe3, 22 },
+    { 0x3fffe4, 22 }, { 0x7ffff0, 23 }, { 0x3fffe5, 22 }, { 0x3fffe6, 22 },
+    { 0x7ffff1, 23 }, { 0x3ffffe0, 26 }, { 0x3ffffe1, 26 }, { 0xfffeb, 20 },
+    { 0x7fff1, 19 }, { 0x3fffe7, 22 }, { 0x7ffff2, 23 }, { 0x3fffe8, 22 },
+    { 0x1ffffec, 25 }, { 0x3ffffe2, 26 }, { 0x3ffffe3, 26 }, { 0x3ffffe4, 26 },
+    { 0x7ffffde, 27 }, { 0x7ffffdf, 27 }, { 0x3ffffe5, 26 }, { 0xfffff1, 24 },
+    { 0x1ffffed, 25 }, { 0x7fff2, 19 }, { 0x1fffe3, 21 }, { 0x3ffffe6, 26 },
+    { 0x7ffffe0, 27 }, { 0x7ffffe1, 27 }, { 0x3ffffe7, 26 }, { 0x7ffffe2, 27 },
+    { 0xfffff2, 24 }, { 0x1fffe4, 21 }, { 0x1fffe5, 21 }, { 0x3ffffe8, 26 },
+    { 0x3ffffe9, 26 }, { 0xffffffd, 28 }, { 0x7ffffe3, 27 }, { 0x7ffffe4, 27 },
+    { 0x7ffffe5, 27 }, { 0xfffec, 20 }, { 0xfffff3, 24 }, { 0xfffed, 20 },
+    { 0x1fffe6, 21 }, { 0x3fffe9, 22 }, { 0x1fffe7, 21 }, { 0x1fffe8, 21 },
+    { 0x7ffff3, 23 }, { 0x3fffea, 22 }, { 0x3fffeb, 22 }, { 0x1ffffee, 25 },
+    { 0x1ffffef, 25 }, { 0xfffff4, 24 }, { 0xfffff5, 24 }, { 0x3ffffea, 26 },
+    { 0x7ffff4, 23 }, { 0x3ffffeb, 26 }, { 0x7ffffe6, 27 }, { 0x3ffffec, 26 },
+    { 0x3ffffed, 26 }, { 0x7ffffe7, 27 }, { 0x7ffffe8, 27 }, { 0x7ffffe9, 27 },
+    { 0x7ffffea, 27 }, { 0x7ffffeb, 27 }, { 0xffffffe, 28 }, { 0x7ffffec, 27 },
+    { 0x7ffffed, 27 }, { 0x7ffffee, 27 }, { 0x7ffffef, 27 }, { 0x7fffff0, 27 },
+    { 0x3ffffee, 26 }, { 0x3fffffff, 30 }
+};
+
+constexpr int eos = 256;
+
+// The codes as a binary tree, walked a bit at a time when decoding
+struct huffman_tree
+{
+    struct node
+    {
+        std::int16_t child[2] = { -1, -1 };
+        std::int16_t symbol   = -1;
+    };
+
+    huffman_tree()
+    {
+        nodes.emplace_back();
+        for (int sym = 0; sym < 257; ++sym)
+        {
+            auto [bits, length] = huffman_codes[sym];
+            auto at             = std::size_t(0);
+            for (int i = length - 1; i >= 0; --i)
+            {
+                auto b = (bits >> i) & 1;
+                if (nodes[at].child[b] < 0)
+                {
+                    nodes[at].child[b] = std::int16_t(nodes.size());
+                    nodes.emplace_back();
+                }
+                at = std::size_t(nodes[at].child[b]);
+            }
+            nodes[at].symbol = std::int16_t(sym);
+        }
+    }
+
+    std::vector< node > nodes;
+};
+
+[[noreturn]] void
+fail()
+{
+    throw system_error(h2_error::compression_error);
+}
+
+void
+huffman_decode(std::string_view in, std::string &out)
+{
+    static auto const tree = huffman_tree();
+
+    auto at       = std::size_t(0);
+    auto pad_bits = 0;
+    auto all_ones = true;
+    for (auto c : in)
+    {
+        for (int i = 7; i >= 0; --i)
+        {
+            auto b = (static_cast< unsigned char >(c) >> i) & 1;
+            all_ones &= b == 1;
+            ++pad_bits;
+            auto next = tree.nodes[at].child[b];
+            if (next < 0)
+                fail();
+            at        = std::size_t(next);
+            auto &sym = tree.nodes[at].symbol;
+            if (sym >= 0)
+            {
+                if (sym == eos)
+                    fail();
+                out.push_back(char(sym));
+                at       = 0;
+                pad_bits = 0;
+                all_ones = true;
+            }
+        }
+    }
+
+    // what is left over must be a prefix of EOS, and shorter than an octet
+    if (pad_bits > 7 || !all_ones)
+        fail();
+}
+
+struct reader
+{
+    std::string_view in;
+
+    bool
+    done() const
+    {
+        return in.empty();
+    }
+
+    unsigned char
+    peek() const
+    {
+        return static_cast< unsigned char >(in.front());
+    }
+
+    unsigned char
+    next()
+    {
+        if (in.empty())
+            fail();
+        auto c = peek();
+        in.remove_prefix(1);
+        return c;
+    }
+
+    // an integer whose first octet uses the low prefix_bits bits
+    std::size_t
+    integer(int prefix_bits)
+    {
+        auto const mask  = (1u << prefix_bits) - 1;
+        auto       value = std::size_t(next() & mask);
+        if (value < mask)
+            return value;
+
+        for (int shift = 0;; shift += 7)
+        {
+            if (shift > 28)
+                fail();
+            auto c = next();
+            value += std::size_t(c & 0x7f) << shift;
+            if (!(c & 0x80))
+                return value;
+        }
+    }
+
+    std::string
+    string()
+    {
+        auto huffman = (peek() & 0x80) != 0;
+        auto length  = integer(7);
+        if (length > in.size())
+            fail();
+        auto raw = in.substr(0, length);
+        in.remove_prefix(length);
+
+        auto result = std::string();
+        if (huffman)
+            huffman_decode(raw, result);
+        else
+            result.assign(raw);
+        return result;
+    }
+};
+
+void
+append_integer(std::string &out,
+               std::uint8_t pattern,
+               int          prefix_bits,
+               std::size_t  value)
+{
+    auto const mask = (std::size_t(1) << prefix_bits) - 1;
+    if (value < mask)
+    {
+        out.push_back(char(pattern | value));
+        return;
+    }
+
+    out.push_back(char(pattern | mask));
+    value -= mask;
+    while (value >= 0x80)
+    {
+        out.push_back(char(0x80 | (value & 0x7f)));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+void
+append_string(std::string &out, std::string_view s)
+{
+    append_integer(out, 0x00, 7, s.size());
+    out.append(s);
+}
+
+constexpr std::size_t
+entry_size(header_field const &f)
+{
+    return f.name.size() + f.value.size() + 32;
+}
+}   // namespace
+
+std::string_view
+find_header(header_list const &headers, std::string_view name)
+{
+    for (auto &f : headers)
+        if (f.name == name)
+            return f.value;
+    return {};
+}
+
+void
+hpack_encode(header_list const &headers, std::string &out)
+{
+    for (auto &f : headers)
+    {
+        auto name_index = std::size_t(0);
+        auto full_index = std::size_t(0);
+        for (std::size_t i = 0; i < static_size && !full_index; ++i)
+        {
+            if (static_table[i].name != f.name)
+                continue;
+            if (!name_index)
+                name_index = i + 1;
+            if (static_table[i].value == f.value)
+                full_index = i + 1;
+        }
+
+        if (full_index)
+        {
+            // indexed header field
+            append_integer(out, 0x80, 7, full_index);
+            continue;
+        }
+
+        // literal header field without indexing
+        append_integer(out, 0x00, 4, name_index);
+        if (!name_index)
+            append_string(out, f.name);
+        append_string(out, f.value);
+    }
+}
+
+hpack_decoder::hpack_decoder(std::size_t max_table_size,
+                             std::size_t max_list_size)
+: limit_(max_table_size)
+, max_table_size_(max_table_size)
+, max_list_size_(max_list_size)
+{
+}
+
+header_list
+hpack_decoder::decode(std::string_view block)
+{
+    auto in     = reader { block };
+    auto result = header_list();
+    auto total  = std::size_t(0);
+    auto emit   = [&](header_field f)
+    {
+        total += entry_size(f);
+        if (total > max_list_size_)
+            fail();
+        result.push_back(std::move(f));
+    };
+
+    while (!in.done())
+    {
+        auto c = in.peek();
+        if (c & 0x80)
+        {
+            // indexed header field
+            emit(lookup(in.integer(7)));
+        }
+        else if (c & 0x40)
+        {
+            // literal header field with incremental indexing
+            auto index = in.integer(6);
+            auto f     = header_field();
+            f.name     = index ? lookup(index).name : in.string();
+            f.value    = in.string();
+            insert(f);
+            emit(std::move(f));
+        }
+        else if (c & 0x20)
+        {
+            // dynamic table size update
+            auto size = in.integer(5);
+            if (size > max_table_size_)
+                fail();
+            limit_ = size;
+            evict(limit_);
+        }
+        else
+        {
+            // literal header field without indexing, or never indexed
+            auto index = in.integer(4);
+            auto f     = header_field();
+            f.name     = index ? lookup(index).name : in.string();
+            f.value    = in.string();
+            emit(std::move(f));
+        }
+    }
+    return result;
+}
+
+header_field const &
+hpack_decoder::lookup(std::size_t index) const
+{
+    static auto const fields = []
+    {
+        auto v = std::vector< header_field >();
+        for (auto &e : static_table)
+            v.push_back({ std::string(e.name), std::string(e.value) });
+        return v;
+    }();
+
+    if (index == 0)
+        fail();
+    if (index <= static_size)
+        return fields[index - 1];
+    index -= static_size + 1;
+    if (index >= dynamic_.size())
+        fail();
+    return dynamic_[index];
+}
+
+void
+hpack_decoder::insert(header_field field)
+{
+    auto size = entry_size(field);
+    if (size > limit_)
+    {
+        // an entry larger than the table empties it and is not kept
+        evict(0);
+        return;
+    }
+    evict(limit_ - size);
+    size_ += size;
+    dynamic_.push_front(std::move(field));
+}
+
+void
+hpack_decoder::evict(std::size_t limit)
+{
+    while (size_ > limit)
+    {
+        size_ -= entry_size(dynamic_.back());
+        dynamic_.pop_back();
+    }
+}
+
+}   // namespace blog
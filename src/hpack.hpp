@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_HPACK_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_HPACK_HPP
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace blog
+{
+
+struct header_field
+{
+    std::string name;
+    std::string value;
+};
+
+using header_list = std::vector< header_field >;
+
+/// The value of the first field called name, or an empty view
+std::string_view
+find_header(header_list const &headers, std::string_view name);
+
+/// Append the HPACK encoding (RFC 7541) of headers to out.
+///
+/// Only the static table is used, and strings are sent as they are rather
+/// than Huffman coded, so encoding keeps no state and the peer's dynamic
+/// table is never touched. The header blocks of a websocket handshake are a
+/// handful of short fields sent once per stream, which is not worth more.
+void
+hpack_encode(header_list const &headers, std::string &out);
+
+/// Decodes the header blocks of one direction of a connection, keeping the
+/// dynamic table the peer's encoder maintains. Blocks must be decoded in the
+/// order they were received.
+///
+/// Malformed input throws a system_error with h2_error::compression_error,
+/// after which the connection must be abandoned.
+struct hpack_decoder
+{
+    /// max_table_size is the SETTINGS_HEADER_TABLE_SIZE advertised to the
+    /// peer. A block that decodes to more than max_list_size bytes of names
+    /// and values is rejected, since a few bytes of indices can otherwise
+    /// repeat a large table entry many times over.
+    explicit hpack_decoder(std::size_t max_table_size = 4096,
+                           std::size_t max_list_size  = 64 * 1024);
+
+    header_list
+    decode(std::string_view block);
+
+  private:
+    header_field const &
+    lookup(std::size_t index) const;
+
+    void
+    insert(header_field field);
+
+    void
+    evict(std::size_t limit);
+
+    std::deque< header_field > dynamic_;
+    std::size_t                size_  = 0;
+    std::size_t                limit_ = 4096;
+    std::size_t                max_table_size_;
+    std::size_t                max_list_size_;
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_HPACK_HPP
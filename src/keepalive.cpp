@@ -0,0 +1,105 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "keepalive.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+
+namespace blog
+{
+
+void
+keepalive_stats::record_rtt(std::chrono::microseconds rtt)
+{
+    auto us    = std::uint64_t(std::max< std::int64_t >(rtt.count(), 0));
+    rtt_min_us = pongs ? std::min(rtt_min_us, us) : us;
+    rtt_max_us = std::max(rtt_max_us, us);
+    rtt_total_us += us;
+    ++pongs;
+}
+
+keepalive::keepalive(timer_wheel      &wheel,
+                     keepalive_options options,
+                     keepalive_stats  &stats)
+: wheel_(wheel)
+, options_(options)
+, stats_(stats)
+, timer_([this] { on_timer(); })
+{
+}
+
+keepalive::~keepalive()
+{
+    if (detach_)
+        detach_();
+}
+
+void
+keepalive::start(ping_fn                 ping,
+                 std::function< void() > kill,
+                 std::function< void() > detach)
+{
+    ping_   = std::move(ping);
+    kill_   = std::move(kill);
+    detach_ = std::move(detach);
+    wheel_.arm(timer_, options_.ping_interval);
+}
+
+void
+keepalive::activity()
+{
+    // while a ping is outstanding only its pong will do, since that is what
+    // shows the peer is still reading
+    if (ping_ && !awaiting_pong_ && !options_.ping_when_busy)
+        wheel_.arm(timer_, options_.ping_interval);
+}
+
+void
+keepalive::on_control(beast::websocket::frame_type kind,
+                      beast::string_view           payload)
+{
+    if (kind == beast::websocket::frame_type::pong && awaiting_pong_ &&
+        payload == beast::string_view(payload_.data(), payload_.size()))
+    {
+        using std::chrono::microseconds;
+
+        awaiting_pong_ = false;
+        last_rtt_ =
+            std::chrono::duration_cast< microseconds >(clock::now() - sent_);
+        stats_.record_rtt(last_rtt_);
+        if (on_rtt_)
+            on_rtt_(last_rtt_);
+        wheel_.arm(timer_, options_.ping_interval);
+    }
+    else
+        activity();
+}
+
+void
+keepalive::on_timer()
+{
+    if (awaiting_pong_)
+    {
+        ++stats_.timeouts;
+        kill_();
+        return;
+    }
+
+    auto text = fmt::format("{}", ++seq_);
+    payload_.assign(text.data(), text.size());
+    sent_          = clock::now();
+    awaiting_pong_ = true;
+    ++stats_.pings;
+    ping_(payload_);
+    wheel_.arm(timer_, options_.pong_timeout);
+}
+
+}   // namespace blog
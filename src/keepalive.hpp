@@ -0,0 +1,162 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_KEEPALIVE_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_KEEPALIVE_HPP
+
+#include "config.hpp"
+#include "timer_wheel.hpp"
+
+#include <boost/describe.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace blog
+{
+
+struct keepalive_options
+{
+    /// Ping a connection once it has been quiet for this long. Zero disables
+    /// keepalive.
+    std::chrono::milliseconds ping_interval { 30'000 };
+
+    /// Close a connection whose pong has not arrived this long after the ping
+    std::chrono::milliseconds pong_timeout { 10'000 };
+
+    /// Ping every ping_interval even while messages are flowing, so that the
+    /// round trip time is sampled throughout rather than only when the
+    /// connection goes quiet
+    bool ping_when_busy = false;
+};
+
+/// Totals for any number of connections sharing them
+struct keepalive_stats
+{
+    std::uint64_t pings        = 0;
+    std::uint64_t pongs        = 0;
+    std::uint64_t timeouts     = 0;   // connections closed for a missing pong
+    std::uint64_t rtt_total_us = 0;
+    std::uint64_t rtt_min_us   = 0;
+    std::uint64_t rtt_max_us   = 0;
+
+    void
+    record_rtt(std::chrono::microseconds rtt);
+
+    /// The mean round trip time over every pong received
+    std::chrono::microseconds
+    mean_rtt() const
+    {
+        return std::chrono::microseconds(pongs ? rtt_total_us / pongs : 0);
+    }
+};
+
+BOOST_DESCRIBE_STRUCT(
+    keepalive_stats,
+    (),
+    (pings, pongs, timeouts, rtt_total_us, rtt_min_us, rtt_max_us))
+
+/// Keeps watch over one websocket. Once the connection has been quiet for
+/// ping_interval it is pinged, and if the pong does not arrive within
+/// pong_timeout its socket is closed, which fails any operation pending on
+/// it. The round trip time of each ping is recorded.
+///
+/// Pongs are only seen while a read is in progress on the stream, as they are
+/// delivered through its control callback, so the owner should always have
+/// a read outstanding and call activity() whenever a message arrives.
+///
+/// Timers live on a timer_wheel, so a keepalive must be used on the wheel's
+/// thread. It must be destroyed before the stream it is attached to.
+struct keepalive
+{
+    keepalive(timer_wheel      &wheel,
+              keepalive_options options,
+              keepalive_stats  &stats);
+
+    keepalive(keepalive const &) = delete;
+
+    ~keepalive();
+
+    /// Start watching ws. Replaces the stream's control callback.
+    template < class WebSocketStream >
+    void
+    attach(WebSocketStream &ws);
+
+    /// The peer has shown signs of life, so postpone the next ping
+    void
+    activity();
+
+    /// The round trip time of the latest ping, or zero if none has completed
+    std::chrono::microseconds
+    last_rtt() const
+    {
+        return last_rtt_;
+    }
+
+    /// Also pass the round trip time of each ping to f
+    void
+    on_rtt(std::function< void(std::chrono::microseconds) > f)
+    {
+        on_rtt_ = std::move(f);
+    }
+
+  private:
+    using clock   = timer_wheel::clock;
+    using ping_fn = std::function< void(beast::websocket::ping_data const &) >;
+    using rtt_fn  = std::function< void(std::chrono::microseconds) >;
+
+    void
+    start(ping_fn                 ping,
+          std::function< void() > kill,
+          std::function< void() > detach);
+
+    void
+    on_control(beast::websocket::frame_type kind, beast::string_view payload);
+
+    void
+    on_timer();
+
+    timer_wheel                &wheel_;
+    keepalive_options           options_;
+    keepalive_stats            &stats_;
+    timer_wheel::entry          timer_;
+    ping_fn                     ping_;
+    std::function< void() >     kill_;
+    std::function< void() >     detach_;
+    beast::websocket::ping_data payload_;
+    clock::time_point           sent_;
+    std::uint64_t               seq_           = 0;
+    bool                        awaiting_pong_ = false;
+    std::chrono::microseconds   last_rtt_ { 0 };
+    rtt_fn                      on_rtt_;
+};
+
+template < class WebSocketStream >
+void
+keepalive::attach(WebSocketStream &ws)
+{
+    if (options_.ping_interval.count() <= 0)
+        return;
+
+    ws.control_callback(
+        [this](beast::websocket::frame_type kind, beast::string_view payload)
+        { on_control(kind, payload); });
+
+    // the ping's completion is not interesting: a lost peer is detected by
+    // the missing pong, and the keepalive may be gone by the time it runs
+    start([&ws](beast::websocket::ping_data const &payload)
+          { ws.async_ping(payload, [](error_code) {}); },
+          [&ws] { beast::close_socket(beast::get_lowest_layer(ws)); },
+          [&ws] { ws.control_callback(); });
+}
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_KEEPALIVE_HPP
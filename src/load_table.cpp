@@ -0,0 +1,404 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "load_table.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace blog
+{
+
+// Plain integers, only ever touched through std::atomic_ref, so that a
+// mapping of zeros is a valid empty table in every process that maps it.
+//
+// owner holds the slot's state and the generation of its current claim. A
+// claim sets it to claiming before rewriting root and back to ready after,
+// so a reader that sees the same owner before and after copying root has
+// copied it whole: owner doubles as the sequence number of a seqlock.
+struct alignas(64) load_table::slot
+{
+    std::uint64_t owner;          // generation << 2 | state
+    std::uint64_t heartbeat_ns;   // steady clock, which is shared by processes
+    std::uint32_t active;
+    std::uint32_t pending;
+    std::uint32_t handshake_us;   // moving average
+    std::uint32_t unused;
+    std::uint64_t root[max_root / 8];   // NUL padded
+
+    void
+    write_root(std::string_view r);
+
+    bool
+    read_root(std::uint64_t owner_seen, char (&out)[max_root]);
+};
+
+namespace
+{
+constexpr std::uint64_t slot_free     = 0;
+constexpr std::uint64_t slot_claiming = 1;
+constexpr std::uint64_t slot_ready    = 2;
+constexpr std::uint64_t state_mask    = 3;
+
+constexpr std::uint64_t
+owner_word(std::uint64_t generation, std::uint64_t state)
+{
+    return generation << 2 | state;
+}
+
+template < class T >
+std::atomic_ref< T >
+ref(T &x)
+{
+    static_assert(std::atomic_ref< T >::is_always_lock_free);
+    return std::atomic_ref< T >(x);
+}
+
+std::uint64_t
+now_ns()
+{
+    using namespace std::chrono;
+    return std::uint64_t(
+        duration_cast< nanoseconds >(steady_clock::now().time_since_epoch())
+            .count());
+}
+
+// whether a heartbeat at beat is recent at now. Another process may have
+// beaten since now was read.
+bool
+fresh(std::uint64_t beat, std::uint64_t now, std::chrono::milliseconds limit)
+{
+    return beat >= now ||
+           now - beat <= std::uint64_t(limit.count()) * 1'000'000;
+}
+
+[[noreturn]] void
+throw_errno(std::string const &what)
+{
+    throw system_error(error_code(errno, asio::error::get_system_category()),
+                       what);
+}
+}   // namespace
+
+// called by the claimant with owner set to claiming
+void
+load_table::slot::write_root(std::string_view r)
+{
+    std::uint64_t words[max_root / 8] = {};
+    std::memcpy(words, r.data(), r.size());
+    std::atomic_thread_fence(std::memory_order_release);
+    for (std::size_t i = 0; i < std::size(words); ++i)
+        ref(root[i]).store(words[i], std::memory_order_relaxed);
+}
+
+// copy out root, which is only good if owner is still owner_seen after,
+// which must have been loaded with acquire
+bool
+load_table::slot::read_root(std::uint64_t owner_seen, char (&out)[max_root])
+{
+    std::uint64_t words[max_root / 8];
+    for (std::size_t i = 0; i < std::size(words); ++i)
+        words[i] = ref(root[i]).load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (ref(owner).load(std::memory_order_relaxed) != owner_seen)
+        return false;
+    std::memcpy(out, words, sizeof(words));
+    out[max_root - 1] = 0;
+    return true;
+}
+
+load_table::load_table(std::string const &path)
+{
+    constexpr auto table_bytes = sizeof(slot) * max_backends;
+
+    void *p = nullptr;
+    if (path.empty())
+        p = ::mmap(nullptr,
+                   table_bytes,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS,
+                   -1,
+                   0);
+    else
+    {
+        auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+            throw_errno(path);
+
+        // a new file is sized here, and its zeros are an empty table. Any
+        // number of processes may race to do this.
+        struct ::stat st;
+        if (::fstat(fd, &st) < 0 ||
+            (st.st_size == 0 && ::ftruncate(fd, ::off_t(table_bytes)) < 0))
+        {
+            auto e = errno;
+            ::close(fd);
+            errno = e;
+            throw_errno(path);
+        }
+        if (st.st_size != 0 && std::size_t(st.st_size) != table_bytes)
+        {
+            ::close(fd);
+            throw std::runtime_error(path + ": not a load table");
+        }
+
+        p = ::mmap(
+            nullptr, table_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+    }
+    if (p == MAP_FAILED)
+        throw_errno(path.empty() ? "load_table" : path);
+    slots_ = static_cast< slot * >(p);
+}
+
+load_table::~load_table()
+{
+    ::munmap(slots_, sizeof(slot) * max_backends);
+}
+
+load_table::lease
+load_table::register_backend(std::string_view          root,
+                             std::chrono::milliseconds stale_after)
+{
+    if (root.size() >= max_root)
+        throw std::invalid_argument(
+            fmt::format("backend root too long: {}", root));
+
+    // Claims are won by compare and swap on owner, so two backends racing
+    // for a slot cannot both claim it, and each claim is a new generation
+    auto claim = [&](std::size_t i, std::uint64_t seen) -> lease
+    {
+        auto &s          = slots_[i];
+        auto  generation = (seen >> 2) + 1;
+        if (!ref(s.owner).compare_exchange_strong(
+                seen,
+                owner_word(generation, slot_claiming),
+                std::memory_order_acq_rel))
+            return {};
+
+        s.write_root(root);
+        ref(s.active).store(0, std::memory_order_relaxed);
+        ref(s.pending).store(0, std::memory_order_relaxed);
+        ref(s.handshake_us).store(0, std::memory_order_relaxed);
+        ref(s.heartbeat_ns).store(now_ns(), std::memory_order_relaxed);
+        ref(s.owner).store(owner_word(generation, slot_ready),
+                           std::memory_order_release);
+        return { .slot = i, .generation = generation };
+    };
+
+    // a backend that restarts, or a successor given its listeners, takes the
+    // slot of its root over, which shuts its predecessor out of it
+    for (std::size_t i = 0; i < max_backends; ++i)
+    {
+        auto &s     = slots_[i];
+        auto  owner = ref(s.owner).load(std::memory_order_acquire);
+        char  r[max_root];
+        if ((owner & state_mask) == slot_ready && s.read_root(owner, r) &&
+            root == r)
+            if (auto l = claim(i, owner))
+                return l;
+    }
+
+    // then a free slot if there is one, and otherwise one whose backend has
+    // gone without releasing it
+    for (std::size_t i = 0; i < max_backends; ++i)
+    {
+        auto owner = ref(slots_[i].owner).load(std::memory_order_acquire);
+        if ((owner & state_mask) == slot_free)
+            if (auto l = claim(i, owner))
+                return l;
+    }
+    auto now = now_ns();
+    for (std::size_t i = 0; i < max_backends; ++i)
+    {
+        auto &s     = slots_[i];
+        auto  owner = ref(s.owner).load(std::memory_order_acquire);
+        if ((owner & state_mask) == slot_ready &&
+            !fresh(ref(s.heartbeat_ns).load(std::memory_order_relaxed),
+                   now,
+                   stale_after))
+            if (auto l = claim(i, owner))
+                return l;
+    }
+
+    throw std::runtime_error("load table is full");
+}
+
+// The slot of a lease that is still current. A claim that overtakes the check
+// can still see one write from the old owner land, which the new owner's next
+// publication overwrites.
+load_table::slot *
+load_table::owned(lease const &l) const
+{
+    if (!l)
+        return nullptr;
+    auto &s = slots_[l.slot];
+    if (ref(s.owner).load(std::memory_order_acquire) !=
+        owner_word(l.generation, slot_ready))
+        return nullptr;
+    return &s;
+}
+
+void
+load_table::release(lease const &l)
+{
+    if (!l)
+        return;
+    auto expected = owner_word(l.generation, slot_ready);
+    ref(slots_[l.slot].owner)
+        .compare_exchange_strong(expected,
+                                 owner_word(l.generation, slot_free),
+                                 std::memory_order_release,
+                                 std::memory_order_relaxed);
+}
+
+void
+load_table::set_active(lease const &l, std::uint32_t active)
+{
+    auto s = owned(l);
+    if (!s)
+        return;
+    ref(s->active).store(active, std::memory_order_relaxed);
+    ref(s->heartbeat_ns).store(now_ns(), std::memory_order_relaxed);
+}
+
+void
+load_table::record_handshake(lease const &l, std::chrono::microseconds t)
+{
+    auto s = owned(l);
+    if (!s)
+        return;
+
+    // only the backend writes its average, so a load and a store will do
+    auto sample = std::int64_t(t.count());
+    auto avg    = ref(s->handshake_us);
+    auto old    = std::int64_t(avg.load(std::memory_order_relaxed));
+    auto next   = old ? old + (sample - old) / 8 : sample;
+    avg.store(std::uint32_t(std::clamp< std::int64_t >(
+                  next, 1, std::numeric_limits< std::uint32_t >::max())),
+              std::memory_order_relaxed);
+}
+
+void
+load_table::heartbeat(lease const &l)
+{
+    auto s = owned(l);
+    if (!s)
+        return;
+    ref(s->pending).store(0, std::memory_order_relaxed);
+    ref(s->heartbeat_ns).store(now_ns(), std::memory_order_relaxed);
+}
+
+void
+load_table::arrived(lease const &l)
+{
+    auto s = owned(l);
+    if (!s)
+        return;
+    auto pending = ref(s->pending);
+    auto n       = pending.load(std::memory_order_relaxed);
+    while (n && !pending.compare_exchange_weak(
+                    n, n - 1, std::memory_order_relaxed))
+        ;
+}
+
+std::string
+load_table::choose(std::vector< std::string > const &candidates,
+                   std::chrono::milliseconds         stale_after)
+{
+    auto now        = now_ns();
+    auto best       = npos;
+    auto best_owner = std::uint64_t(0);
+    auto best_cost  = std::numeric_limits< std::uint64_t >::max();
+    char best_root[max_root];
+    for (std::size_t i = 0; i < max_backends; ++i)
+    {
+        auto &s     = slots_[i];
+        auto  owner = ref(s.owner).load(std::memory_order_acquire);
+        if ((owner & state_mask) != slot_ready ||
+            !fresh(ref(s.heartbeat_ns).load(std::memory_order_relaxed),
+                   now,
+                   stale_after))
+            continue;
+
+        auto connections =
+            std::uint64_t(ref(s.active).load(std::memory_order_relaxed)) +
+            ref(s.pending).load(std::memory_order_relaxed) + 1;
+        auto cost = connections *
+                    (ref(s.handshake_us).load(std::memory_order_relaxed) +
+                     std::uint64_t(1000));
+        if (cost >= best_cost)
+            continue;
+
+        char root[max_root];
+        if (!s.read_root(owner, root))
+            continue;
+        if (!candidates.empty() &&
+            std::find(candidates.begin(),
+                      candidates.end(),
+                      std::string_view(root)) == candidates.end())
+            continue;
+
+        best       = i;
+        best_owner = owner;
+        best_cost  = cost;
+        std::memcpy(best_root, root, max_root);
+    }
+
+    if (best == npos)
+        return {};
+
+    // a backend that claimed the slot meanwhile is not the one chosen
+    if (ref(slots_[best].owner).load(std::memory_order_relaxed) == best_owner)
+        ref(slots_[best].pending).fetch_add(1, std::memory_order_relaxed);
+    return best_root;
+}
+
+std::vector< backend_load >
+load_table::snapshot(std::chrono::milliseconds stale_after) const
+{
+    auto now    = now_ns();
+    auto result = std::vector< backend_load >();
+    for (std::size_t i = 0; i < max_backends; ++i)
+    {
+        auto &s     = slots_[i];
+        auto  owner = ref(s.owner).load(std::memory_order_acquire);
+        if ((owner & state_mask) != slot_ready)
+            continue;
+
+        char root[max_root];
+        if (!s.read_root(owner, root))
+            continue;
+        result.push_back(backend_load {
+            .root    = root,
+            .active  = ref(s.active).load(std::memory_order_relaxed),
+            .pending = ref(s.pending).load(std::memory_order_relaxed),
+            .handshake =
+                std::chrono::microseconds(
+                    ref(s.handshake_us).load(std::memory_order_relaxed)),
+            .live = fresh(ref(s.heartbeat_ns).load(std::memory_order_relaxed),
+                          now,
+                          stale_after) });
+    }
+    return result;
+}
+
+}   // namespace blog
@@ -0,0 +1,139 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_LOAD_TABLE_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_LOAD_TABLE_HPP
+
+#include "config.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace blog
+{
+
+/// The load of one backend as last published
+struct backend_load
+{
+    std::string               root;
+    std::uint32_t             active  = 0;       // connections being served
+    std::uint32_t             pending = 0;       // redirects yet to arrive
+    std::chrono::microseconds handshake { 0 };   // recent TLS handshakes
+    bool                      live = false;      // heard from recently
+};
+
+/// The live load of a set of backends, kept in a file that every process
+/// involved maps, so that each backend can publish its own load and a
+/// redirecting server can read them all without asking.
+///
+/// The table is a fixed array of slots, one per backend root. Every field is
+/// a lock-free atomic in the mapping, so there are no locks to be left held
+/// by a process that dies. A slot's load has one writer: the backend itself,
+/// or a feeder standing in for it. Redirecting servers add to its pending
+/// count, which the backend takes back as the redirected clients arrive.
+///
+/// A backend publishes a heartbeat with its load. One not heard from within
+/// the staleness limit given to choose() is passed over, and its slot may be
+/// claimed by another backend, so that backends on ephemeral ports do not
+/// fill the table. A backend releases its slot when it stops.
+///
+/// Each claim of a slot starts a new generation of it, which the claimant
+/// holds as a lease. A backend whose slot has been claimed from under it,
+/// because it stalled or because a successor took its root over, finds its
+/// lease out of date and its writes are ignored.
+struct load_table
+{
+    static constexpr std::size_t max_backends = 64;
+    static constexpr std::size_t max_root     = 200;
+    static constexpr std::size_t npos         = ~std::size_t(0);
+
+    /// A backend's claim on a slot
+    struct lease
+    {
+        std::size_t   slot       = npos;
+        std::uint64_t generation = 0;
+
+        explicit
+        operator bool() const
+        {
+            return slot != npos;
+        }
+    };
+
+    /// Map the table in the file at path, creating it if need be. An empty
+    /// path makes a table private to this process.
+    explicit load_table(std::string const &path);
+
+    load_table(load_table const &) = delete;
+
+    load_table &
+    operator=(load_table const &) = delete;
+
+    ~load_table();
+
+    /// Claim a slot for the backend at root: the one it already has, a free
+    /// one, or else one whose backend has not been heard from within
+    /// stale_after. Throws if there is no such slot or root is too long.
+    lease
+    register_backend(std::string_view          root,
+                     std::chrono::milliseconds stale_after);
+
+    /// Give up a slot, unless it has been claimed by another backend since
+    void
+    release(lease const &l);
+
+    /// Publish the connections a backend is serving, and beat its heart
+    void
+    set_active(lease const &l, std::uint32_t active);
+
+    /// Fold a TLS handshake time into the backend's moving average
+    void
+    record_handshake(lease const &l, std::chrono::microseconds t);
+
+    /// Say that the backend is alive, and forget any redirects to it that
+    /// have not arrived since the last heartbeat
+    void
+    heartbeat(lease const &l);
+
+    /// A connection has arrived at the backend, so one fewer is on its way
+    void
+    arrived(lease const &l);
+
+    /// The root of the least loaded live backend whose root is among
+    /// candidates, or of any live backend if candidates is empty. The choice
+    /// is counted as pending against it. Returns an empty string if there is
+    /// no live backend to choose.
+    ///
+    /// Load is (active + pending + 1) * (handshake + 1ms), so connection
+    /// counts decide between backends that handshake equally quickly, and a
+    /// backend that has slowed down is given fewer new clients.
+    std::string
+    choose(std::vector< std::string > const &candidates,
+           std::chrono::milliseconds         stale_after);
+
+    /// The load of every registered backend
+    std::vector< backend_load >
+    snapshot(std::chrono::milliseconds stale_after) const;
+
+  private:
+    struct slot;
+
+    slot *
+    owned(lease const &l) const;
+
+    slot *slots_ = nullptr;
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_LOAD_TABLE_HPP
@@ -0,0 +1,99 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace blog
+{
+namespace
+{
+[[noreturn]] void
+throw_errno(std::string const &what)
+{
+    throw system_error(error_code(errno, asio::error::get_system_category()),
+                       what);
+}
+}   // namespace
+
+mapped_file::mapped_file(std::string const &path)
+{
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw_errno(path);
+
+    struct ::stat st;
+    if (::fstat(fd, &st) < 0)
+    {
+        auto err = errno;
+        ::close(fd);
+        errno = err;
+        throw_errno(path);
+    }
+
+    size_ = static_cast< std::size_t >(st.st_size);
+    if (size_)
+    {
+        auto p   = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        auto err = errno;
+        ::close(fd);
+        if (p == MAP_FAILED)
+        {
+            errno = err;
+            throw_errno(path);
+        }
+        data_ = p;
+        ::madvise(p, size_, MADV_SEQUENTIAL);
+    }
+    else
+    {
+        ::close(fd);
+    }
+}
+
+mapped_file::mapped_file(mapped_file &&other) noexcept
+: data_(std::exchange(other.data_, nullptr))
+, size_(std::exchange(other.size_, 0))
+{
+}
+
+mapped_file &
+mapped_file::operator=(mapped_file &&other) noexcept
+{
+    auto tmp = std::move(other);
+    std::swap(data_, tmp.data_);
+    std::swap(size_, tmp.size_);
+    return *this;
+}
+
+mapped_file::~mapped_file()
+{
+    if (data_)
+        ::munmap(const_cast< void * >(data_), size_);
+}
+
+void
+mapped_file::release_prefix(std::size_t n)
+{
+    static auto const page =
+        static_cast< std::size_t >(::sysconf(_SC_PAGESIZE));
+
+    n = std::min(n, size_) / page * page;
+    if (n)
+        ::madvise(const_cast< void * >(data_), n, MADV_DONTNEED);
+}
+
+}   // namespace blog
@@ -0,0 +1,60 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_MAPPED_FILE_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_MAPPED_FILE_HPP
+
+#include "config.hpp"
+
+#include <cstddef>
+#include <string>
+
+namespace blog
+{
+
+/// A file mapped read-only into memory, for sending without reading it into
+/// a buffer first.
+struct mapped_file
+{
+    explicit mapped_file(std::string const &path);
+
+    mapped_file(mapped_file &&other) noexcept;
+
+    mapped_file &
+    operator=(mapped_file &&other) noexcept;
+
+    ~mapped_file();
+
+    asio::const_buffer
+    buffer() const
+    {
+        return asio::const_buffer(data_, size_);
+    }
+
+    std::size_t
+    size() const
+    {
+        return size_;
+    }
+
+    /// Drop the pages wholly within the first n bytes from the resident set.
+    /// Used once they have been sent, so that sending a large file does not
+    /// leave all of it resident. The data is still readable afterwards; it is
+    /// simply faulted in from the file again.
+    void
+    release_prefix(std::size_t n);
+
+  private:
+    void const *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_MAPPED_FILE_HPP
@@ -0,0 +1,93 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_MEMORY_ACCOUNTING_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_MEMORY_ACCOUNTING_HPP
+
+#include <boost/describe.hpp>
+
+#include <cstddef>
+
+namespace blog
+{
+
+/// What the server's connections are holding, as far as the server can see.
+/// Memory owned by OpenSSL and the kernel is not included; the benchmark in
+/// bench/bench_idle_memory.cpp measures the whole resident cost.
+struct memory_report
+{
+    std::size_t connections    = 0;
+    std::size_t stream_bytes   = 0;   // fixed size state of the streams
+    std::size_t buffer_bytes   = 0;   // receive buffers currently allocated
+    std::size_t per_connection = 0;
+};
+
+BOOST_DESCRIBE_STRUCT(
+    memory_report,
+    (),
+    (connections, stream_bytes, buffer_bytes, per_connection))
+
+/// Running totals of the memory held by connections. Like the rest of the
+/// server's state it is only touched from the server's executor.
+struct memory_accounting
+{
+    memory_report
+    report() const
+    {
+        auto r = memory_report { .connections  = connections,
+                                 .stream_bytes = stream_bytes,
+                                 .buffer_bytes = buffer_bytes };
+        if (connections)
+            r.per_connection = (stream_bytes + buffer_bytes) / connections;
+        return r;
+    }
+
+    std::size_t connections  = 0;
+    std::size_t stream_bytes = 0;
+    std::size_t buffer_bytes = 0;
+};
+
+/// One connection's share of a memory_accounting, for as long as the
+/// connection exists. Call buffer() whenever the connection's buffer capacity
+/// may have changed.
+struct connection_memory
+{
+    connection_memory(memory_accounting &acct, std::size_t stream_bytes)
+    : acct_(acct)
+    , stream_bytes_(stream_bytes)
+    {
+        ++acct_.connections;
+        acct_.stream_bytes += stream_bytes_;
+    }
+
+    connection_memory(connection_memory const &) = delete;
+
+    ~connection_memory()
+    {
+        --acct_.connections;
+        acct_.stream_bytes -= stream_bytes_;
+        acct_.buffer_bytes -= buffer_bytes_;
+    }
+
+    void
+    buffer(std::size_t capacity)
+    {
+        acct_.buffer_bytes = acct_.buffer_bytes - buffer_bytes_ + capacity;
+        buffer_bytes_      = capacity;
+    }
+
+  private:
+    memory_accounting &acct_;
+    std::size_t        stream_bytes_;
+    std::size_t        buffer_bytes_ = 0;
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_MEMORY_ACCOUNTING_HPP
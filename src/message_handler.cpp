@@ -0,0 +1,83 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "message_handler.hpp"
+
+namespace blog
+{
+namespace
+{
+std::uint64_t
+nanoseconds(registered_handler::clock::duration d)
+{
+    return std::uint64_t(
+        std::chrono::duration_cast< std::chrono::nanoseconds >(d).count());
+}
+}   // namespace
+
+bool
+registered_handler::handle_inline(ws_message &m)
+{
+    constexpr auto relaxed = std::memory_order_relaxed;
+
+    auto start = clock::now();
+    try
+    {
+        auto reply = handler->handle(m);
+        service_ns_.fetch_add(nanoseconds(clock::now() - start), relaxed);
+        handled_.fetch_add(1, relaxed);
+        return reply;
+    }
+    catch (...)
+    {
+        service_ns_.fetch_add(nanoseconds(clock::now() - start), relaxed);
+        handled_.fetch_add(1, relaxed);
+        failed_.fetch_add(1, relaxed);
+        throw;
+    }
+}
+
+void
+registered_handler::on_queued()
+{
+    constexpr auto relaxed = std::memory_order_relaxed;
+
+    offloaded_.fetch_add(1, relaxed);
+    auto depth = queued_.fetch_add(1, relaxed) + 1;
+    auto peak  = peak_queued_.load(relaxed);
+    while (depth > peak && !peak_queued_.compare_exchange_weak(peak, depth))
+        ;
+}
+
+bool
+registered_handler::handle_offloaded(ws_message       &m,
+                                     clock::time_point queued_at)
+{
+    constexpr auto relaxed = std::memory_order_relaxed;
+
+    queued_.fetch_sub(1, relaxed);
+    wait_ns_.fetch_add(nanoseconds(clock::now() - queued_at), relaxed);
+    return handle_inline(m);
+}
+
+handler_stats
+registered_handler::stats() const
+{
+    constexpr auto relaxed = std::memory_order_relaxed;
+
+    return handler_stats { .handled     = handled_.load(relaxed),
+                           .offloaded   = offloaded_.load(relaxed),
+                           .failed      = failed_.load(relaxed),
+                           .queued      = queued_.load(relaxed),
+                           .peak_queued = peak_queued_.load(relaxed),
+                           .wait_ns     = wait_ns_.load(relaxed),
+                           .service_ns  = service_ns_.load(relaxed) };
+}
+
+}   // namespace blog
@@ -0,0 +1,152 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_MESSAGE_HANDLER_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_MESSAGE_HANDLER_HPP
+
+#include "config.hpp"
+
+#include <boost/describe.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+namespace blog
+{
+
+/// A websocket message and whether it is text
+struct ws_message
+{
+    beast::flat_buffer buffer;
+    bool               text = true;
+
+    std::string_view
+    view() const
+    {
+        auto data = buffer.cdata();
+        return std::string_view(static_cast< char const * >(data.data()),
+                                data.size());
+    }
+};
+
+/// What a websocket session does with each message it receives. A route
+/// names its handler as its upgrade behaviour; see server::add_handler.
+///
+/// One handler serves every session of its route, so handle() may be called
+/// for several messages at once from different threads if the handler
+/// offloads, and must then be thread safe.
+struct message_handler
+{
+    virtual ~message_handler() = default;
+
+    /// Replace the message in m with the reply to it, which may be the
+    /// message itself. Return false to send no reply. An exception fails the
+    /// session.
+    virtual bool
+    handle(ws_message &m) = 0;
+
+    /// Whether handle() should run on the server's worker pool rather than
+    /// on the connection's thread. A handler that takes more than a few
+    /// microseconds per message should say yes, or every connection on the
+    /// thread waits for it.
+    virtual bool
+    offload() const
+    {
+        return false;
+    }
+};
+
+/// Sends every message straight back
+struct echo_handler final : message_handler
+{
+    bool
+    handle(ws_message &) override
+    {
+        return true;
+    }
+};
+
+struct handler_stats
+{
+    std::uint64_t handled     = 0;   // messages handled, inline or offloaded
+    std::uint64_t offloaded   = 0;   // messages sent to the worker pool
+    std::uint64_t failed      = 0;   // messages whose handler threw
+    std::uint64_t queued      = 0;   // waiting for a worker now
+    std::uint64_t peak_queued = 0;
+    std::uint64_t wait_ns     = 0;   // total time spent waiting for a worker
+    std::uint64_t service_ns  = 0;   // total time spent in handle()
+
+    std::chrono::nanoseconds
+    mean_wait() const
+    {
+        return std::chrono::nanoseconds(offloaded ? wait_ns / offloaded : 0);
+    }
+
+    std::chrono::nanoseconds
+    mean_service() const
+    {
+        return std::chrono::nanoseconds(handled ? service_ns / handled : 0);
+    }
+};
+
+BOOST_DESCRIBE_STRUCT(handler_stats,
+                      (),
+                      (handled,
+                       offloaded,
+                       failed,
+                       queued,
+                       peak_queued,
+                       wait_ns,
+                       service_ns))
+
+/// A handler as the server holds it, with its statistics. The counters are
+/// updated by the connection threads and the workers alike, so they are
+/// atomic; relaxed ordering is enough for totals.
+struct registered_handler
+{
+    using clock = std::chrono::steady_clock;
+
+    explicit registered_handler(std::shared_ptr< message_handler > h)
+    : handler(std::move(h))
+    {
+    }
+
+    /// Call the handler here and now, timing it
+    bool
+    handle_inline(ws_message &m);
+
+    /// Count a message sent to a worker
+    void
+    on_queued();
+
+    /// Call the handler on a worker for a message queued at queued_at
+    bool
+    handle_offloaded(ws_message &m, clock::time_point queued_at);
+
+    handler_stats
+    stats() const;
+
+    std::shared_ptr< message_handler > handler;
+
+  private:
+    std::atomic< std::uint64_t > handled_ { 0 };
+    std::atomic< std::uint64_t > offloaded_ { 0 };
+    std::atomic< std::uint64_t > failed_ { 0 };
+    std::atomic< std::uint64_t > queued_ { 0 };
+    std::atomic< std::uint64_t > peak_queued_ { 0 };
+    std::atomic< std::uint64_t > wait_ns_ { 0 };
+    std::atomic< std::uint64_t > service_ns_ { 0 };
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_MESSAGE_HANDLER_HPP
@@ -0,0 +1,89 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_MPSC_QUEUE_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_MPSC_QUEUE_HPP
+
+#include <atomic>
+
+namespace blog
+{
+
+struct mpsc_node
+{
+    std::atomic< mpsc_node * > next { nullptr };
+};
+
+/// An intrusive queue with any number of producers and one consumer, after
+/// Dmitry Vyukov's design. push() is wait free: one exchange and one store.
+/// pop() takes no lock, but may return null while a push is half done even
+/// though the queue is not empty, so the consumer should retry rather than
+/// take null to mean empty if it knows something is queued.
+///
+/// The queue does not own its nodes.
+struct mpsc_queue
+{
+    mpsc_queue() = default;
+
+    mpsc_queue(mpsc_queue const &) = delete;
+
+    mpsc_queue &
+    operator=(mpsc_queue const &) = delete;
+
+    /// Called by any thread
+    void
+    push(mpsc_node *n)
+    {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        auto *prev = head_.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    /// Called by the consumer only
+    mpsc_node *
+    pop()
+    {
+        auto *tail = tail_;
+        auto *next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_)
+        {
+            if (!next)
+                return nullptr;
+            tail_ = next;
+            tail  = next;
+            next  = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next)
+        {
+            tail_ = next;
+            return tail;
+        }
+
+        // tail is the last node, unless a push is under way. Put the stub
+        // behind it so that it can be handed out.
+        if (tail != head_.load(std::memory_order_acquire))
+            return nullptr;
+        push(&stub_);
+        next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return nullptr;
+        tail_ = next;
+        return tail;
+    }
+
+  private:
+    mpsc_node                  stub_;
+    std::atomic< mpsc_node * > head_ { &stub_ };
+    mpsc_node                 *tail_ = &stub_;
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_MPSC_QUEUE_HPP
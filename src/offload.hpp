@@ -0,0 +1,91 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_OFFLOAD_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_OFFLOAD_HPP
+
+#include "config.hpp"
+
+#include <memory>
+#include <utility>
+
+namespace blog
+{
+
+/// Await an asynchronous operation whose work is done on pool rather than on
+/// the calling coroutine's executor. initiate is called with a completion
+/// token and starts the operation, e.g.
+///
+///     co_await offload< void(error_code) >(
+///         pool,
+///         [&](auto token)
+///         { return stream.async_handshake(server, std::move(token)); });
+///
+/// The operation is started on a strand of the pool and the token is bound
+/// to it, so every intermediate step of a composed operation runs there. For
+/// a TLS handshake that is the asymmetric crypto. The I/O objects stay with
+/// the executor they were made on. Only the work between their completions
+/// moves. The coroutine is resumed on its own executor once the operation
+/// completes, and an error is thrown as for use_awaitable.
+///
+/// Cancelling the coroutine cancels the operation. The request is passed to
+/// the strand, where the operation's own cancellation slot is, since that
+/// slot may only be used by one thread at a time.
+///
+/// Nothing else may use the operation's I/O objects until it completes.
+template < class Signature, class Initiate >
+auto
+offload(asio::thread_pool &pool, Initiate initiate)
+{
+    return asio::async_initiate< decltype(asio::use_awaitable), Signature >(
+        [&pool](auto handler, Initiate initiate)
+        {
+            auto home   = asio::get_associated_executor(handler);
+            auto strand = asio::make_strand(pool);
+            auto cancel = std::make_shared< asio::cancellation_signal >();
+
+            auto slot = asio::get_associated_cancellation_slot(handler);
+            if (slot.is_connected())
+                slot.assign(
+                    [strand, cancel](asio::cancellation_type type)
+                    {
+                        asio::dispatch(strand,
+                                       [cancel, type] { cancel->emit(type); });
+                    });
+
+            auto done =
+                [h = std::move(handler), home, cancel](auto... args) mutable
+            {
+                asio::post(home,
+                           [h = std::move(h), args...]() mutable
+                           {
+                               asio::get_associated_cancellation_slot(h)
+                                   .clear();
+                               std::move(h)(args...);
+                           });
+            };
+            asio::dispatch(
+                strand,
+                [strand,
+                 cancel,
+                 initiate = std::move(initiate),
+                 done     = std::move(done)]() mutable
+                {
+                    initiate(asio::bind_cancellation_slot(
+                        cancel->slot(),
+                        asio::bind_executor(strand, std::move(done))));
+                });
+        },
+        asio::use_awaitable,
+        std::move(initiate));
+}
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_OFFLOAD_HPP
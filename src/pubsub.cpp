@@ -0,0 +1,112 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "pubsub.hpp"
+
+#include <algorithm>
+
+namespace blog
+{
+
+subscription::subscription(asio::any_io_executor exec,
+                           std::size_t           limit,
+                           drop_policy           policy)
+: ring_(std::max< std::size_t >(limit, 1))
+, policy_(policy)
+, signal_(exec)
+{
+}
+
+void
+subscription::push(message_ptr msg)
+{
+    if (overflowed_)
+        return;
+
+    if (count_ == ring_.size())
+    {
+        ++dropped_;
+        switch (policy_)
+        {
+        case drop_policy::drop_oldest:
+            ring_[head_] = nullptr;
+            head_        = (head_ + 1) % ring_.size();
+            --count_;
+            break;
+        case drop_policy::drop_newest:
+            return;
+        case drop_policy::disconnect:
+            overflowed_ = true;
+            for (auto &m : ring_)
+                m = nullptr;
+            count_ = 0;
+            signal_.wake();
+            return;
+        }
+    }
+
+    ring_[(head_ + count_) % ring_.size()] = std::move(msg);
+    ++count_;
+    signal_.wake();
+}
+
+message_ptr
+subscription::try_pop()
+{
+    if (count_ == 0)
+        return nullptr;
+
+    auto result  = std::move(ring_[head_]);
+    head_        = (head_ + 1) % ring_.size();
+    --count_;
+    return result;
+}
+
+asio::awaitable< message_ptr >
+subscription::pop()
+{
+    while (count_ == 0 && !overflowed_)
+        co_await signal_.wait();
+
+    co_return try_pop();
+}
+
+void
+pubsub_hub::subscribe(std::string const &topic, subscription &sub)
+{
+    topics_[topic].push_back(&sub);
+}
+
+void
+pubsub_hub::unsubscribe(std::string const &topic, subscription &sub)
+{
+    auto it = topics_.find(topic);
+    if (it == topics_.end())
+        return;
+
+    auto &subs = it->second;
+    subs.erase(std::remove(subs.begin(), subs.end(), &sub), subs.end());
+    if (subs.empty())
+        topics_.erase(it);
+}
+
+std::size_t
+pubsub_hub::publish(std::string const &topic, message_ptr const &msg)
+{
+    auto it = topics_.find(topic);
+    if (it == topics_.end())
+        return 0;
+
+    // each subscriber holds a reference to the same message, not a copy of it
+    for (auto *sub : it->second)
+        sub->push(msg);
+    return it->second.size();
+}
+
+}   // namespace blog
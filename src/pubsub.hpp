@@ -0,0 +1,112 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_PUBSUB_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_PUBSUB_HPP
+
+#include "config.hpp"
+#include "wake_signal.hpp"
+
+#include <boost/describe.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace blog
+{
+
+/// A message as received from the publisher. It is never modified once
+/// published, so every subscriber writes from the same buffer.
+struct published_message
+{
+    beast::flat_buffer buffer;
+    bool               text = true;
+};
+
+using message_ptr = std::shared_ptr< published_message const >;
+
+/// What a subscription does when a message arrives and its queue is full
+enum class drop_policy
+{
+    drop_oldest,   // discard the oldest queued message to make room
+    drop_newest,   // discard the message that has just arrived
+    disconnect     // give up on the subscriber altogether
+};
+
+BOOST_DESCRIBE_ENUM(drop_policy, drop_oldest, drop_newest, disconnect)
+
+/// A bounded queue of messages waiting to be written to one subscriber.
+///
+/// Like the rest of the server, subscriptions and the hub are not thread safe
+/// and must only be used from the server's executor.
+struct subscription
+{
+    subscription(asio::any_io_executor exec,
+                 std::size_t           limit,
+                 drop_policy           policy);
+
+    /// Queue a message, applying the drop policy if the queue is full.
+    void
+    push(message_ptr msg);
+
+    /// Take the next message without waiting. Returns null if there is none.
+    message_ptr
+    try_pop();
+
+    /// Wait for the next message. Returns null once the subscription has been
+    /// cut off by the disconnect policy.
+    asio::awaitable< message_ptr >
+    pop();
+
+    std::size_t
+    dropped() const
+    {
+        return dropped_;
+    }
+
+    bool
+    overflowed() const
+    {
+        return overflowed_;
+    }
+
+  private:
+    std::vector< message_ptr > ring_;
+    std::size_t                head_       = 0;
+    std::size_t                count_      = 0;
+    std::size_t                dropped_    = 0;
+    drop_policy                policy_;
+    bool                       overflowed_ = false;
+    wake_signal                signal_;
+};
+
+/// Fans each published message out to every subscription on its topic.
+struct pubsub_hub
+{
+    void
+    subscribe(std::string const &topic, subscription &sub);
+
+    void
+    unsubscribe(std::string const &topic, subscription &sub);
+
+    /// Queue msg for every subscriber of topic. Returns the number of
+    /// subscribers it was offered to.
+    std::size_t
+    publish(std::string const &topic, message_ptr const &msg);
+
+  private:
+    std::unordered_map< std::string, std::vector< subscription * > > topics_;
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_PUBSUB_HPP
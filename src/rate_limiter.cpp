@@ -0,0 +1,107 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+#include <string_view>
+
+namespace blog
+{
+
+std::size_t
+rate_limiter::key_hash::operator()(key_type const &key) const
+{
+    return std::hash< std::string_view >()(std::string_view(
+        reinterpret_cast< char const * >(key.data()), key.size()));
+}
+
+rate_limiter::rate_limiter(rate_limit_options options)
+: options_(options)
+{
+    auto n          = std::max< std::size_t >(options_.shards, 1);
+    shard_capacity_ = std::max< std::size_t >(options_.max_clients / n, 1);
+    for (std::size_t i = 0; i < n; ++i)
+        shards_.push_back(std::make_unique< shard >());
+}
+
+bool
+rate_limiter::admit(ip::address const &addr, clock::time_point now)
+{
+    if (!enabled())
+        return true;
+
+    // ipv4 addresses are keyed by their mapped ipv6 form
+    auto key = addr.is_v4()
+                   ? ip::make_address_v6(ip::v4_mapped, addr.to_v4()).to_bytes()
+                   : addr.to_v6().to_bytes();
+    auto hash = key_hash()(key);
+    auto &s   = *shards_[(hash >> 7) % shards_.size()];
+
+    auto lock           = std::lock_guard(s.mutex);
+    auto [it, inserted] = s.buckets.try_emplace(key);
+    auto &b             = it->second;
+    if (inserted)
+    {
+        s.lru.push_front(key);
+        b = bucket { .tokens  = options_.burst,
+                     .updated = now,
+                     .lru     = s.lru.begin() };
+        if (s.buckets.size() > shard_capacity_)
+        {
+            s.buckets.erase(s.lru.back());
+            s.lru.pop_back();
+            evicted_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    else
+    {
+        if (now > b.updated)
+        {
+            auto elapsed = std::chrono::duration< double >(now - b.updated);
+            b.tokens     = std::min(options_.burst,
+                                b.tokens + elapsed.count() * options_.rate);
+            b.updated    = now;
+        }
+        s.lru.splice(s.lru.begin(), s.lru, b.lru);
+    }
+
+    if (b.tokens < 1)
+    {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    b.tokens -= 1;
+    admitted_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+std::size_t
+rate_limiter::size() const
+{
+    auto n = std::size_t(0);
+    for (auto &s : shards_)
+    {
+        auto lock = std::lock_guard(s->mutex);
+        n += s->buckets.size();
+    }
+    return n;
+}
+
+rate_limit_stats
+rate_limiter::stats() const
+{
+    return rate_limit_stats {
+        .admitted = admitted_.load(std::memory_order_relaxed),
+        .rejected = rejected_.load(std::memory_order_relaxed),
+        .evicted  = evicted_.load(std::memory_order_relaxed)
+    };
+}
+
+}   // namespace blog
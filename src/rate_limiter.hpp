@@ -0,0 +1,122 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_RATE_LIMITER_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_RATE_LIMITER_HPP
+
+#include "config.hpp"
+
+#include <boost/describe.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace blog
+{
+
+struct rate_limit_options
+{
+    /// Sustained connections per second allowed from one address. Zero
+    /// disables rate limiting.
+    double rate = 0;
+
+    /// Connections an address may make in a burst, after being quiet
+    double burst = 20;
+
+    /// Addresses remembered at once. When the table is full, the address
+    /// heard from least recently is forgotten.
+    std::size_t max_clients = 64 * 1024;
+
+    /// Independently locked parts of the table
+    std::size_t shards = 16;
+};
+
+struct rate_limit_stats
+{
+    std::uint64_t admitted = 0;
+    std::uint64_t rejected = 0;
+    std::uint64_t evicted  = 0;
+};
+
+BOOST_DESCRIBE_STRUCT(rate_limit_stats, (), (admitted, rejected, evicted))
+
+/// A token bucket per source address, consulted as each connection is
+/// accepted.
+///
+/// The table is split into shards by hash of the address, each with its own
+/// lock and its own LRU list, so threads accepting on different sockets
+/// rarely contend. Each shard holds at most max_clients / shards addresses.
+/// An evicted address starts again with a full bucket, which is what an
+/// address idle long enough to reach the tail would have anyway.
+struct rate_limiter
+{
+    using clock = std::chrono::steady_clock;
+
+    explicit rate_limiter(rate_limit_options options = {});
+
+    bool
+    enabled() const
+    {
+        return options_.rate > 0;
+    }
+
+    /// Take a token from addr's bucket. Returns false if the bucket is empty,
+    /// in which case the connection should be refused.
+    bool
+    admit(ip::address const &addr, clock::time_point now = clock::now());
+
+    /// The number of addresses being tracked
+    std::size_t
+    size() const;
+
+    rate_limit_stats
+    stats() const;
+
+  private:
+    using key_type = std::array< unsigned char, 16 >;
+
+    struct key_hash
+    {
+        std::size_t
+        operator()(key_type const &key) const;
+    };
+
+    struct bucket
+    {
+        double                          tokens;
+        clock::time_point               updated;
+        std::list< key_type >::iterator lru;
+    };
+
+    struct shard
+    {
+        mutable std::mutex                               mutex;
+        std::unordered_map< key_type, bucket, key_hash > buckets;
+        std::list< key_type >                            lru;   // newest first
+    };
+
+    rate_limit_options                      options_;
+    std::size_t                             shard_capacity_;
+    std::vector< std::unique_ptr< shard > > shards_;
+    std::atomic< std::uint64_t >            admitted_ { 0 };
+    std::atomic< std::uint64_t >            rejected_ { 0 };
+    std::atomic< std::uint64_t >            evicted_ { 0 };
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_RATE_LIMITER_HPP
@@ -0,0 +1,75 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_RELAY_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_RELAY_HPP
+
+#include "config.hpp"
+#include "websock_connection.hpp"
+
+#include <boost/asio/experimental/awaitable_operators.hpp>
+
+#include <cstddef>
+
+namespace blog
+{
+
+/// Copy messages from one websocket to another until from is closed, then
+/// pass its close reason on to to.
+///
+/// Data is relayed frame by frame as it arrives rather than message by
+/// message, so a large message neither waits to be received in full nor
+/// needs a buffer of its own size. Each chunk is written to `to` straight from
+/// the buffer it was read into.
+template < class FromStream, class ToStream >
+asio::awaitable< void >
+relay_frames(FromStream &from, ToStream &to, std::size_t chunk = 64 * 1024)
+{
+    using asio::redirect_error;
+    using asio::use_awaitable;
+
+    auto buf = beast::flat_buffer();
+    try
+    {
+        for (;;)
+        {
+            auto n = co_await from.async_read_some(buf, chunk, use_awaitable);
+            to.text(from.got_text());
+            co_await to.async_write_some(
+                from.is_message_done(), buf.cdata(), use_awaitable);
+            buf.consume(n);
+        }
+    }
+    catch (system_error &e)
+    {
+        if (e.code() != beast::websocket::error::closed)
+            throw;
+    }
+
+    auto ec = error_code();
+    co_await to.async_close(from.reason(), redirect_error(use_awaitable, ec));
+}
+
+/// Join a websocket client to an upstream connection, relaying in both
+/// directions until either side closes.
+template < class ClientStream >
+asio::awaitable< void >
+run_proxy(ClientStream &client, websock_connection &upstream)
+{
+    using namespace asio::experimental::awaitable_operators;
+
+    co_await visit(
+        [&](auto &ws)
+        { return relay_frames(client, ws) || relay_frames(ws, client); },
+        upstream.var_);
+}
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_RELAY_HPP
@@ -0,0 +1,77 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "request_pool.hpp"
+
+#include <tuple>
+#include <vector>
+
+namespace blog
+{
+
+namespace
+{
+// The spare slots of the calling thread. Reserved up front so that
+// releasing a slot never allocates.
+std::vector< std::unique_ptr< request_slot > > &
+spares()
+{
+    thread_local auto list = []
+    {
+        auto v = std::vector< std::unique_ptr< request_slot > >();
+        v.reserve(max_pooled_requests);
+        return v;
+    }();
+    return list;
+}
+}   // namespace
+
+request_slot::request_slot()
+: arena_resource_(arena_.data(), arena_.size())
+{
+    reset();
+}
+
+void
+request_slot::reset()
+{
+    parser_.reset();
+    arena_resource_.release();
+    buffer.clear();
+    parser_.emplace(std::piecewise_construct,
+                    std::make_tuple(),
+                    std::make_tuple(allocator_type(&arena_resource_)));
+    parser_->header_limit(header_limit);
+    parser_->body_limit(0);
+}
+
+void
+request_slot_release::operator()(request_slot *slot) const noexcept
+{
+    auto &list = spares();
+    if (list.size() < max_pooled_requests)
+        list.emplace_back(slot);
+    else
+        delete slot;
+}
+
+pooled_request
+acquire_request()
+{
+    auto &list = spares();
+    if (list.empty())
+        return pooled_request(new request_slot());
+
+    auto slot = pooled_request(list.back().release());
+    list.pop_back();
+    slot->reset();
+    return slot;
+}
+
+}   // namespace blog
@@ -0,0 +1,100 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_REQUEST_POOL_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_REQUEST_POOL_HPP
+
+#include "config.hpp"
+
+#include <boost/beast/http.hpp>
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+namespace blog
+{
+
+/// Everything needed to read the header of one HTTP request without touching
+/// the heap: a fixed read buffer, an arena for the parsed fields, and a
+/// parser, which is made afresh in place for each request since a beast
+/// parser can only be used once.
+///
+/// The parser refuses a header longer than header_limit and any body at
+/// all, which is right for both a websocket upgrade and the requests the
+/// plain http listener redirects. A header whose fields need more than
+/// arena_bytes spills to the heap rather than failing, since beast lets an
+/// allocation failure escape the read. No ordinary request comes near that.
+struct request_slot
+{
+    static constexpr std::size_t header_limit = 8 * 1024;
+    static constexpr std::size_t arena_bytes  = 4 * 1024;
+
+    using allocator_type = std::pmr::polymorphic_allocator< char >;
+    using parser_type =
+        beast::http::request_parser< beast::http::empty_body, allocator_type >;
+
+    request_slot();
+
+    request_slot(request_slot const &) = delete;
+
+    request_slot &
+    operator=(request_slot const &) = delete;
+
+    /// Forget the last request, and make a new parser for the next
+    void
+    reset();
+
+    parser_type &
+    parser()
+    {
+        return *parser_;
+    }
+
+    /// What the parser has read so far
+    beast::http::request< beast::http::empty_body,
+                          beast::http::basic_fields< allocator_type > > &
+    request()
+    {
+        return parser_->get();
+    }
+
+    /// The read buffer. It holds a whole header, so a request that does not
+    /// fit is refused by the read whether or not the parser counted it.
+    beast::flat_static_buffer< header_limit > buffer;
+
+  private:
+    alignas(std::max_align_t) std::array< std::byte, arena_bytes > arena_;
+    std::pmr::monotonic_buffer_resource arena_resource_;
+    std::optional< parser_type >        parser_;
+};
+
+/// Returns a request_slot to the pool of the thread that releases it
+struct request_slot_release
+{
+    void
+    operator()(request_slot *slot) const noexcept;
+};
+
+/// A request_slot on loan from a thread's pool
+using pooled_request = std::unique_ptr< request_slot, request_slot_release >;
+
+constexpr std::size_t max_pooled_requests = 64;
+
+/// A request_slot ready for a new request, from the calling thread's pool if
+/// it has one to spare. Each thread keeps up to max_pooled_requests spare,
+/// and frees any more that are released to it.
+pooled_request
+acquire_request();
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_REQUEST_POOL_HPP
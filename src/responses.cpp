@@ -0,0 +1,50 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "responses.hpp"
+
+#include <fmt/format.h>
+
+#include <sstream>
+
+namespace blog
+{
+
+string_response
+make_redirect(std::string const &loc)
+{
+    auto response = string_response();
+    response.result(beast::http::status::moved_permanently);
+    response.set(beast::http::field::location, loc);
+    response.keep_alive(false);
+    response.body() = fmt::format("please redirect to {}\r\n", loc);
+    response.prepare_payload();
+    return response;
+}
+
+string_response
+make_error(beast::http::status stat, std::string message)
+{
+    auto response = string_response();
+    response.result(stat);
+    response.keep_alive(false);
+    response.body() = std::move(message);
+    response.prepare_payload();
+    return response;
+}
+
+std::string
+to_wire(string_response const &response)
+{
+    auto os = std::ostringstream();
+    os << response;
+    return std::move(os).str();
+}
+
+}   // namespace blog
@@ -0,0 +1,40 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_RESPONSES_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_RESPONSES_HPP
+
+#include "config.hpp"
+
+#include <boost/beast/http.hpp>
+
+#include <string>
+
+namespace blog
+{
+
+using string_response = beast::http::response< beast::http::string_body >;
+
+/// A 301 response pointing at loc, after which the connection is closed
+string_response
+make_redirect(std::string const &loc);
+
+/// A response with status stat and message as its body, after which the
+/// connection is closed
+string_response
+make_error(beast::http::status stat, std::string message);
+
+/// The bytes of response as written to the wire, for a response that is sent
+/// often enough to be worth serialising once
+std::string
+to_wire(string_response const &response);
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_RESPONSES_HPP
@@ -0,0 +1,383 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "route_table.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+namespace blog
+{
+namespace
+{
+char
+lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+}
+
+bool
+is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+std::string_view
+trim(std::string_view s)
+{
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+        s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' ||
+                          s.back() == '\r'))
+        s.remove_suffix(1);
+    return s;
+}
+
+// split off the first whitespace delimited word of s
+std::string_view
+next_word(std::string_view &s)
+{
+    s         = trim(s);
+    auto end  = std::min(s.find(' '), s.find('\t'));
+    auto word = s.substr(0, end);
+    s.remove_prefix(word.size());
+    s = trim(s);
+    return word;
+}
+
+[[noreturn]] void
+invalid(std::string message)
+{
+    throw std::invalid_argument(std::move(message));
+}
+}   // namespace
+
+route_template
+route_template::compile(std::string_view text)
+{
+    static constexpr std::pair< std::string_view, part > names[] = {
+        { "{tls_root}", part::tls_root }, { "{tcp_root}", part::tcp_root },
+        { "{target}", part::target },     { "{n}", part::n },
+        { "{n-1}", part::n_minus_1 },     { "{rest}", part::rest },
+        { "{backend}", part::backend },
+    };
+
+    auto result  = route_template();
+    auto literal = std::string();
+    while (!text.empty())
+    {
+        auto it = std::find_if(std::begin(names),
+                               std::end(names),
+                               [&](auto &entry)
+                               { return text.starts_with(entry.first); });
+        if (it == std::end(names))
+        {
+            if (text.front() == '{')
+                invalid(fmt::format("unknown placeholder in: {}", text));
+            literal += text.front();
+            text.remove_prefix(1);
+            continue;
+        }
+
+        if (!literal.empty())
+            result.parts.emplace_back(part::literal, std::move(literal));
+        literal.clear();
+        result.parts.emplace_back(it->second, std::string());
+        text.remove_prefix(it->first.size());
+    }
+    if (!literal.empty())
+        result.parts.emplace_back(part::literal, std::move(literal));
+    return result;
+}
+
+std::string
+expand(route_template const &tmpl,
+       route_match const    &match,
+       route_vars const     &vars)
+{
+    using part = route_template::part;
+
+    auto result = std::string();
+    auto out    = std::back_inserter(result);
+    for (auto &[kind, literal] : tmpl.parts)
+    {
+        switch (kind)
+        {
+        case part::literal:
+            result += literal;
+            break;
+        case part::tls_root:
+            result += vars.tls_root;
+            break;
+        case part::tcp_root:
+            result += vars.tcp_root;
+            break;
+        case part::target:
+            result += vars.target;
+            break;
+        case part::n:
+            fmt::format_to(out, "{}", match.n);
+            break;
+        case part::n_minus_1:
+            fmt::format_to(out, "{}", match.n ? match.n - 1 : 0);
+            break;
+        case part::rest:
+            result += match.rest;
+            break;
+        case part::backend:
+            result += vars.backend;
+            break;
+        }
+    }
+    return result;
+}
+
+route_table::route_table()
+: nodes_(1)
+{
+}
+
+std::uint32_t
+route_table::literal_child(std::uint32_t index, char c)
+{
+    auto &lits = nodes_[index].literals;
+    auto  it   = std::lower_bound(lits.begin(),
+                               lits.end(),
+                               c,
+                               [](auto &entry, char c)
+                               { return entry.first < c; });
+    if (it != lits.end() && it->first == c)
+        return it->second;
+
+    auto child = static_cast< std::uint32_t >(nodes_.size());
+    lits.emplace(it, c, child);
+    nodes_.emplace_back();
+    return child;
+}
+
+void
+route_table::add(std::string_view pattern, route r)
+{
+    auto index  = std::uint32_t(0);
+    auto params = 0;
+    auto slot   = &node::exact;
+
+    while (!pattern.empty())
+    {
+        if (pattern.starts_with("{n}"))
+        {
+            if (++params > 1)
+                invalid("only one {n} is allowed per route");
+            if (nodes_[index].digits == none)
+            {
+                nodes_[index].digits =
+                    static_cast< std::uint32_t >(nodes_.size());
+                nodes_.emplace_back();
+            }
+            index = nodes_[index].digits;
+            pattern.remove_prefix(3);
+        }
+        else if (pattern == "{rest}")
+        {
+            slot = &node::rest;
+            break;
+        }
+        else if (pattern == "{any}")
+        {
+            slot = &node::any;
+            break;
+        }
+        else if (pattern.front() == '{')
+        {
+            invalid(
+                fmt::format("invalid placeholder in pattern: {}", pattern));
+        }
+        else
+        {
+            index = literal_child(index, lower(pattern.front()));
+            pattern.remove_prefix(1);
+        }
+    }
+
+    auto &target = nodes_[index].*slot;
+    if (target != none)
+        invalid("duplicate route");
+    target = static_cast< std::uint32_t >(routes_.size());
+    routes_.push_back(std::move(r));
+}
+
+route_match
+route_table::match(std::string_view target) const
+{
+    auto result = route_match();
+    if (!match_from(0, target, 0, result))
+        result = route_match();
+    return result;
+}
+
+bool
+route_table::match_from(std::uint32_t    index,
+                        std::string_view target,
+                        std::size_t      pos,
+                        route_match     &result) const
+{
+    auto &n = nodes_[index];
+
+    if (pos == target.size())
+    {
+        if (n.exact != none)
+        {
+            result.which = &routes_[n.exact];
+            result.rest  = std::string_view();
+            return true;
+        }
+    }
+    else
+    {
+        auto c  = lower(target[pos]);
+        auto it = std::lower_bound(n.literals.begin(),
+                                   n.literals.end(),
+                                   c,
+                                   [](auto &entry, char c)
+                                   { return entry.first < c; });
+        if (it != n.literals.end() && it->first == c &&
+            match_from(it->second, target, pos + 1, result))
+            return true;
+
+        if (n.digits != none && is_digit(target[pos]))
+        {
+            auto value = std::uint64_t(0);
+            auto end   = pos;
+            for (; end < target.size() && is_digit(target[end]); ++end)
+                value = std::min(value * 10 + (target[end] - '0'),
+                                 std::uint64_t(1) << 60);
+            auto saved = result.n;
+            result.n   = value;
+            if (match_from(n.digits, target, end, result))
+                return true;
+            result.n = saved;
+        }
+    }
+
+    auto tail = target.substr(pos);
+    if (n.rest != none && (tail.empty() || tail.front() == '/'))
+    {
+        result.which = &routes_[n.rest];
+        result.rest  = tail;
+        return true;
+    }
+
+    if (n.any != none)
+    {
+        result.which = &routes_[n.any];
+        result.rest  = tail;
+        return true;
+    }
+
+    return false;
+}
+
+route_config
+parse_routes(std::string_view text)
+{
+    auto result = route_config();
+    auto lineno = std::size_t(0);
+
+    while (!text.empty())
+    {
+        auto eol  = text.find('\n');
+        auto line = trim(text.substr(0, eol));
+        text.remove_prefix(eol == text.npos ? text.size() : eol + 1);
+        ++lineno;
+
+        if (line.empty() || line.front() == '#')
+            continue;
+
+        try
+        {
+            auto listener = next_word(line);
+            auto pattern  = next_word(line);
+            auto action   = next_word(line);
+
+            route_table *table = nullptr;
+            if (listener == "http")
+                table = &result.http;
+            else if (listener == "https")
+                table = &result.https;
+            else
+                invalid("listener must be http or https");
+
+            auto r = route();
+            if (action == "redirect")
+            {
+                r.action = route_action::redirect;
+                r.text   = route_template::compile(line);
+            }
+            else if (action == "upgrade")
+            {
+                if (table != &result.https)
+                    invalid("upgrade is only available on https");
+                r.action    = route_action::upgrade;
+                r.behaviour = std::string(next_word(line));
+                if (r.behaviour == "proxy" && line.empty())
+                    invalid("proxy requires a backend url");
+                r.text = route_template::compile(line);
+            }
+            else if (action == "reply")
+            {
+                r.action  = route_action::reply;
+                auto word = next_word(line);
+                auto code = 0u;
+                auto last = word.data() + word.size();
+                auto [p, ec] = std::from_chars(word.data(), last, code);
+                if (ec != std::errc() || p != last)
+                    invalid("reply requires a status code");
+                r.status = beast::http::int_to_status(code);
+                if (r.status == beast::http::status::unknown)
+                    invalid("unrecognised status code");
+                r.text =
+                    route_template::compile(fmt::format("{}\r\n", line));
+            }
+            else
+            {
+                invalid("action must be redirect, upgrade or reply");
+            }
+
+            table->add(pattern, std::move(r));
+        }
+        catch (std::invalid_argument &e)
+        {
+            throw std::runtime_error(
+                fmt::format("routes line {}: {}", lineno, e.what()));
+        }
+    }
+
+    return result;
+}
+
+route_config
+load_routes(std::string const &path)
+{
+    auto ifs = std::ifstream(path);
+    if (!ifs)
+        throw system_error(error_code(errno, boost::system::generic_category()),
+                           path);
+    auto ss = std::stringstream();
+    ss << ifs.rdbuf();
+    return parse_routes(ss.str());
+}
+
+}   // namespace blog
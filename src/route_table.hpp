@@ -0,0 +1,183 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_ROUTE_TABLE_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_ROUTE_TABLE_HPP
+
+#include "config.hpp"
+
+#include <boost/beast/http/status.hpp>
+#include <boost/describe.hpp>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace blog
+{
+
+enum class route_action
+{
+    redirect,
+    upgrade,
+    reply
+};
+
+BOOST_DESCRIBE_ENUM(route_action, redirect, upgrade, reply)
+
+/// Text containing placeholders such as {tls_root} or {n-1}, split into parts
+/// once at load time so that expanding it never has to re-parse.
+struct route_template
+{
+    enum class part
+    {
+        literal,
+        tls_root,
+        tcp_root,
+        target,
+        n,
+        n_minus_1,
+        rest,
+        backend
+    };
+
+    static route_template
+    compile(std::string_view text);
+
+    bool
+    refers_to(part p) const
+    {
+        for (auto &entry : parts)
+            if (entry.first == p)
+                return true;
+        return false;
+    }
+
+    std::vector< std::pair< part, std::string > > parts;
+};
+
+struct route
+{
+    route_action        action;
+    beast::http::status status = beast::http::status::ok;
+    std::string         behaviour;   // for upgrade, e.g. "echo"
+    route_template      text;        // location for redirect, body for reply,
+                                     // backend url for upgrade to proxy
+};
+
+/// The result of matching a target against a route_table. Refers into both the
+/// table and the target, so must not outlive either.
+struct route_match
+{
+    route const     *which = nullptr;
+    std::uint64_t    n     = 0;
+    std::string_view rest;
+
+    explicit
+    operator bool() const
+    {
+        return which != nullptr;
+    }
+};
+
+/// Values that a route_template may refer to in addition to those captured
+/// by the match itself.
+struct route_vars
+{
+    std::string_view tls_root;
+    std::string_view tcp_root;
+    std::string_view target;
+    std::string_view backend;   // the least loaded backend's root, if needed
+};
+
+std::string
+expand(route_template const &tmpl,
+       route_match const    &match,
+       route_vars const     &vars);
+
+/// A set of routes compiled into a character trie.
+///
+/// Patterns are literal text (matched case-insensitively) which may contain
+/// one {n} placeholder matching a run of decimal digits, and may end with
+/// either {rest}, which matches nothing or anything starting with '/', or
+/// {any}, which matches anything at all.
+///
+/// Matching walks the trie once per character of the target and never
+/// allocates. Literal edges are preferred over {n}, which is preferred over
+/// the tails, so "/websocket-0" beats "/websocket-{n}". The matcher only
+/// backtracks at nodes where a more specific edge fails, which keeps the cost
+/// linear in the length of the target for any realistic table.
+struct route_table
+{
+    route_table();
+
+    void
+    add(std::string_view pattern, route r);
+
+    route_match
+    match(std::string_view target) const;
+
+    std::size_t
+    size() const
+    {
+        return routes_.size();
+    }
+
+  private:
+    static constexpr std::uint32_t none = ~std::uint32_t(0);
+
+    struct node
+    {
+        std::vector< std::pair< char, std::uint32_t > > literals;   // sorted
+        std::uint32_t                                   digits   = none;
+        std::uint32_t                                   exact    = none;
+        std::uint32_t                                   rest     = none;
+        std::uint32_t                                   any      = none;
+    };
+
+    bool
+    match_from(std::uint32_t    index,
+               std::string_view target,
+               std::size_t      pos,
+               route_match     &result) const;
+
+    std::uint32_t
+    literal_child(std::uint32_t index, char c);
+
+    std::vector< node >  nodes_;
+    std::vector< route > routes_;
+};
+
+/// The routes for each of the server's listeners
+struct route_config
+{
+    route_table http;
+    route_table https;
+};
+
+/// Parse route configuration text. Each non-blank line that does not start
+/// with '#' has the form:
+///
+///     <listener> <pattern> redirect <location template>
+///     <listener> <pattern> upgrade  <behaviour>
+///     <listener> <pattern> reply    <status> <body template>
+///
+/// where listener is http or https.
+route_config
+parse_routes(std::string_view text);
+
+/// Load route configuration from a file. See parse_routes.
+route_config
+load_routes(std::string const &path);
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_ROUTE_TABLE_HPP
@@ -8,10 +8,24 @@
 //
 #include "server.hpp"
 
+#include "h2_websocket.hpp"
+#include "offload.hpp"
+#include "relay.hpp"
+#include "request_pool.hpp"
+#include "responses.hpp"
+#include "url.hpp"
+
 #include <boost/asio/experimental/awaitable_operators.hpp>
 #include <fmt/format.h>
 
-#include <regex>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <type_traits>
+
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace blog
 {
@@ -23,15 +37,73 @@ as_text(tcp::endpoint ep)
 {
     return fmt::format("{}:{}", ep.address().to_string(), ep.port());
 }
+
+// bind a new acceptor, or adopt the one handed over by a previous server
+tcp::acceptor
+open_acceptor(asio::any_io_executor exec,
+              tcp::endpoint         ep,
+              int                   inherited,
+              socket_profile const &profile)
+{
+    auto acceptor = tcp::acceptor(exec);
+    if (inherited < 0)
+        listen_with(acceptor, ep, profile);
+    else
+    {
+        acceptor.assign(ep.protocol(), inherited);
+        tune_listener(acceptor, profile);
+    }
+    return acceptor;
+}
+
+// bind a listener to a unix domain socket at path, replacing a socket left
+// there by an earlier server, or leave it closed if there is no path. Any
+// other kind of file at path is an error rather than something to delete.
+local_stream::acceptor
+open_local_acceptor(asio::any_io_executor exec, std::string const &path)
+{
+    auto acceptor = local_stream::acceptor(exec);
+    if (!path.empty())
+    {
+        struct ::stat st;
+        if (::lstat(path.c_str(), &st) == 0)
+        {
+            if (!S_ISSOCK(st.st_mode))
+                throw system_error(
+                    error_code(EEXIST, asio::error::get_system_category()),
+                    path + " exists and is not a socket");
+            ::unlink(path.c_str());
+        }
+        auto ep = local_stream::endpoint(path);
+        acceptor.open(ep.protocol());
+        acceptor.bind(ep);
+        acceptor.listen();
+    }
+    return acceptor;
+}
 }   // namespace
 
-server::server(asio::any_io_executor exec)
+server::server(asio::any_io_executor exec, server_options options)
 : exec_(exec)
 , sslctx_(ssl::context_base::sslv23)
-, tcp_acceptor_(exec_, tcp::endpoint(ip::address_v4::loopback(), 0))
-, tls_acceptor_(exec_, tcp::endpoint(ip::address_v4::loopback(), 0))
+, handoff_peer_(exec_)
+, inherited_(take_over_listeners(exec_, options.handoff_path, handoff_peer_))
+, tcp_acceptor_(open_acceptor(
+      exec_, options.tcp_endpoint, inherited_.tcp, options.socket))
+, tls_acceptor_(open_acceptor(
+      exec_, options.tls_endpoint, inherited_.tls, options.socket))
+, local_acceptor_(open_local_acceptor(exec_, options.local_path))
 , tcp_root_(fmt::format("ws://{}", as_text(tcp_acceptor_.local_endpoint())))
 , tls_root_(fmt::format("wss://{}", as_text(tls_acceptor_.local_endpoint())))
+, local_root_(options.local_path.empty()
+                  ? std::string()
+                  : blog::local_root(options.local_path, options.local_tls))
+, routes_(load_routes(options.route_file))
+, options_(std::move(options))
+, timers_(exec_)
+, limiter_(options_.rate_limit)
+, upstreams_(exec_, options_.upstream_spares)
+, workers_(options_.worker_threads)
 {
     sslctx_.set_options(boost::asio::ssl::context::default_workarounds |
                         boost::asio::ssl::context::no_sslv2 |
@@ -42,12 +114,102 @@ server::server(asio::any_io_executor exec)
     sslctx_.use_certificate_chain_file("server.pem");
     sslctx_.use_private_key_file("server.pem", boost::asio::ssl::context::pem);
     sslctx_.use_tmp_dh_file("dh4096.pem");
+    if (options_.release_ssl_buffers)
+        SSL_CTX_set_mode(sslctx_.native_handle(), SSL_MODE_RELEASE_BUFFERS);
+    if (options_.http2)
+        select_h2(sslctx_);
+
+    auto busy = make_error(beast::http::status::too_many_requests,
+                           "too many connections, try again later\r\n");
+    if (limiter_.enabled())
+        busy.set(beast::http::field::retry_after,
+                 std::to_string(int(std::ceil(1 / options_.rate_limit.rate))));
+    too_many_requests_ = to_wire(busy);
+
+    if (!options_.record_file.empty())
+        recorder_ = std::make_unique< session_recorder >(options_.record_file);
+
+    if (options_.handshake_threads)
+        handshake_pool_ =
+            std::make_unique< asio::thread_pool >(options_.handshake_threads);
+
+    if (!options_.load_table.empty())
+    {
+        load_table_ = std::make_unique< load_table >(options_.load_table);
+        if (options_.report_load)
+            load_lease_ = load_table_->register_backend(tls_root_,
+                                                        options_.load_stale);
+    }
+
+    add_handler("echo", std::make_shared< echo_handler >());
+}
+
+server::~server()
+{
+    if (load_lease_)
+        load_table_->release(load_lease_);
+}
+
+std::string
+server::choose_backend()
+{
+    if (load_table_)
+        if (auto root =
+                load_table_->choose(options_.backends, options_.load_stale);
+            !root.empty())
+            return root;
+    return tls_root_;
+}
+
+void
+server::record_handshake(std::chrono::microseconds t)
+{
+    if (load_lease_)
+        load_table_->record_handshake(load_lease_, t);
+}
+
+void
+server::publish_load(bool arrived)
+{
+    if (!load_lease_)
+        return;
+    if (arrived)
+        load_table_->arrived(load_lease_);
+    load_table_->set_active(load_lease_, std::uint32_t(load_sessions_));
+}
+
+void
+server::add_handler(std::string                        name,
+                    std::shared_ptr< message_handler > handler)
+{
+    auto &slot = handlers_[std::move(name)];
+    if (slot)
+        slot->handler = std::move(handler);
+    else
+        slot = std::make_unique< registered_handler >(std::move(handler));
+}
+
+registered_handler *
+server::find_handler(std::string const &name)
+{
+    auto i = handlers_.find(name);
+    return i == handlers_.end() ? nullptr : i->second.get();
+}
+
+std::map< std::string, handler_stats >
+server::handler_report() const
+{
+    auto report = std::map< std::string, handler_stats >();
+    for (auto &[name, h] : handlers_)
+        report[name] = h->stats();
+    return report;
 }
 
 namespace
 {
+template < class Socket >
 asio::awaitable< void >
-send_and_die(ssl::stream< tcp::socket >                              &stream,
+send_and_die(ssl::stream< Socket >                                   &stream,
              beast::http::response< beast::http::string_body > const &response)
 {
     using asio::redirect_error;
@@ -64,8 +226,9 @@ send_and_die(ssl::stream< tcp::socket >                              &stream,
     sock.close();
 }
 
+template < class Socket >
 asio::awaitable< void >
-send_and_die(tcp::socket                                             &sock,
+send_and_die(Socket                                                  &sock,
              beast::http::response< beast::http::string_body > const &response)
 {
     using asio::redirect_error;
@@ -79,73 +242,176 @@ send_and_die(tcp::socket                                             &sock,
     sock.close();
 }
 
+// where the response to a request on a stream of an HTTP/2 connection goes
+struct h2_reply
+{
+    h2_session &session;
+    h2_stream  &stream;
+};
+
+// On a shared connection only the stream dies. HTTP/2 has no reason phrase
+// or connection fields, and wants its field names in lower case.
+asio::awaitable< void >
+send_and_die(h2_reply                                                &reply,
+             beast::http::response< beast::http::string_body > const &response)
+{
+    auto headers = header_list();
+    headers.push_back({ ":status", std::to_string(response.result_int()) });
+    for (auto const &f : response)
+    {
+        if (f.name() == beast::http::field::connection)
+            continue;
+        auto name = std::string(f.name_string());
+        std::transform(name.begin(),
+                       name.end(),
+                       name.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        headers.push_back({ std::move(name), std::string(f.value()) });
+    }
+    reply.session.respond(reply.stream, headers, response.body());
+    co_return;
+}
+
 template < class Stream >
 asio::awaitable< void >
 send_redirect(Stream &stream, std::string loc)
 {
-    using asio::redirect_error;
-    using asio::use_awaitable;
-    using asio::experimental::deferred;
-
-    auto response = beast::http::response< beast::http::string_body >();
-    response.result(beast::http::status::moved_permanently);
-    response.set(beast::http::field::location, loc);
-    response.keep_alive(false);
-    response.body() = fmt::format("please redirect to {}\r\n", loc);
-    response.prepare_payload();
-
+    auto response = make_redirect(loc);
     co_await send_and_die(stream, response);
 }
 
 template < class Stream >
 asio::awaitable< void >
 send_error(Stream &stream, beast::http::status stat, std::string message)
+{
+    auto response = make_error(stat, std::move(message));
+    co_await send_and_die(stream, response);
+}
+
+// check the peer of a newly accepted socket against the rate limiter
+bool
+admit(server &svr, tcp::socket &sock)
+{
+    if (!svr.limiter().enabled())
+        return true;
+
+    auto ec = error_code();
+    auto ep = sock.remote_endpoint(ec);
+    return !ec && svr.limiter().admit(ep.address());
+}
+
+asio::awaitable< void >
+send_cached(tcp::socket sock, std::string const &wire)
 {
     using asio::redirect_error;
     using asio::use_awaitable;
-    using asio::experimental::deferred;
 
-    auto response = beast::http::response< beast::http::string_body >();
-    response.result(stat);
-    response.keep_alive(false);
-    response.body() = std::move(message);
-    response.prepare_payload();
-    co_await send_and_die(stream, response);
+    auto ec = error_code();
+    co_await asio::async_write(
+        sock, asio::buffer(wire), redirect_error(use_awaitable, ec));
+    sock.shutdown(asio::socket_base::shutdown_both, ec);
+    sock.close(ec);
 }
 
-asio::awaitable< void >
-serve_http(tcp::socket sock, std::string https_endpoint)
+template < class Fields >
+std::string_view
+target_of(beast::http::request_header< Fields > const &request)
 {
-    using asio::experimental::deferred;
+    return std::string_view(request.target().data(), request.target().size());
+}
+
+// Follow the https routes from target for as long as they redirect back to
+// root, the listener the client came in on, so that the client is upgraded in
+// one round trip rather than being sent round the chain. Leaves target as the
+// last one reached and returns its match. A redirect elsewhere, or a chain
+// longer than the limit, is left for the client to follow.
+route_match
+follow_internal_redirects(server            &svr,
+                          std::string       &target,
+                          std::string const &root)
+{
+    auto match = svr.routes().https.match(target);
+    for (std::size_t hops = 0; hops < svr.options().max_internal_redirects;
+         ++hops)
+    {
+        if (!match || match.which->action != route_action::redirect)
+            break;
 
-    auto rxbuf  = beast::flat_buffer();
-    auto parser = beast::http::request_parser< beast::http::empty_body >();
-    co_await beast::http::async_read(sock, rxbuf, parser, deferred);
+        auto vars = route_vars { .tls_root = root,
+                                 .tcp_root = svr.tcp_root(),
+                                 .target   = target };
+        auto loc  = expand(match.which->text, match, vars);
+        if (!loc.starts_with(root) ||
+            (loc.size() > root.size() && loc[root.size()] != '/'))
+            break;
 
-    static const auto re      = std::regex("(/websocket-\\d+)(/.*)?",
-                                      std::regex_constants::icase |
-                                          std::regex_constants::optimize);
-    auto              match   = std::cmatch();
-    auto             &request = parser.get();
-    if (std::regex_match(
-            request.target().begin(), request.target().end(), match, re))
+        target = loc.size() > root.size() ? loc.substr(root.size()) : "/";
+        match  = svr.routes().https.match(target);
+    }
+    return match;
+}
+
+// respond to a request that is not being upgraded, according to its route
+template < class Stream >
+asio::awaitable< void >
+send_routed(Stream            &stream,
+            server            &svr,
+            route_match const &match,
+            route_vars         vars)
+{
+    if (!match)
     {
-        co_await send_redirect(
-            sock, fmt::format("{}{}", https_endpoint, match[0].str()));
+        co_await send_error(
+            stream,
+            beast::http::status::not_found,
+            fmt::format("resource {} is not recognised\r\n", vars.target));
+    }
+    else if (match.which->action == route_action::redirect)
+    {
+        // choose only when the location needs it, since choosing counts a
+        // connection as pending at the backend chosen
+        auto backend = std::string();
+        if (match.which->text.refers_to(route_template::part::backend))
+        {
+            backend      = svr.choose_backend();
+            vars.backend = backend;
+        }
+        co_await send_redirect(stream, expand(match.which->text, match, vars));
+    }
+    else if (match.which->action == route_action::reply)
+    {
+        co_await send_error(stream,
+                            match.which->status,
+                            expand(match.which->text, match, vars));
     }
     else
     {
         co_await send_error(
-            sock,
-            beast::http::status::not_found,
-            fmt::format("resource {} is not recognised\r\n",
-                        std::string_view(request.target().data(),
-                                         request.target().size())));
+            stream,
+            beast::http::status::not_acceptable,
+            "This resource only accepts websocket requests\r\n");
     }
 }
 
 asio::awaitable< void >
-http_server(tcp::acceptor &acceptor, std::string https_endpoint)
+serve_http(tcp::socket sock, server &svr)
+{
+    using asio::experimental::deferred;
+
+    auto active = server::session_scope(svr);
+    auto slot   = acquire_request();
+    co_await beast::http::async_read(
+        sock, slot->buffer, slot->parser(), deferred);
+
+    auto target = target_of(slot->request());
+    auto vars   = route_vars { .tls_root = svr.tls_root(),
+                               .tcp_root = svr.tcp_root(),
+                               .target   = target };
+    co_await send_routed(sock, svr, svr.routes().http.match(target), vars);
+}
+
+asio::awaitable< void >
+http_server(tcp::acceptor &acceptor, server &svr)
 {
     using asio::detached;
     using asio::experimental::deferred;
@@ -157,8 +423,15 @@ http_server(tcp::acceptor &acceptor, std::string https_endpoint)
         {
             tcp::socket sock(exec);
             co_await acceptor.async_accept(sock, deferred);
-            co_spawn(
-                exec, serve_http(std::move(sock), https_endpoint), detached);
+            if (!admit(svr, sock))
+            {
+                co_spawn(exec,
+                         send_cached(std::move(sock), svr.too_many_requests()),
+                         detached);
+                continue;
+            }
+            tune_connected(sock, svr.options().socket);
+            co_spawn(exec, serve_http(std::move(sock), svr), detached);
         }
     }
     catch (system_error &se)
@@ -171,81 +444,463 @@ http_server(tcp::acceptor &acceptor, std::string https_endpoint)
     }
 }
 
+// settings common to every websocket the server accepts, whether it has a
+// connection of its own or is a stream of an HTTP/2 one
+template < class WebSocketStream >
+void
+configure(WebSocketStream &wss, server_options const &options)
+{
+    wss.read_message_max(options.max_message_size);
+}
+
+template < class WebSocketStream >
 asio::awaitable< void >
-run_echo_server(beast::websocket::stream< ssl::stream< tcp::socket > > &wss,
-                beast::flat_buffer                                     &rxbuf)
+run_handler_session(WebSocketStream    &wss,
+                    server             &svr,
+                    registered_handler &h)
 {
     using asio::experimental::deferred;
 
+    auto memory = connection_memory(svr.memory_accounts(), sizeof(wss));
+    auto limit  = svr.options().idle_buffer_limit;
+    auto tap    = session_tap(svr.recorder());
+    auto worker = svr.workers().assign();
+    auto m      = ws_message();
+    auto alive =
+        keepalive(svr.timers(), svr.options().keepalive, svr.ping_stats());
+    alive.attach(wss);
+
     for (;;)
     {
-        auto size = co_await wss.async_read(rxbuf, deferred);
-        auto data = rxbuf.cdata();
-        co_await wss.async_write(data, deferred);
-        rxbuf.consume(size);
+        // the buffer is empty between messages, so shrinking it frees it
+        if (m.buffer.capacity() > limit)
+            m.buffer.shrink_to_fit();
+        memory.buffer(m.buffer.capacity());
+
+        co_await wss.async_read(m.buffer, deferred);
+        alive.activity();
+        m.text = wss.got_text();
+        tap.received(opcode_of(m.text), m.buffer.cdata());
+
+        auto reply = h.handler->offload()
+                         ? co_await svr.workers().async_offload(
+                               worker, h, m, deferred)
+                         : h.handle_inline(m);
+        memory.buffer(m.buffer.capacity());
+        if (reply)
+        {
+            wss.text(m.text);
+            tap.sent(opcode_of(m.text), m.buffer.cdata());
+            co_await wss.async_write(m.buffer.cdata(), deferred);
+        }
+        m.buffer.clear();
     }
 }
 
+// Run a handler session with the read and write sides at once, so that the
+// next message is being received while the last is still being handled and
+// sent. The reader stalls when all the pipeline's buffers are waiting for the
+// writer, which leaves further input in the socket and so pushes back on the
+// client.
+template < class WebSocketStream >
 asio::awaitable< void >
-serve_https(ssl::stream< tcp::socket > stream, std::string https_fqdn)
+run_pipelined_session(WebSocketStream    &wss,
+                      server             &svr,
+                      registered_handler &h)
+{
+    using asio::experimental::deferred;
+    using namespace asio::experimental::awaitable_operators;
+
+    auto &options = svr.options();
+    auto  memory  = connection_memory(svr.memory_accounts(), sizeof(wss));
+    auto  tap     = session_tap(svr.recorder());
+    auto  worker  = svr.workers().assign();
+    auto  alive =
+        keepalive(svr.timers(), options.keepalive, svr.ping_stats());
+    auto  pipe    = echo_pipeline(wss.get_executor(),
+                                  options.pipeline_depth,
+                                  options.pipeline_buffer_limit);
+    alive.attach(wss);
+
+    auto reader = [&]() -> asio::awaitable< void >
+    {
+        for (;;)
+        {
+            auto *m = co_await pipe.acquire();
+            co_await wss.async_read(m->buffer, deferred);
+            alive.activity();
+            m->text = wss.got_text();
+            tap.received(opcode_of(m->text), m->buffer.cdata());
+            pipe.push(m);
+            memory.buffer(pipe.capacity());
+        }
+    };
+
+    auto writer = [&]() -> asio::awaitable< void >
+    {
+        for (;;)
+        {
+            auto *m     = co_await pipe.pop();
+            auto  reply = h.handler->offload()
+                              ? co_await svr.workers().async_offload(
+                                    worker, h, *m, deferred)
+                              : h.handle_inline(*m);
+            if (reply)
+            {
+                wss.text(m->text);
+                tap.sent(opcode_of(m->text), m->buffer.cdata());
+                co_await wss.async_write(m->buffer.cdata(), deferred);
+            }
+            pipe.release(m);
+            memory.buffer(pipe.capacity());
+        }
+    };
+
+    // whichever side fails first cancels the other
+    co_await (reader() || writer());
+}
+
+template < class WebSocketStream >
+asio::awaitable< void >
+run_pubsub_server(WebSocketStream &wss, server &svr, std::string topic)
+{
+    using namespace asio::experimental::awaitable_operators;
+    using asio::experimental::deferred;
+
+    auto sub = subscription(wss.get_executor(),
+                            svr.options().subscriber_queue_limit,
+                            svr.options().subscriber_drop_policy);
+    auto memory = connection_memory(svr.memory_accounts(),
+                                    sizeof(wss) + sizeof(sub));
+    auto alive =
+        keepalive(svr.timers(), svr.options().keepalive, svr.ping_stats());
+    alive.attach(wss);
+
+    struct registration
+    {
+        registration(pubsub_hub        &hub,
+                     std::string const &topic,
+                     subscription      &sub)
+        : hub(hub)
+        , topic(topic)
+        , sub(sub)
+        {
+            hub.subscribe(topic, sub);
+        }
+
+        ~registration()
+        {
+            hub.unsubscribe(topic, sub);
+        }
+
+        pubsub_hub        &hub;
+        std::string const &topic;
+        subscription      &sub;
+    } reg(svr.hub(), topic, sub);
+
+    // every message received is published to the topic, including back to
+    // this connection if it is the topic's only subscriber
+    auto reader = [&]() -> asio::awaitable< void >
+    {
+        for (;;)
+        {
+            // read each message into its own buffer, which then becomes the
+            // shared payload without being copied
+            auto msg = std::make_shared< published_message >();
+            co_await wss.async_read(msg->buffer, deferred);
+            alive.activity();
+            msg->text = wss.got_text();
+            svr.hub().publish(topic, std::move(msg));
+        }
+    };
+
+    auto writer = [&]() -> asio::awaitable< void >
+    {
+        while (auto msg = co_await sub.pop())
+        {
+            wss.text(msg->text);
+            co_await wss.async_write(msg->buffer.cdata(), deferred);
+        }
+        co_await wss.async_close(
+            beast::websocket::close_reason(
+                beast::websocket::close_code::try_again_later,
+                "subscriber too slow"),
+            deferred);
+    };
+
+    co_await (reader() || writer());
+}
+
+// Serve one stream of an HTTP/2 connection. A websocket is asked for by an
+// extended CONNECT (RFC 8441) rather than an upgrade, and is routed just as
+// an upgrade would be.
+asio::awaitable< void >
+serve_h2_stream(std::shared_ptr< h2_session > session,
+                std::shared_ptr< h2_stream >  s,
+                server                       &svr)
 {
     try
     {
-        using asio::experimental::deferred;
+        auto        reply   = h2_reply { *session, *s };
+        auto const &headers = s->headers();
+        if (find_header(headers, ":method") != "CONNECT" ||
+            find_header(headers, ":protocol") != "websocket")
+        {
+            co_await send_error(
+                reply,
+                beast::http::status::not_acceptable,
+                "This server only accepts websocket requests\r\n");
+            co_return;
+        }
 
+        auto target = std::string(find_header(headers, ":path"));
+        auto match  = svr.options().resolve_redirects
+                          ? follow_internal_redirects(
+                                svr, target, svr.tls_root())
+                          : svr.routes().https.match(target);
+        auto vars   = route_vars { .tls_root = svr.tls_root(),
+                                   .tcp_root = svr.tcp_root(),
+                                   .target   = target };
+        if (!match || match.which->action != route_action::upgrade)
+        {
+            co_await send_routed(reply, svr, match, vars);
+            co_return;
+        }
+
+        // accepting the websocket is answering the CONNECT with a 200
+        auto accept = [&]
+        {
+            session->respond(*s, { { ":status", "200" } }, {}, false);
+            auto ws = h2_websocket(session, s);
+            configure(ws, svr.options());
+            return ws;
+        };
+
+        if (auto *h = svr.find_handler(match.which->behaviour))
+        {
+            auto ws = accept();
+            if (svr.options().echo == echo_mode::pipelined)
+                co_await run_pipelined_session(ws, svr, *h);
+            else
+            {
+                co_await run_handler_session(ws, svr, *h);
+            }
+        }
+        else if (match.which->behaviour == "pubsub")
+        {
+            auto topic = match.rest.starts_with('/') ? match.rest.substr(1)
+                                                     : match.rest;
+            auto name  = std::string(topic);
+            auto ws    = accept();
+            co_await run_pubsub_server(ws, svr, std::move(name));
+        }
+        else if (match.which->behaviour == "proxy")
+        {
+            auto url      = expand(match.which->text, match, vars);
+            auto upstream = std::unique_ptr< websock_connection >();
+            try
+            {
+                upstream = co_await svr.upstreams().acquire(url);
+            }
+            catch (std::exception &e)
+            {
+                fmt::print("serve_h2_stream: {}: {}\n", url, e.what());
+            }
+
+            if (!upstream)
+            {
+                co_await send_error(reply,
+                                    beast::http::status::bad_gateway,
+                                    "backend unavailable\r\n");
+                co_return;
+            }
+            auto ws = accept();
+            co_await run_proxy(ws, *upstream);
+        }
+        else
+        {
+            co_await send_error(
+                reply,
+                beast::http::status::not_implemented,
+                fmt::format("behaviour {} is not implemented\r\n",
+                            match.which->behaviour));
+        }
+    }
+    catch (system_error &e)
+    {
+        fmt::print("serve_h2_stream: {}\n", e.code().message());
+    }
+    catch (std::exception &e)
+    {
+        fmt::print("serve_h2_stream: {}\n", e.what());
+    }
+}
+
+// Serve a connection on which the client chose h2, each stream in a
+// coroutine of its own, until the connection ends
+asio::awaitable< void >
+serve_h2(ssl::stream< tcp::socket > stream, server &svr)
+{
+    using asio::detached;
+
+    auto session = std::make_shared< h2_session >(std::move(stream),
+                                                  h2_session::role::server,
+                                                  svr.options().http2_session);
+    co_await session->start();
+    while (auto s = co_await session->accept())
+        co_spawn(session->get_executor(),
+                 serve_h2_stream(session, std::move(s), svr),
+                 detached);
+}
+
+// The server side of the TLS handshake, done on the handshake pool if the
+// server has one. Its time goes into the load the server publishes.
+template < class Socket >
+asio::awaitable< void >
+tls_handshake(ssl::stream< Socket > &stream, server &svr)
+{
+    using asio::experimental::deferred;
+
+    auto start = std::chrono::steady_clock::now();
+    if (auto *pool = svr.handshake_pool())
+        co_await offload< void(error_code) >(
+            *pool,
+            [&](auto token)
+            {
+                return stream.async_handshake(ssl::stream_base::server,
+                                              std::move(token));
+            });
+    else
         co_await stream.async_handshake(ssl::stream_base::server, deferred);
+    svr.record_handshake(std::chrono::duration_cast< std::chrono::microseconds >(
+        std::chrono::steady_clock::now() - start));
+}
 
-        auto rxbuf   = beast::flat_buffer();
-        auto request = beast::http::request< beast::http::string_body >();
-        co_await beast::http::async_read(stream, rxbuf, request, deferred);
+// Read the upgrade request from stream, which is connected and through any
+// TLS handshake, and serve it by the https routes. root is the root url of
+// the listener it came in on, so that redirects back to this server keep to
+// the same transport.
+//
+// The request is read into a pooled request_slot, which is returned as soon
+// as the websocket is accepted, so that a long lived connection holds no
+// buffer until its first message arrives.
+template < class Stream >
+asio::awaitable< void >
+serve_upgrade(Stream stream, server &svr, std::string const &root)
+{
+    using asio::experimental::deferred;
+    using ws_stream = beast::websocket::stream< Stream >;
 
-        auto &sock = stream.next_layer();
-        if (beast::websocket::is_upgrade(request))
+    auto  slot    = acquire_request();
+    auto &request = slot->request();
+    auto *pool    = svr.handshake_pool();
+    if (pool && svr.options().offload_upgrade)
+        co_await offload< void(error_code, std::size_t) >(
+            *pool,
+            [&](auto token)
+            {
+                return beast::http::async_read(
+                    stream, slot->buffer, slot->parser(), std::move(token));
+            });
+    else
+        co_await beast::http::async_read(
+            stream, slot->buffer, slot->parser(), deferred);
+
+    if (beast::websocket::is_upgrade(request))
+    {
+        auto target = std::string(target_of(request));
+        auto match  = svr.options().resolve_redirects
+                          ? follow_internal_redirects(svr, target, root)
+                          : svr.routes().https.match(target);
+        auto vars   = route_vars { .tls_root = root,
+                                   .tcp_root = svr.tcp_root(),
+                                   .target   = target };
+        if (match && match.which->action == route_action::upgrade)
         {
-            static const auto re = std::regex(
-                "/websocket-(\\d+)(/.*)?",
-                std::regex_constants::icase | std::regex_constants::optimize);
-            auto match = std::cmatch();
-            if (std::regex_match(request.target().begin(),
-                                 request.target().end(),
-                                 match,
-                                 re))
+            if (auto *h = svr.find_handler(match.which->behaviour))
+            {
+                auto wss = ws_stream(std::move(stream));
+                configure(wss, svr.options());
+                co_await wss.async_accept(request, deferred);
+                slot.reset();
+                if (svr.options().echo == echo_mode::pipelined)
+                    co_await run_pipelined_session(wss, svr, *h);
+                else
+                    co_await run_handler_session(wss, svr, *h);
+            }
+            else if (match.which->behaviour == "pubsub")
             {
-                auto index = ::atoi(match[1].str().c_str());
-                if (index == 0)
+                auto topic = match.rest.starts_with('/') ? match.rest.substr(1)
+                                                         : match.rest;
+                auto wss   = ws_stream(std::move(stream));
+                configure(wss, svr.options());
+                co_await wss.async_accept(request, deferred);
+                auto name = std::string(topic);
+                slot.reset();
+                co_await run_pubsub_server(wss, svr, std::move(name));
+            }
+            else if (match.which->behaviour == "proxy")
+            {
+                auto url      = expand(match.which->text, match, vars);
+                auto upstream = std::unique_ptr< websock_connection >();
+                try
                 {
-                    auto wss =
-                        beast::websocket::stream< ssl::stream< tcp::socket > >(
-                            std::move(stream));
-                    co_await wss.async_accept(request, deferred);
-                    co_await run_echo_server(wss, rxbuf);
-                    // serve the websocket
+                    upstream = co_await svr.upstreams().acquire(url);
                 }
-                else
+                catch (std::exception &e)
                 {
-                    // redirect to the next index down
-                    auto loc = fmt::format("{}/websocket-{}{}",
-                                           https_fqdn,
-                                           index - 1,
-                                           match[2].str());
-                    co_await send_redirect(stream, loc);
+                    fmt::print("serve_upgrade: {}: {}\n", url, e.what());
                 }
+
+                if (!upstream)
+                {
+                    co_await send_error(stream,
+                                        beast::http::status::bad_gateway,
+                                        "backend unavailable\r\n");
+                    co_return;
+                }
+
+                auto wss = ws_stream(std::move(stream));
+                configure(wss, svr.options());
+                co_await wss.async_accept(request, deferred);
+                slot.reset();
+                co_await run_proxy(wss, *upstream);
             }
             else
             {
-                co_await send_error(stream,
-                                    beast::http::status::not_found,
-                                    "try /websocket-5\r\n");
+                co_await send_error(
+                    stream,
+                    beast::http::status::not_implemented,
+                    fmt::format("behaviour {} is not implemented\r\n",
+                                match.which->behaviour));
             }
         }
         else
         {
-            co_await send_error(
-                stream,
-                beast::http::status::not_acceptable,
-                "This server only accepts websocket requests\r\n");
+            co_await send_routed(stream, svr, match, vars);
         }
     }
+    else
+    {
+        co_await send_error(stream,
+                            beast::http::status::not_acceptable,
+                            "This server only accepts websocket requests\r\n");
+    }
+}
+
+asio::awaitable< void >
+serve_https(ssl::stream< tcp::socket > stream, server &svr)
+{
+    auto active = server::session_scope(svr);
+    auto load   = server::load_scope(svr);
+    try
+    {
+        co_await tls_handshake(stream, svr);
+        if (svr.options().http2 && negotiated_h2(stream))
+            co_await serve_h2(std::move(stream), svr);
+        else
+            co_await serve_upgrade(std::move(stream), svr, svr.tls_root());
+    }
     catch (system_error &e)
     {
         fmt::print("serve_https: {}\n", e.code().message());
@@ -259,7 +914,7 @@ serve_https(ssl::stream< tcp::socket > stream, std::string https_fqdn)
 asio::awaitable< void >
 wss_server(ssl::context  &sslctx,
            tcp::acceptor &acceptor,
-           std::string    https_fqdn)
+           server        &svr)
 {
     using asio::detached;
     using asio::experimental::deferred;
@@ -271,10 +926,18 @@ wss_server(ssl::context  &sslctx,
         {
             auto sock = tcp::socket(exec);
             co_await acceptor.async_accept(sock, deferred);
+            if (!admit(svr, sock))
+            {
+                // refused before any tls work is done on its behalf
+                auto ec = error_code();
+                sock.close(ec);
+                continue;
+            }
+            tune_connected(sock, svr.options().socket);
             co_spawn(
                 exec,
                 serve_https(ssl::stream< tcp::socket >(std::move(sock), sslctx),
-                            https_fqdn),
+                            svr),
                 detached);
         }
     }
@@ -288,6 +951,68 @@ wss_server(ssl::context  &sslctx,
     }
 }
 
+// serve a client connected over the unix domain socket, which is either the
+// socket itself or a TLS stream over it
+template < class Stream >
+asio::awaitable< void >
+serve_local(Stream stream, server &svr)
+{
+    auto active = server::session_scope(svr);
+    auto load   = server::load_scope(svr);
+    try
+    {
+        if constexpr (!std::is_same_v< Stream, local_stream::socket >)
+            co_await tls_handshake(stream, svr);
+        co_await serve_upgrade(std::move(stream), svr, svr.local_root());
+    }
+    catch (system_error &e)
+    {
+        fmt::print("serve_local: {}\n", e.code().message());
+    }
+    catch (std::exception &e)
+    {
+        fmt::print("serve_local: {}\n", e.what());
+    }
+}
+
+asio::awaitable< void >
+local_server(ssl::context           &sslctx,
+             local_stream::acceptor &acceptor,
+             server                 &svr)
+{
+    using asio::detached;
+    using asio::experimental::deferred;
+    auto exec = co_await asio::this_coro::executor;
+
+    if (!acceptor.is_open())
+        co_return;
+
+    try
+    {
+        while (1)
+        {
+            auto sock = local_stream::socket(exec);
+            co_await acceptor.async_accept(sock, deferred);
+            if (svr.options().local_tls)
+                co_spawn(exec,
+                         serve_local(ssl::stream< local_stream::socket >(
+                                         std::move(sock), sslctx),
+                                     svr),
+                         detached);
+            else
+                co_spawn(exec, serve_local(std::move(sock), svr), detached);
+        }
+    }
+    catch (system_error &se)
+    {
+        fmt::print("local_server: {}\n", se.code().message());
+    }
+    catch (std::exception &e)
+    {
+        fmt::print("local_server: {}\n", e.what());
+    }
+}
+
 void
 print_exceptions(system_error &se);
 
@@ -347,6 +1072,89 @@ print_exceptions(std::exception_ptr const &ep)
 
 }   // namespace
 
+asio::awaitable< void >
+server::offer_listeners()
+{
+    using asio::redirect_error;
+    using asio::use_awaitable;
+    using asio::experimental::deferred;
+
+    if (options_.handoff_path.empty())
+        co_return;
+
+    try
+    {
+        ::unlink(options_.handoff_path.c_str());
+        auto acceptor = local_stream::acceptor(
+            exec_, local_stream::endpoint(options_.handoff_path));
+
+        for (;;)
+        {
+            auto peer = local_stream::socket(exec_);
+            co_await acceptor.async_accept(peer, deferred);
+            co_await peer.async_wait(local_stream::socket::wait_write,
+                                     deferred);
+            send_listeners(
+                peer,
+                listener_fds { .tcp = tcp_acceptor_.native_handle(),
+                               .tls = tls_acceptor_.native_handle() });
+
+            // keep serving unless the successor confirms that it is accepting
+            auto ack = char(0);
+            auto ec  = error_code();
+            co_await asio::async_read(
+                peer, asio::buffer(&ack, 1), redirect_error(use_awaitable, ec));
+            if (!ec && ack == 'A')
+                break;
+            fmt::print("handoff: successor did not confirm, still serving\n");
+        }
+
+        // the successor owns the listening sockets now. Closing ours stops the
+        // accept loops without affecting the sessions already running.
+        tcp_acceptor_.close();
+        tls_acceptor_.close();
+        local_acceptor_.close();
+
+        // and the load slot, which the sessions left draining here must not
+        // publish to
+        load_lease_ = {};
+        fmt::print("handed over listeners, draining {} sessions\n",
+                   sessions_);
+    }
+    catch (system_error &se)
+    {
+        fmt::print("offer_listeners: {}\n", se.code().message());
+    }
+}
+
+// Beat the heart of this server's slot in the load table until its listeners
+// are handed over, after which its successor publishes the load of the slot.
+asio::awaitable< void >
+server::report_load()
+{
+    using asio::experimental::deferred;
+
+    if (!load_lease_)
+        co_return;
+
+    try
+    {
+        auto timer = asio::steady_timer(exec_);
+        while (load_lease_)
+        {
+            load_table_->heartbeat(load_lease_);
+            load_table_->set_active(load_lease_,
+                                    std::uint32_t(load_sessions_));
+            timer.expires_after(options_.load_interval);
+            co_await timer.async_wait(deferred);
+        }
+    }
+    catch (system_error &se)
+    {
+        fmt::print("report_load: {}\n", se.code().message());
+    }
+}
+
 void
 server::run(asio::cancellation_slot stop_slot)
 {
@@ -357,6 +1165,14 @@ server::run(asio::cancellation_slot stop_slot)
 
     fmt::print("server starting\n");
 
+    // tell the server we took over from that we are ready to accept
+    if (handoff_peer_.is_open())
+    {
+        auto ec = error_code();
+        asio::write(handoff_peer_, asio::buffer("A", 1), ec);
+        handoff_peer_.close(ec);
+    }
+
     auto handler = [](std::exception_ptr ep)
     {
         try
@@ -375,8 +1191,10 @@ server::run(asio::cancellation_slot stop_slot)
     };
 
     co_spawn(get_executor(),
-             http_server(tcp_acceptor_, tls_root_) &&
-                 wss_server(sslctx_, tls_acceptor_, tls_root_),
+             http_server(tcp_acceptor_, *this) &&
+                 wss_server(sslctx_, tls_acceptor_, *this) &&
+                 local_server(sslctx_, local_acceptor_, *this) &&
+                 offer_listeners() && report_load(),
              bind_cancellation_slot(stop_slot, handler));
 }
 
@@ -11,13 +11,152 @@
 #define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_SERVER_HPP
 
 #include "config.hpp"
+#include "echo_pipeline.hpp"
+#include "h2_session.hpp"
+#include "keepalive.hpp"
+#include "load_table.hpp"
+#include "memory_accounting.hpp"
+#include "message_handler.hpp"
+#include "pubsub.hpp"
+#include "rate_limiter.hpp"
+#include "route_table.hpp"
+#include "session_log.hpp"
+#include "socket_handoff.hpp"
+#include "socket_profile.hpp"
+#include "upstream_pool.hpp"
+#include "worker_pool.hpp"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace blog
 {
 
+struct server_options
+{
+    /// Where the listeners are bound, unless they are taken over from a
+    /// running server. The default of port 0 picks a free port.
+    tcp::endpoint tcp_endpoint = tcp::endpoint(ip::address_v4::loopback(), 0);
+    tcp::endpoint tls_endpoint = tcp::endpoint(ip::address_v4::loopback(), 0);
+
+    /// If set, the path of a unix domain socket on which to accept websocket
+    /// clients on the same host as well. They are routed as the tls
+    /// listener's are but skip the TCP stack, and TLS too unless local_tls is
+    /// set. Rate limiting and the socket profile do not apply to them, nor
+    /// does HTTP/2. A socket already at the path is replaced, and any other
+    /// file there is an error. A successor started with handoff_path binds
+    /// the path afresh rather than taking the socket over.
+    std::string local_path;
+    bool        local_tls = false;
+
+    /// If set, the path of a unix socket through which a running server hands
+    /// its listening sockets to its successor. At startup the server first
+    /// tries to take over from a predecessor at this path, and once running it
+    /// offers its own listeners there. After handing over, a server stops
+    /// accepting and drains the sessions it already has.
+    std::string handoff_path;
+
+    /// File from which the route table is loaded. See routes.conf
+    std::string route_file = "routes.conf";
+
+    /// Messages that may be queued for a slow pubsub subscriber
+    std::size_t subscriber_queue_limit = 1024;
+
+    /// What to do when a pubsub subscriber's queue is full
+    drop_policy subscriber_drop_policy = drop_policy::drop_oldest;
+
+    /// Largest websocket message accepted from a client. A bigger message
+    /// fails the connection rather than growing its buffer to match.
+    std::size_t max_message_size = 16 * 1024 * 1024;
+
+    /// Receive buffer capacity a message session keeps between messages. A
+    /// larger buffer, grown to hold a big message, is released once the
+    /// message has been answered, so a quiet connection holds at most this
+    /// much. 0 releases the buffer after every message.
+    std::size_t idle_buffer_limit = 0;
+
+    /// Let OpenSSL free its read and write buffers while a connection has
+    /// nothing in flight (SSL_MODE_RELEASE_BUFFERS). Saves about 34KiB per
+    /// idle TLS connection at the cost of reallocating on the next record.
+    bool release_ssl_buffers = true;
+
+    /// How sessions served by a message_handler, echo among them, are run. A
+    /// pipelined session keeps reading while earlier messages are still being
+    /// handled and written back, with up to
+    /// pipeline_depth messages in flight; a buffer that grows past
+    /// pipeline_buffer_limit is shrunk once its message has been sent.
+    echo_mode   echo                  = echo_mode::sequential;
+    std::size_t pipeline_depth        = 8;
+    std::size_t pipeline_buffer_limit = 64 * 1024;
+
+    /// Pings sent to quiet websocket sessions, and how long to wait for the
+    /// pong before giving up on the peer
+    keepalive_options keepalive;
+
+    /// Connections allowed per source address. Checked as soon as a
+    /// connection is accepted: a plain http connection over the limit is
+    /// sent a 429, and a tls one is closed before its handshake.
+    rate_limit_options rate_limit;
+
+    /// Follow redirects that lead back to this server internally, so that a
+    /// websocket client reaches its endpoint without being sent round the
+    /// redirect chain, up to max_internal_redirects hops.
+    bool        resolve_redirects      = false;
+    std::size_t max_internal_redirects = 16;
+
+    /// Connections kept ready for each backend of a proxy route
+    std::size_t upstream_spares = 2;
+
+    /// TCP options for the listeners and every connection accepted
+    socket_profile socket;
+
+    /// Record every message of every handler session to this file, as a
+    /// session log for the replay tool. Empty records nothing.
+    std::string record_file;
+
+    /// Threads for message handlers that offload their work, or 0 for one
+    /// per hardware thread. They are only started if a handler offloads.
+    std::size_t worker_threads = 0;
+
+    /// Threads on which to do the TLS handshake of each new connection, so
+    /// that the crypto of a burst of new connections does not hold up the
+    /// sessions already running on the server's executor. 0 does handshakes
+    /// on the server's executor. With offload_upgrade, reading and parsing
+    /// the upgrade request is done on them too. Either way the connection
+    /// itself stays with the server's executor, where its session runs.
+    std::size_t handshake_threads = 0;
+    bool        offload_upgrade   = false;
+
+    /// The file holding the load table shared by a group of servers, or
+    /// empty for none. With a table, a redirect whose location refers to
+    /// {backend} goes to the least loaded live backend in it, among
+    /// backends if that is not empty. Unless report_load is cleared, the
+    /// server also publishes its own load in the table, under its tls root,
+    /// every load_interval and whenever a connection on the tls or local
+    /// listener opens or closes. Plain http connections, which are only
+    /// ever redirected, are not load.
+    std::string                load_table;
+    std::vector< std::string > backends;
+    bool                       report_load   = true;
+    std::chrono::milliseconds  load_interval = std::chrono::seconds(1);
+    std::chrono::milliseconds  load_stale    = std::chrono::seconds(3);
+
+    /// Offer h2 through ALPN on the tls listener, so that a client opening
+    /// many websockets can carry them all as streams of one connection
+    /// (RFC 8441), each with its own flow control. Clients that do not ask
+    /// for h2 are served over HTTP/1.1 as before.
+    bool               http2 = false;
+    h2_session_options http2_session;
+};
+
 struct server
 {
-    server(asio::any_io_executor exec);
+    server(asio::any_io_executor exec, server_options options = {});
+
+    ~server();
 
 
     void run  (asio::cancellation_slot stop_slot);
@@ -28,19 +167,229 @@ struct server
         return exec_;
     }
 
-    std::string
+    std::string const &
     tcp_root() const
     {
         return tcp_root_;
     }
 
+    std::string const &
+    tls_root() const
+    {
+        return tls_root_;
+    }
+
+    /// The root url of the unix domain socket listener, or empty if there is
+    /// none. See local_root() in url.hpp
+    std::string const &
+    local_root() const
+    {
+        return local_root_;
+    }
+
+    route_config const &
+    routes() const
+    {
+        return routes_;
+    }
+
+    server_options const &
+    options() const
+    {
+        return options_;
+    }
+
+    pubsub_hub &
+    hub()
+    {
+        return hub_;
+    }
+
+    /// The memory held by websocket connections, as far as the server can
+    /// account for it
+    memory_report
+    memory() const
+    {
+        return memory_.report();
+    }
+
+    memory_accounting &
+    memory_accounts()
+    {
+        return memory_;
+    }
+
+    /// The wheel on which the server's per connection timers are kept
+    timer_wheel &
+    timers()
+    {
+        return timers_;
+    }
+
+    /// Keepalive totals across every websocket session
+    keepalive_stats &
+    ping_stats()
+    {
+        return ping_stats_;
+    }
+
+    rate_limiter &
+    limiter()
+    {
+        return limiter_;
+    }
+
+    /// A 429 response, serialised once so that refusing a connection costs
+    /// no more than a write
+    std::string const &
+    too_many_requests() const
+    {
+        return too_many_requests_;
+    }
+
+    upstream_pool &
+    upstreams()
+    {
+        return upstreams_;
+    }
+
+    /// Serve upgrades to routes whose behaviour is name with handler,
+    /// replacing any handler already registered under that name. "echo" is
+    /// registered from the start. Handlers must be added before run().
+    void
+    add_handler(std::string name, std::shared_ptr< message_handler > handler);
+
+    /// The handler registered as name, or null
+    registered_handler *
+    find_handler(std::string const &name);
+
+    /// Message counts, queue depth and service time of each handler
+    std::map< std::string, handler_stats >
+    handler_report() const;
+
+    worker_pool &
+    workers()
+    {
+        return workers_;
+    }
+
+    /// The root to which a redirect to {backend} goes now: the least loaded
+    /// live backend in the load table, or the tls root if there is none
+    std::string
+    choose_backend();
+
+    /// Count a TLS handshake's time in the load the server publishes
+    void
+    record_handshake(std::chrono::microseconds t);
+
+    /// Where TLS handshakes are done, or null if they are done on the
+    /// server's executor
+    asio::thread_pool *
+    handshake_pool()
+    {
+        return handshake_pool_.get();
+    }
+
+    /// Where sessions are recorded, or null if they are not
+    session_recorder *
+    recorder()
+    {
+        return recorder_.get();
+    }
+
+    /// The number of connections currently being served
+    std::size_t
+    active_sessions() const
+    {
+        return sessions_;
+    }
+
+    /// Counts a connection as active for the lifetime of the scope
+    struct session_scope
+    {
+        explicit session_scope(server &svr)
+        : svr_(svr)
+        {
+            ++svr_.sessions_;
+        }
+
+        session_scope(session_scope const &) = delete;
+
+        ~session_scope()
+        {
+            --svr_.sessions_;
+        }
+
+      private:
+        server &svr_;
+    };
+
+    /// Counts a connection in the load the server publishes for the lifetime
+    /// of the scope. Only connections that a {backend} redirect can have sent
+    /// here count, which are those on the tls and local listeners.
+    struct load_scope
+    {
+        explicit load_scope(server &svr)
+        : svr_(svr)
+        {
+            ++svr_.load_sessions_;
+            svr_.publish_load(true);
+        }
+
+        load_scope(load_scope const &) = delete;
+
+        ~load_scope()
+        {
+            --svr_.load_sessions_;
+            svr_.publish_load(false);
+        }
+
+      private:
+        server &svr_;
+    };
+
   private:
-    asio::any_io_executor exec_;
-    ssl::context          sslctx_;
-    tcp::acceptor         tcp_acceptor_;
-    tcp::acceptor         tls_acceptor_;
-    std::string           tcp_root_;
-    std::string           tls_root_;
+    using handler_map =
+        std::unordered_map< std::string,
+                            std::unique_ptr< registered_handler > >;
+
+    asio::awaitable< void >
+    offer_listeners();
+
+    // tell the load table the number of load_scopes now open
+    void
+    publish_load(bool arrived);
+
+    asio::awaitable< void >
+    report_load();
+
+    asio::any_io_executor                exec_;
+    ssl::context                         sslctx_;
+    local_stream::socket                 handoff_peer_;
+    listener_fds                         inherited_;
+    tcp::acceptor                        tcp_acceptor_;
+    tcp::acceptor                        tls_acceptor_;
+    local_stream::acceptor               local_acceptor_;
+    std::string                          tcp_root_;
+    std::string                          tls_root_;
+    std::string                          local_root_;
+    route_config                         routes_;
+    server_options                       options_;
+    pubsub_hub                           hub_;
+    memory_accounting                    memory_;
+    timer_wheel                          timers_;
+    keepalive_stats                      ping_stats_;
+    rate_limiter                         limiter_;
+    std::string                          too_many_requests_;
+    upstream_pool                        upstreams_;
+    std::unique_ptr< session_recorder >  recorder_;
+    handler_map                          handlers_;
+    worker_pool                          workers_;
+    std::unique_ptr< asio::thread_pool > handshake_pool_;
+    std::unique_ptr< load_table >        load_table_;
+    load_table::lease                    load_lease_;
+    std::size_t                          sessions_      = 0;
+    std::size_t                          load_sessions_ = 0;
 };
 
 }   // namespace blog
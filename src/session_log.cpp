@@ -0,0 +1,180 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "session_log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace blog
+{
+namespace
+{
+constexpr char log_magic[8] = { 'B', 'L', 'O', 'G', 'W', 'S', 'L', '1' };
+
+// the magic, then the wall clock time the log was started
+constexpr std::size_t log_header_size = 16;
+
+constexpr std::size_t
+padded(std::size_t n)
+{
+    return (n + 7) & ~std::size_t(7);
+}
+
+[[noreturn]] void
+throw_errno(std::string const &what)
+{
+    throw system_error(error_code(errno, asio::error::get_system_category()),
+                       what);
+}
+}   // namespace
+
+session_recorder::session_recorder(std::string const &path, std::size_t chunk)
+: fd_(::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))
+, path_(path)
+, chunk_(padded(std::max< std::size_t >(chunk, 4096)))
+, start_(clock::now())
+{
+    if (fd_ < 0)
+        throw_errno(path_);
+
+    try
+    {
+        grow(log_header_size);
+    }
+    catch (...)
+    {
+        ::close(fd_);
+        throw;
+    }
+
+    auto wall = std::int64_t(
+        std::chrono::duration_cast< std::chrono::nanoseconds >(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count());
+    std::memcpy(data_, log_magic, sizeof(log_magic));
+    std::memcpy(data_ + sizeof(log_magic), &wall, sizeof(wall));
+    used_ = log_header_size;
+}
+
+session_recorder::~session_recorder()
+{
+    ::munmap(data_, mapped_);
+    [[maybe_unused]] auto r = ::ftruncate(fd_, ::off_t(used_));
+    ::close(fd_);
+}
+
+std::size_t
+session_recorder::size() const
+{
+    auto lock = std::lock_guard(mutex_);
+    return used_;
+}
+
+char *
+session_recorder::reserve(std::uint64_t   session,
+                          frame_direction direction,
+                          frame_opcode    opcode,
+                          std::size_t     size)
+{
+    auto total = padded(sizeof(frame_header) + size);
+    if (used_ + total > mapped_)
+        grow(used_ + total);
+
+    auto header = frame_header {
+        .time = std::uint64_t(
+            std::chrono::duration_cast< std::chrono::nanoseconds >(
+                clock::now() - start_)
+                .count()),
+        .session   = session,
+        .size      = std::uint32_t(size),
+        .direction = direction,
+        .opcode    = opcode,
+        .reserved  = 0
+    };
+    auto *p = data_ + used_;
+    std::memcpy(p, &header, sizeof(header));
+    used_ += total;
+    return p + sizeof(header);
+}
+
+void
+session_recorder::grow(std::size_t needed)
+{
+    auto size = (needed + chunk_ - 1) / chunk_ * chunk_;
+    if (::ftruncate(fd_, ::off_t(size)) < 0)
+        throw_errno(path_);
+
+    // the new pages of the file read as zeros, which is what marks the end
+    // of the log should the process die before truncating it
+    auto p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED)
+        throw_errno(path_);
+    if (data_)
+        ::munmap(data_, mapped_);
+    data_   = static_cast< char * >(p);
+    mapped_ = size;
+}
+
+void
+session_log::iterator::load(std::size_t pos)
+{
+    pos_ = data_.size();
+    if (pos + sizeof(frame_header) > data_.size())
+        return;
+
+    auto header = frame_header();
+    std::memcpy(&header, data_.data() + pos, sizeof(header));
+    auto payload = pos + sizeof(header);
+    if (header.session == 0 || header.size > data_.size() - payload)
+        return;
+
+    pos_     = pos;
+    next_    = pos + padded(sizeof(header) + header.size);
+    current_ = frame_view {
+        .time      = std::chrono::nanoseconds(header.time),
+        .session   = header.session,
+        .direction = header.direction,
+        .opcode    = header.opcode,
+        .payload   = data_.substr(payload, header.size)
+    };
+}
+
+session_log::session_log(std::string const &path)
+: file_(path)
+{
+    if (file_.size() < log_header_size ||
+        std::memcmp(file_.buffer().data(), log_magic, sizeof(log_magic)))
+        throw std::runtime_error(path + ": not a session log");
+}
+
+session_log::iterator
+session_log::begin() const
+{
+    auto buf = file_.buffer();
+    return iterator(
+        std::string_view(static_cast< char const * >(buf.data()), buf.size()),
+        log_header_size);
+}
+
+session_log::iterator
+session_log::end() const
+{
+    auto buf = file_.buffer();
+    return iterator(
+        std::string_view(static_cast< char const * >(buf.data()), buf.size()),
+        buf.size());
+}
+
+}   // namespace blog
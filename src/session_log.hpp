@@ -0,0 +1,254 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_SESSION_LOG_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_SESSION_LOG_HPP
+
+#include "config.hpp"
+#include "mapped_file.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace blog
+{
+
+// A session log is a 16 byte file header followed by records, each a
+// frame_header and its payload, padded to a multiple of 8 bytes. Numbers are
+// in host byte order: a log is meant to be replayed on the kind of machine
+// that recorded it.
+
+/// Which way a recorded message went, as seen by whoever recorded it
+enum class frame_direction : std::uint8_t
+{
+    received = 1,
+    sent     = 2
+};
+
+enum class frame_opcode : std::uint8_t
+{
+    text   = 1,
+    binary = 2,
+    close  = 8   // the payload is the close reason
+};
+
+inline frame_opcode
+opcode_of(bool text)
+{
+    return text ? frame_opcode::text : frame_opcode::binary;
+}
+
+struct frame_header
+{
+    std::uint64_t   time;      // nanoseconds since the log was started
+    std::uint64_t   session;   // the connection, numbered from 1
+    std::uint32_t   size;      // payload bytes
+    frame_direction direction;
+    frame_opcode    opcode;
+    std::uint16_t   reserved;
+};
+
+static_assert(sizeof(frame_header) == 24);
+
+/// Appends websocket messages to a session log.
+///
+/// The file is grown a chunk at a time and mapped into memory, so recording a
+/// message is a copy into the mapping under a short lock, with no system
+/// call unless the chunk is full. The file is truncated to the records
+/// actually written when the recorder is destroyed; a log left by a process
+/// that died is padded with zeros, which readers take as the end.
+///
+/// Thread safe, so one recorder can serve every connection of a process.
+struct session_recorder
+{
+    explicit session_recorder(std::string const &path,
+                              std::size_t        chunk = 64 * 1024 * 1024);
+
+    session_recorder(session_recorder const &) = delete;
+
+    session_recorder &
+    operator=(session_recorder const &) = delete;
+
+    ~session_recorder();
+
+    /// A number for a new connection's records
+    std::uint64_t
+    open_session()
+    {
+        return next_session_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    template < class ConstBufferSequence >
+    void
+    record(std::uint64_t              session,
+           frame_direction            direction,
+           frame_opcode               opcode,
+           ConstBufferSequence const &payload)
+    {
+        auto size = beast::buffer_bytes(payload);
+        auto lock = std::lock_guard(mutex_);
+        auto *p   = reserve(session, direction, opcode, size);
+        asio::buffer_copy(asio::buffer(p, size), payload);
+    }
+
+    /// Bytes of the log written so far
+    std::size_t
+    size() const;
+
+  private:
+    // append a header for a payload of size bytes and return where the
+    // payload goes. mutex_ must be held.
+    char *
+    reserve(std::uint64_t   session,
+            frame_direction direction,
+            frame_opcode    opcode,
+            std::size_t     size);
+
+    void
+    grow(std::size_t needed);
+
+    using clock = std::chrono::steady_clock;
+
+    int                          fd_;
+    std::string                  path_;
+    std::size_t                  chunk_;
+    char                        *data_   = nullptr;
+    std::size_t                  mapped_ = 0;
+    std::size_t                  used_   = 0;
+    clock::time_point            start_;
+    std::atomic< std::uint64_t > next_session_ { 1 };
+    mutable std::mutex           mutex_;
+};
+
+/// One connection's view of a recorder. A default constructed tap records
+/// nothing, so code can record unconditionally and pay only a test when
+/// recording is off.
+struct session_tap
+{
+    session_tap() = default;
+
+    explicit session_tap(session_recorder *recorder)
+    : recorder_(recorder)
+    , session_(recorder ? recorder->open_session() : 0)
+    {
+    }
+
+    explicit
+    operator bool() const
+    {
+        return recorder_ != nullptr;
+    }
+
+    template < class ConstBufferSequence >
+    void
+    received(frame_opcode opcode, ConstBufferSequence const &payload)
+    {
+        if (recorder_)
+            recorder_->record(
+                session_, frame_direction::received, opcode, payload);
+    }
+
+    template < class ConstBufferSequence >
+    void
+    sent(frame_opcode opcode, ConstBufferSequence const &payload)
+    {
+        if (recorder_)
+            recorder_->record(session_, frame_direction::sent, opcode, payload);
+    }
+
+  private:
+    session_recorder *recorder_ = nullptr;
+    std::uint64_t     session_  = 0;
+};
+
+/// A record read from a session log. The payload points into the log's
+/// mapping and is valid for as long as the log is.
+struct frame_view
+{
+    std::chrono::nanoseconds time;
+    std::uint64_t            session;
+    frame_direction          direction;
+    frame_opcode             opcode;
+    std::string_view         payload;
+};
+
+/// A session log mapped for reading. Iterating it yields each record in the
+/// order it was written without copying any payload.
+struct session_log
+{
+    struct iterator
+    {
+        using value_type        = frame_view;
+        using difference_type   = std::ptrdiff_t;
+        using iterator_category = std::input_iterator_tag;
+
+        frame_view const &
+        operator*() const
+        {
+            return current_;
+        }
+
+        frame_view const *
+        operator->() const
+        {
+            return &current_;
+        }
+
+        iterator &
+        operator++()
+        {
+            load(next_);
+            return *this;
+        }
+
+        bool
+        operator==(iterator const &other) const
+        {
+            return pos_ == other.pos_;
+        }
+
+      private:
+        friend session_log;
+
+        iterator(std::string_view data, std::size_t pos)
+        : data_(data)
+        {
+            load(pos);
+        }
+
+        void
+        load(std::size_t pos);
+
+        std::string_view data_;
+        std::size_t      pos_  = 0;
+        std::size_t      next_ = 0;
+        frame_view       current_ {};
+    };
+
+    /// Map the log at path. Throws if it is not a session log.
+    explicit session_log(std::string const &path);
+
+    iterator
+    begin() const;
+
+    iterator
+    end() const;
+
+  private:
+    mapped_file file_;
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_SESSION_LOG_HPP
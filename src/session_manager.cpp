@@ -0,0 +1,235 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "session_manager.hpp"
+
+#include "connect_websock.hpp"
+#include "counter.hpp"
+
+#include <boost/asio/experimental/awaitable_operators.hpp>
+
+#include <algorithm>
+
+namespace blog
+{
+
+client_session::client_session(session_shard   &shard,
+                               ssl::context    &sslctx,
+                               session_config   config,
+                               session_handlers handlers)
+: shard_(shard)
+, sslctx_(sslctx)
+, config_(std::move(config))
+, handlers_(std::move(handlers))
+, strand_(asio::make_strand(shard.ioc))
+, outbox_signal_(strand_)
+{
+}
+
+void
+client_session::send(std::string msg)
+{
+    asio::post(strand_,
+               [self = shared_from_this(), msg = std::move(msg)]() mutable
+               {
+                   self->outbox_.push_back(std::move(msg));
+                   self->outbox_signal_.wake();
+               });
+}
+
+void
+client_session::stop()
+{
+    asio::post(strand_,
+               [self = shared_from_this()]
+               {
+                   self->stopping_ = true;
+                   self->stop_signal_.emit(asio::cancellation_type::all);
+               });
+}
+
+asio::awaitable< void >
+client_session::read_loop(websock_connection &conn)
+{
+    for (;;)
+    {
+        auto msg = co_await conn.receive_view();
+        if (handlers_.on_message)
+            handlers_.on_message(*this, msg);
+    }
+}
+
+asio::awaitable< void >
+client_session::write_loop(websock_connection &conn)
+{
+    for (;;)
+    {
+        while (outbox_.empty())
+            co_await outbox_signal_.wait();
+
+        auto msg = std::move(outbox_.front());
+        outbox_.pop_front();
+        co_await conn.send_text(msg);
+    }
+}
+
+asio::awaitable< void >
+client_session::run()
+{
+    using namespace asio::experimental::awaitable_operators;
+    using asio::experimental::deferred;
+
+    shard_.live.insert(this);
+
+    auto backoff = config_.min_backoff;
+    auto timer   = asio::steady_timer(strand_);
+    auto error   = std::exception_ptr();
+
+    // stop() may have been called before the coroutine started, in which case
+    // there was nobody listening to the cancellation signal
+    while (!stopping_)
+    {
+        auto was_open = false;
+        try
+        {
+            auto conn = co_await connect_websock(
+                sslctx_, config_.url, config_.redirect_limit, false);
+
+            conn->report_to(shard_.connections);
+            conn->start_keepalive(shard_.timers, config_.keepalive);
+            bump(shard_.stats.connects);
+            bump(shard_.stats.open);
+            was_open = true;
+            backoff  = config_.min_backoff;
+            if (handlers_.on_open)
+                handlers_.on_open(*this);
+
+            co_await (read_loop(*conn) || write_loop(*conn));
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        if (was_open)
+            shard_.stats.open.store(
+                shard_.stats.open.load(std::memory_order_relaxed) - 1,
+                std::memory_order_relaxed);
+
+        if (stopping_ || !config_.reconnect)
+            break;
+
+        bump(shard_.stats.failures);
+        try
+        {
+            timer.expires_after(backoff);
+            co_await timer.async_wait(deferred);
+        }
+        catch (system_error &)
+        {
+            break;
+        }
+        backoff = std::min(backoff * 2, config_.max_backoff);
+    }
+
+    shard_.live.erase(this);
+    if (handlers_.on_close)
+        handlers_.on_close(*this, stopping_ ? nullptr : error);
+}
+
+session_manager::session_manager(ssl::context &sslctx, std::size_t threads)
+: sslctx_(sslctx)
+{
+    threads = std::max< std::size_t >(threads, 1);
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        shards_.push_back(std::make_unique< session_shard >());
+        work_.push_back(asio::make_work_guard(shards_.back()->ioc));
+    }
+
+    for (auto &shard : shards_)
+        shard->thread = std::thread([&ioc = shard->ioc] { ioc.run(); });
+}
+
+session_manager::~session_manager()
+{
+    stop();
+    join();
+}
+
+std::shared_ptr< client_session >
+session_manager::open(session_config config, session_handlers handlers)
+{
+    auto &shard = *shards_[next_++ % shards_.size()];
+    auto  session =
+        std::make_shared< client_session >(shard,
+                                           sslctx_,
+                                           std::move(config),
+                                           std::move(handlers));
+
+    // the completion handler owns the session until its coroutine finishes
+    asio::co_spawn(session->get_executor(),
+                   session->run(),
+                   asio::bind_cancellation_slot(
+                       session->stop_signal_.slot(),
+                       [session](std::exception_ptr) {}));
+    return session;
+}
+
+session_stats
+session_manager::stats() const
+{
+    auto result = session_stats();
+    for (auto &shard : shards_)
+    {
+        auto &c = shard->stats;
+        result.open += c.open.load(std::memory_order_relaxed);
+        result.connects += c.connects.load(std::memory_order_relaxed);
+        result.failures += c.failures.load(std::memory_order_relaxed);
+
+        auto traffic = shard->connections.snapshot();
+        result.messages_in += traffic.messages_in;
+        result.messages_out += traffic.messages_out;
+        result.bytes_in += traffic.bytes_in;
+        result.bytes_out += traffic.bytes_out;
+    }
+    return result;
+}
+
+connection_stats
+session_manager::connection_report() const
+{
+    auto result = connection_stats();
+    for (auto &shard : shards_)
+        result += shard->connections.snapshot();
+    return result;
+}
+
+void
+session_manager::stop()
+{
+    for (auto &shard : shards_)
+        asio::post(shard->ioc,
+                   [&live = shard->live]
+                   {
+                       for (auto *session : live)
+                           session->stop();
+                   });
+    work_.clear();
+}
+
+void
+session_manager::join()
+{
+    for (auto &shard : shards_)
+        if (shard->thread.joinable())
+            shard->thread.join();
+}
+
+}   // namespace blog
@@ -0,0 +1,207 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_SESSION_MANAGER_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_SESSION_MANAGER_HPP
+
+#include "config.hpp"
+#include "connection_stats.hpp"
+#include "keepalive.hpp"
+#include "timer_wheel.hpp"
+#include "wake_signal.hpp"
+#include "websock_connection.hpp"
+
+#include <boost/describe.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace blog
+{
+
+struct client_session;
+
+/// Totals across every session of a session_manager
+struct session_stats
+{
+    std::uint64_t open         = 0;   // sessions connected right now
+    std::uint64_t connects     = 0;   // successful connections, ever
+    std::uint64_t failures     = 0;   // connections lost or never made
+    std::uint64_t messages_in  = 0;
+    std::uint64_t messages_out = 0;
+    std::uint64_t bytes_in     = 0;
+    std::uint64_t bytes_out    = 0;
+};
+
+BOOST_DESCRIBE_STRUCT(session_stats,
+                      (),
+                      (open,
+                       connects,
+                       failures,
+                       messages_in,
+                       messages_out,
+                       bytes_in,
+                       bytes_out))
+
+/// Callbacks for a session. They are invoked on the session's strand, so a
+/// handler must not block.
+struct session_handlers
+{
+    std::function< void(client_session &) >                     on_open;
+    std::function< void(client_session &, std::string_view) >   on_message;
+    std::function< void(client_session &, std::exception_ptr) > on_close;
+};
+
+struct session_config
+{
+    std::string               url;
+    int                       redirect_limit = 5;
+    bool                      reconnect      = true;
+    std::chrono::milliseconds min_backoff { 100 };
+    std::chrono::milliseconds max_backoff { 10'000 };
+
+    /// A connection whose pings go unanswered is dropped and reconnected
+    keepalive_options keepalive;
+};
+
+/// One io_context and the thread that runs it. Sessions are spread across
+/// shards, and everything in a shard is only touched by its own thread.
+struct session_shard
+{
+    // written only by the shard's thread, read by anyone. Traffic is counted
+    // by connections.
+    struct counters
+    {
+        std::atomic< std::uint64_t > open { 0 };
+        std::atomic< std::uint64_t > connects { 0 };
+        std::atomic< std::uint64_t > failures { 0 };
+    };
+
+    asio::io_context                       ioc { 1 };
+    alignas(64) counters                   stats;
+    connection_metrics                     connections;
+    std::unordered_set< client_session * > live;
+    timer_wheel                            timers { ioc.get_executor() };
+    std::thread                            thread;
+};
+
+/// A websocket client connection that reconnects, with backoff, whenever its
+/// connection is lost. Created by session_manager::open.
+struct client_session : std::enable_shared_from_this< client_session >
+{
+    using executor_type = asio::strand< asio::io_context::executor_type >;
+
+    client_session(session_shard   &shard,
+                   ssl::context    &sslctx,
+                   session_config   config,
+                   session_handlers handlers);
+
+    /// Queue a text message. May be called from any thread. Messages queued
+    /// while the session is reconnecting are sent once it has connected.
+    void
+    send(std::string msg);
+
+    /// Close the session for good. May be called from any thread.
+    void
+    stop();
+
+    executor_type const &
+    get_executor() const
+    {
+        return strand_;
+    }
+
+    session_config const &
+    config() const
+    {
+        return config_;
+    }
+
+  private:
+    friend struct session_manager;
+
+    asio::awaitable< void >
+    run();
+
+    asio::awaitable< void >
+    read_loop(websock_connection &conn);
+
+    asio::awaitable< void >
+    write_loop(websock_connection &conn);
+
+    session_shard            &shard_;
+    ssl::context             &sslctx_;
+    session_config            config_;
+    session_handlers          handlers_;
+    executor_type             strand_;
+    std::deque< std::string > outbox_;
+    wake_signal               outbox_signal_;
+    asio::cancellation_signal stop_signal_;
+    bool                      stopping_ = false;
+};
+
+/// Runs many client_sessions over a pool of single threaded io_contexts.
+/// Each session lives on a strand of one of them, chosen round robin, so that
+/// a process can keep connections busy on every core.
+struct session_manager
+{
+    explicit session_manager(
+        ssl::context &sslctx,
+        std::size_t   threads = std::thread::hardware_concurrency());
+
+    session_manager(session_manager const &) = delete;
+
+    /// Stops all sessions and waits for the threads to finish
+    ~session_manager();
+
+    std::shared_ptr< client_session >
+    open(session_config config, session_handlers handlers);
+
+    /// A consistent-enough snapshot of the totals. Cheap: one relaxed load
+    /// per counter per thread, with the traffic taken from a snapshot of the
+    /// connection metrics.
+    session_stats
+    stats() const;
+
+    /// Connection set up times, traffic and ping round trip times, totalled
+    /// over every connection the sessions have made. As cheap as stats(),
+    /// plus a load per histogram bucket per thread.
+    connection_stats
+    connection_report() const;
+
+    /// Stop every session. The threads exit once the sessions have unwound.
+    void
+    stop();
+
+    void
+    join();
+
+  private:
+    using work_guard =
+        asio::executor_work_guard< asio::io_context::executor_type >;
+
+    ssl::context                                   &sslctx_;
+    std::vector< std::unique_ptr< session_shard > > shards_;
+    std::vector< work_guard >                       work_;
+    std::atomic< std::size_t >                      next_ { 0 };
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_SESSION_MANAGER_HPP
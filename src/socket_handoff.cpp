@@ -0,0 +1,134 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "socket_handoff.hpp"
+
+#include <fmt/format.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+namespace blog
+{
+namespace
+{
+// how long a successor waits for the listeners once it has connected
+constexpr auto handoff_timeout = ::timeval { .tv_sec = 5, .tv_usec = 0 };
+
+[[noreturn]] void
+throw_errno(char const *what)
+{
+    throw system_error(error_code(errno, asio::error::get_system_category()),
+                       what);
+}
+}   // namespace
+
+void
+send_listeners(local_stream::socket &sock, listener_fds fds)
+{
+    int  payload[2] = { fds.tcp, fds.tls };
+    char tag        = 'L';
+
+    auto iov = ::iovec { .iov_base = &tag, .iov_len = 1 };
+
+    alignas(::cmsghdr) char control[CMSG_SPACE(sizeof(payload))] = {};
+
+    auto msg           = ::msghdr();
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    auto *cmsg       = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(payload));
+    std::memcpy(CMSG_DATA(cmsg), payload, sizeof(payload));
+
+    if (::sendmsg(sock.native_handle(), &msg, MSG_NOSIGNAL) != 1)
+        throw_errno("send_listeners");
+}
+
+listener_fds
+receive_listeners(local_stream::socket &sock)
+{
+    int  payload[2] = { -1, -1 };
+    char tag        = 0;
+
+    auto iov = ::iovec { .iov_base = &tag, .iov_len = 1 };
+
+    alignas(::cmsghdr) char control[CMSG_SPACE(sizeof(payload))] = {};
+
+    auto msg           = ::msghdr();
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    auto n = ::recvmsg(sock.native_handle(), &msg, MSG_CMSG_CLOEXEC);
+    if (n < 0)
+        throw_errno("receive_listeners");
+
+    auto *cmsg = CMSG_FIRSTHDR(&msg);
+    if (n != 1 || tag != 'L' || !cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(payload)))
+        throw system_error(asio::error::invalid_argument,
+                           "receive_listeners: malformed handoff");
+
+    std::memcpy(payload, CMSG_DATA(cmsg), sizeof(payload));
+    return listener_fds { .tcp = payload[0], .tls = payload[1] };
+}
+
+listener_fds
+take_over_listeners(asio::any_io_executor exec,
+                    std::string const    &path,
+                    local_stream::socket &peer)
+{
+    if (path.empty())
+        return {};
+
+    peer    = local_stream::socket(exec);
+    auto ec = error_code();
+    peer.connect(local_stream::endpoint(path), ec);
+    if (ec)
+    {
+        // nobody is running, or a stale socket file was left behind
+        peer.close();
+        return {};
+    }
+
+    // a server that accepts but never sends, because it is wedged or is not
+    // a server at all, must not keep this one from starting
+    if (::setsockopt(peer.native_handle(),
+                     SOL_SOCKET,
+                     SO_RCVTIMEO,
+                     &handoff_timeout,
+                     sizeof(handoff_timeout)) < 0)
+        throw_errno("take_over_listeners");
+
+    try
+    {
+        auto fds = receive_listeners(peer);
+        fmt::print("took over listeners from {}\n", path);
+        return fds;
+    }
+    catch (system_error &se)
+    {
+        fmt::print("handoff from {} failed, listening afresh: {}\n",
+                   path,
+                   se.code().message());
+        peer.close(ec);
+        return {};
+    }
+}
+
+}   // namespace blog
@@ -0,0 +1,49 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_SOCKET_HANDOFF_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_SOCKET_HANDOFF_HPP
+
+#include "config.hpp"
+
+#include <string>
+
+namespace blog
+{
+
+/// The listening sockets of a server, as raw file descriptors. -1 means none.
+struct listener_fds
+{
+    int tcp = -1;
+    int tls = -1;
+};
+
+/// Send both listening sockets over a connected unix socket as SCM_RIGHTS.
+/// The descriptors are duplicated into the receiving process; the sender's
+/// copies remain open.
+void
+send_listeners(local_stream::socket &sock, listener_fds fds);
+
+/// Receive the listening sockets sent by send_listeners.
+listener_fds
+receive_listeners(local_stream::socket &sock);
+
+/// If a running server is offering its listeners at path, connect to it and
+/// take them. Returns an empty listener_fds if there is nobody to take over
+/// from, or if it does not send its listeners within a few seconds, so that
+/// the caller listens afresh. The connection is returned in peer so that the
+/// caller can confirm the takeover once the listeners are in use.
+listener_fds
+take_over_listeners(asio::any_io_executor exec,
+                    std::string const    &path,
+                    local_stream::socket &peer);
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_SOCKET_HANDOFF_HPP
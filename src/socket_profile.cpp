@@ -0,0 +1,114 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "socket_profile.hpp"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace blog
+{
+namespace
+{
+// Tuning is best effort: an option the platform lacks or refuses leaves the
+// socket as it was.
+void
+set_tcp_option(int fd, int name, int value)
+{
+    ::setsockopt(fd, IPPROTO_TCP, name, &value, sizeof(value));
+}
+
+template < class Socket >
+void
+set_buffers(Socket &sock, socket_profile const &profile)
+{
+    auto ec = error_code();
+    if (profile.send_buffer > 0)
+        sock.set_option(
+            asio::socket_base::send_buffer_size(profile.send_buffer), ec);
+    if (profile.receive_buffer > 0)
+        sock.set_option(
+            asio::socket_base::receive_buffer_size(profile.receive_buffer), ec);
+}
+}   // namespace
+
+void
+listen_with(tcp::acceptor        &acceptor,
+            tcp::endpoint         ep,
+            socket_profile const &profile)
+{
+    acceptor.open(ep.protocol());
+    acceptor.set_option(asio::socket_base::reuse_address(true));
+
+    // the receive buffer has to be set before listening for the window
+    // scale offered to peers to take it into account
+    set_buffers(acceptor, profile);
+    acceptor.bind(ep);
+    tune_listener(acceptor, profile);
+    acceptor.listen(profile.backlog);
+}
+
+void
+tune_listener(tcp::acceptor &acceptor, socket_profile const &profile)
+{
+#ifdef TCP_FASTOPEN
+    if (profile.fast_open)
+        set_tcp_option(
+            acceptor.native_handle(), TCP_FASTOPEN, profile.fast_open_queue);
+#endif
+}
+
+void
+tune_connected(tcp::socket &sock, socket_profile const &profile)
+{
+    auto ec = error_code();
+    if (profile.no_delay)
+        sock.set_option(tcp::no_delay(true), ec);
+#ifdef TCP_QUICKACK
+    if (profile.quick_ack)
+        set_tcp_option(sock.native_handle(), TCP_QUICKACK, 1);
+#endif
+}
+
+asio::awaitable< void >
+connect_with(tcp::socket                       &sock,
+             tcp::resolver::results_type const &endpoints,
+             socket_profile const              &profile)
+{
+    using asio::redirect_error;
+    using asio::use_awaitable;
+
+    // asio's range connect reopens the socket for each endpoint, which would
+    // lose the options that must be set before connecting, so try each
+    // endpoint by hand
+    auto ec = error_code(asio::error::host_not_found);
+    for (auto const &entry : endpoints)
+    {
+        auto ep = entry.endpoint();
+        sock.close(ec);
+        sock.open(ep.protocol());
+        set_buffers(sock, profile);
+#ifdef TCP_FASTOPEN_CONNECT
+        // connect completes at once and the SYN waits for the first write,
+        // which it then carries
+        if (profile.fast_open)
+            set_tcp_option(sock.native_handle(), TCP_FASTOPEN_CONNECT, 1);
+#endif
+        co_await sock.async_connect(ep, redirect_error(use_awaitable, ec));
+        if (!ec)
+        {
+            tune_connected(sock, profile);
+            co_return;
+        }
+    }
+    throw system_error(ec, "connect");
+}
+
+}   // namespace blog
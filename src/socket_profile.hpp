@@ -0,0 +1,86 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_SOCKET_PROFILE_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_SOCKET_PROFILE_HPP
+
+#include "config.hpp"
+
+namespace blog
+{
+
+/// The TCP options given to every socket the server listens, accepts or
+/// connects with, and to client connections.
+///
+/// Options the platform does not support are skipped. Fast Open also has to
+/// be allowed by the kernel: on Linux, bit 1 of net.ipv4.tcp_fastopen enables
+/// it for clients and bit 2 for servers. A client's first connection to a
+/// server only fetches a cookie; later ones carry the TLS ClientHello or
+/// HTTP request in the SYN.
+struct socket_profile
+{
+    /// Send small frames immediately rather than waiting to coalesce them
+    bool no_delay = true;
+
+    /// Acknowledge at once rather than delaying, while the connection is
+    /// being set up. Linux clears the flag again once the connection has
+    /// settled, so this speeds up the handshakes rather than the session.
+    bool quick_ack = true;
+
+    /// TCP Fast Open on listeners and for outgoing connections
+    bool fast_open = true;
+
+    /// Pending Fast Open requests a listener will hold
+    int fast_open_queue = 256;
+
+    /// Socket buffer sizes in bytes. Zero leaves the system default, which
+    /// lets the kernel auto-tune them.
+    int send_buffer    = 0;
+    int receive_buffer = 0;
+
+    /// Connections waiting to be accepted
+    int backlog = asio::socket_base::max_listen_connections;
+
+    /// Plain sockets as the system creates them, for comparison
+    static socket_profile
+    system_default()
+    {
+        return socket_profile { .no_delay  = false,
+                                .quick_ack = false,
+                                .fast_open = false };
+    }
+};
+
+/// Open, bind and listen on ep with profile's options. Buffer sizes set on a
+/// listener are inherited by the sockets it accepts.
+void
+listen_with(tcp::acceptor        &acceptor,
+            tcp::endpoint         ep,
+            socket_profile const &profile);
+
+/// Apply the options that can still be changed on a listener that is already
+/// listening, such as one taken over from another process.
+void
+tune_listener(tcp::acceptor &acceptor, socket_profile const &profile);
+
+/// Apply the per connection options to a socket that has just been accepted
+/// or connected.
+void
+tune_connected(tcp::socket &sock, socket_profile const &profile);
+
+/// Connect sock to the first of endpoints that accepts, with Fast Open if the
+/// profile asks for it, then tune the connection. Throws if none accepts.
+asio::awaitable< void >
+connect_with(tcp::socket                       &sock,
+             tcp::resolver::results_type const &endpoints,
+             socket_profile const              &profile);
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_SOCKET_PROFILE_HPP
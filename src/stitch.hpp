@@ -0,0 +1,30 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_STITCH_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_STITCH_HPP
+
+#include <sstream>
+#include <string>
+
+namespace blog
+{
+
+template < class... OStreamables >
+std::string
+stitch(OStreamables &&...oss)
+{
+    std::stringstream ss;
+    ((ss << oss), ...);
+    return ss.str();
+}
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_STITCH_HPP
@@ -0,0 +1,187 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "timer_wheel.hpp"
+
+#include <algorithm>
+
+namespace blog
+{
+
+void
+timer_wheel::entry::link_before(entry &e)
+{
+    e.prev_      = prev_;
+    e.next_      = this;
+    prev_->next_ = &e;
+    prev_        = &e;
+}
+
+void
+timer_wheel::entry::unlink()
+{
+    prev_->next_ = next_;
+    next_->prev_ = prev_;
+    prev_        = this;
+    next_        = this;
+}
+
+void
+timer_wheel::entry::cancel()
+{
+    if (!armed())
+        return;
+    unlink();
+    if (wheel_)
+        --wheel_->size_;
+    wheel_ = nullptr;
+}
+
+timer_wheel::timer_wheel(asio::any_io_executor exec, clock::duration tick)
+: tick_(std::max(tick, clock::duration(1)))
+, origin_(clock::now())
+, timer_(exec)
+, alive_(std::make_shared< timer_wheel * >(this))
+{
+}
+
+timer_wheel::~timer_wheel()
+{
+    // detach the entries so that their destructors do not touch the wheel
+    for (auto &level : wheel_)
+        for (auto &head : level)
+            while (head.armed())
+            {
+                auto &e = *head.next_;
+                e.unlink();
+                e.wheel_ = nullptr;
+            }
+}
+
+std::uint64_t
+timer_wheel::current_tick() const
+{
+    return std::uint64_t((clock::now() - origin_) / tick_);
+}
+
+void
+timer_wheel::arm(entry &e, clock::duration delay)
+{
+    // while nothing is armed the wheel does not turn, so catch up with the
+    // clock now. No ticks are lost since there is nothing to fire.
+    if (!running_)
+        now_ = std::max(now_, current_tick());
+
+    e.cancel();
+
+    // the deadline is rounded up to a tick, measured from the clock rather
+    // than from now_, which lags by up to a tick. It is never the current
+    // tick, which has already fired.
+    auto due  = clock::now() - origin_ + std::max(delay, clock::duration(0));
+    auto tick = std::uint64_t((due + tick_ - clock::duration(1)) / tick_);
+    e.expiry_ = std::clamp< std::uint64_t >(tick, now_ + 1, now_ + span - 1);
+    e.wheel_  = this;
+    place(e);
+    ++size_;
+
+    if (!running_)
+    {
+        running_ = true;
+        schedule();
+    }
+}
+
+// An entry due within 64 ticks goes in level 0, indexed by its expiry tick.
+// Further out, level n holds entries due within 64^(n+1) ticks, indexed by
+// bits [6n, 6n+6) of the expiry. Each time those bits of the current tick
+// roll over, step() moves the slot's entries down to a lower level.
+void
+timer_wheel::place(entry &e)
+{
+    auto delta = e.expiry_ - now_;
+    auto level = 0;
+    while (level + 1 < levels &&
+           delta >= (std::uint64_t(1) << (slot_bits * (level + 1))))
+        ++level;
+
+    auto slot = (e.expiry_ >> (slot_bits * level)) & (slots - 1);
+    wheel_[level][slot].link_before(e);
+}
+
+void
+timer_wheel::step()
+{
+    ++now_;
+
+    for (int level = 1; level < levels; ++level)
+    {
+        auto mask = (std::uint64_t(1) << (slot_bits * level)) - 1;
+        if (now_ & mask)
+            break;
+
+        auto &head = wheel_[level][(now_ >> (slot_bits * level)) & (slots - 1)];
+        while (head.armed())
+        {
+            auto &e = *head.next_;
+            e.unlink();
+            place(e);
+        }
+    }
+
+    // move the due entries to a private list first, so that handlers can
+    // rearm or cancel any entry, including the one being called
+    auto &head = wheel_[0][now_ & (slots - 1)];
+    auto  due  = entry();
+    while (head.armed())
+    {
+        auto &e = *head.next_;
+        e.unlink();
+        due.link_before(e);
+    }
+
+    while (due.armed())
+    {
+        auto &e = *due.next_;
+        e.unlink();
+        e.wheel_ = nullptr;
+        --size_;
+        if (e.handler_)
+            e.handler_();
+    }
+}
+
+void
+timer_wheel::schedule()
+{
+    timer_.expires_at(origin_ + tick_ * (now_ + 1));
+    timer_.async_wait(
+        [this, alive = std::weak_ptr< timer_wheel * >(alive_)](error_code ec)
+        {
+            if (!ec && !alive.expired())
+                on_timer();
+        });
+}
+
+void
+timer_wheel::on_timer()
+{
+    // catch up on every tick that has passed, in case the thread was busy
+    auto target = current_tick();
+    while (now_ < target && size_)
+        step();
+
+    if (size_ == 0)
+    {
+        running_ = false;
+        return;
+    }
+    schedule();
+}
+
+}   // namespace blog
@@ -0,0 +1,156 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_TIMER_WHEEL_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_TIMER_WHEEL_HPP
+
+#include "config.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace blog
+{
+
+/// A hierarchical timing wheel: any number of coarse timers sharing a single
+/// steady_timer. Arming and cancelling are O(1) list operations, where asio's
+/// own timer queue is a heap, so it suits timers that are rearmed far more
+/// often than they fire, such as one idle timeout per connection.
+///
+/// Time advances in ticks, and a timer fires on the first tick at or after
+/// its deadline, so up to one tick late. Deadlines beyond the range of the
+/// wheel (about 19 days with the default tick) are clamped to it.
+///
+/// Like the rest of the server's state, a wheel and its entries are only
+/// touched from one thread: the one running its executor.
+struct timer_wheel
+{
+    using clock = std::chrono::steady_clock;
+
+    /// A timer which can be armed on a wheel. Its handler is set once and
+    /// called each time the entry expires. Arming an armed entry reschedules
+    /// it, and destroying one cancels it.
+    struct entry
+    {
+        explicit entry(std::function< void() > handler = {})
+        : handler_(std::move(handler))
+        {
+        }
+
+        entry(entry const &) = delete;
+
+        ~entry()
+        {
+            cancel();
+        }
+
+        void
+        set_handler(std::function< void() > handler)
+        {
+            handler_ = std::move(handler);
+        }
+
+        bool
+        armed() const
+        {
+            return next_ != this;
+        }
+
+        void
+        cancel();
+
+      private:
+        friend timer_wheel;
+
+        void
+        link_before(entry &e);
+
+        void
+        unlink();
+
+        entry                  *prev_   = this;
+        entry                  *next_   = this;
+        timer_wheel            *wheel_  = nullptr;
+        std::uint64_t           expiry_ = 0;
+        std::function< void() > handler_;
+    };
+
+    explicit timer_wheel(
+        asio::any_io_executor exec,
+        clock::duration       tick = std::chrono::milliseconds(100));
+
+    timer_wheel(timer_wheel const &) = delete;
+
+    /// Entries still armed are cancelled without being called
+    ~timer_wheel();
+
+    /// Call e's handler once delay has passed
+    void
+    arm(entry &e, clock::duration delay);
+
+    void
+    cancel(entry &e)
+    {
+        e.cancel();
+    }
+
+    /// The number of entries armed
+    std::size_t
+    size() const
+    {
+        return size_;
+    }
+
+    clock::duration
+    tick() const
+    {
+        return tick_;
+    }
+
+  private:
+    static constexpr int           slot_bits = 6;
+    static constexpr std::size_t   slots     = std::size_t(1) << slot_bits;
+    static constexpr int           levels    = 4;
+    static constexpr std::uint64_t span      = std::uint64_t(1)
+                                          << (slot_bits * levels);
+
+    std::uint64_t
+    current_tick() const;
+
+    void
+    place(entry &e);
+
+    void
+    step();
+
+    void
+    schedule();
+
+    void
+    on_timer();
+
+    clock::duration    tick_;
+    clock::time_point  origin_;
+    asio::steady_timer timer_;
+    std::uint64_t      now_     = 0;
+    std::size_t        size_    = 0;
+    bool               running_ = false;
+    entry              wheel_[levels][slots];
+
+    // lets a timer completion that was already queued when the wheel was
+    // destroyed see that it is gone
+    std::shared_ptr< timer_wheel * > alive_;
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_TIMER_WHEEL_HPP
@@ -0,0 +1,92 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "upstream_pool.hpp"
+
+#include "connect_websock.hpp"
+
+namespace blog
+{
+
+namespace
+{
+// a refill's connection attempt, which keeps the TLS context alive until it
+// is done, however long the pool lasts
+asio::awaitable< std::unique_ptr< websock_connection > >
+connect_spare(std::shared_ptr< ssl::context > sslctx, std::string url)
+{
+    co_return co_await connect_websock(*sslctx, url, 5, false);
+}
+}   // namespace
+
+upstream_pool::upstream_pool(asio::any_io_executor exec, std::size_t spares)
+: exec_(exec)
+, sslctx_(std::make_shared< ssl::context >(ssl::context::tls_client))
+, spares_(spares)
+, alive_(std::make_shared< upstream_pool * >(this))
+{
+}
+
+asio::awaitable< std::unique_ptr< websock_connection > >
+upstream_pool::acquire(std::string const &url)
+{
+    auto &b = backends_[url];
+
+    // a spare whose socket has been closed under it is of no use
+    while (!b.idle.empty() && !b.idle.front()->is_open())
+        b.idle.pop_front();
+
+    auto conn = std::unique_ptr< websock_connection >();
+    if (!b.idle.empty())
+    {
+        conn = std::move(b.idle.front());
+        b.idle.pop_front();
+        ++stats_.hits;
+    }
+    refill(url, b);
+
+    if (!conn)
+    {
+        ++stats_.misses;
+        conn = co_await connect_websock(*sslctx_, url, 5, false);
+    }
+    co_return conn;
+}
+
+void
+upstream_pool::refill(std::string const &url, backend &b)
+{
+    // A refill can outlast the pool, so it shares the TLS context rather
+    // than borrowing it, and its completion handler holds a weak token
+    // rather than this. A connection made after the pool is destroyed is
+    // closed as the handler drops it.
+    for (; b.idle.size() + b.connecting < spares_; ++b.connecting)
+        asio::co_spawn(
+            exec_,
+            connect_spare(sslctx_, url),
+            [url,
+             alive = std::weak_ptr< upstream_pool * >(alive_)](
+                std::exception_ptr                    ep,
+                std::unique_ptr< websock_connection > conn)
+            {
+                auto lock = alive.lock();
+                if (!lock)
+                    return;
+
+                auto &self = **lock;
+                auto &b    = self.backends_[url];
+                --b.connecting;
+                if (ep)
+                    ++self.stats_.failed;
+                else
+                    b.idle.push_back(std::move(conn));
+            });
+}
+
+}   // namespace blog
@@ -0,0 +1,83 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_UPSTREAM_POOL_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_UPSTREAM_POOL_HPP
+
+#include "config.hpp"
+#include "websock_connection.hpp"
+
+#include <boost/describe.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace blog
+{
+
+struct upstream_stats
+{
+    std::uint64_t hits   = 0;   // served from a spare connection
+    std::uint64_t misses = 0;   // had to wait for a new connection
+    std::uint64_t failed = 0;   // spares that could not be connected
+};
+
+BOOST_DESCRIBE_STRUCT(upstream_stats, (), (hits, misses, failed))
+
+/// Websocket connections to backends, made ahead of time.
+///
+/// A websocket session cannot be shared or reused once its client has gone,
+/// so the pool keeps a few spare connections per backend url, already past
+/// their TCP, TLS and websocket handshakes. Handing one to a new client takes
+/// the backend's round trips off the client's upgrade, and each connection
+/// taken is replaced in the background.
+///
+/// A spare is not read from while it waits, so a backend that pings idle
+/// connections may drop it; a proxy that is busy enough to benefit from
+/// the pool turns its spares over long before that.
+///
+/// Not thread safe: use on the server's executor.
+struct upstream_pool
+{
+    upstream_pool(asio::any_io_executor exec, std::size_t spares);
+
+    /// A connected websocket to url, from the pool if one is ready
+    asio::awaitable< std::unique_ptr< websock_connection > >
+    acquire(std::string const &url);
+
+    upstream_stats const &
+    stats() const
+    {
+        return stats_;
+    }
+
+  private:
+    struct backend
+    {
+        std::deque< std::unique_ptr< websock_connection > > idle;
+        std::size_t                                         connecting = 0;
+    };
+
+    void
+    refill(std::string const &url, backend &b);
+
+    asio::any_io_executor                      exec_;
+    std::shared_ptr< ssl::context >            sslctx_;
+    std::size_t                                spares_;
+    std::unordered_map< std::string, backend > backends_;
+    upstream_stats                             stats_;
+    std::shared_ptr< upstream_pool * >         alive_;
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_UPSTREAM_POOL_HPP
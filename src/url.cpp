@@ -14,6 +14,8 @@
 
 #include <boost/algorithm/string.hpp>
 
+#include <cctype>
+#include <optional>
 #include <regex>
 
 namespace blog
@@ -91,6 +93,66 @@ build_target(std::string const &path,
     return result;
 }
 
+std::string
+percent_decode(std::string const &s)
+{
+    auto hex = [](char c) -> int
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    };
+
+    std::string result;
+    for (std::size_t i = 0; i < s.size(); ++i)
+    {
+        if (s[i] != '%')
+        {
+            result += s[i];
+            continue;
+        }
+
+        auto hi = i + 2 < s.size() ? hex(s[i + 1]) : -1;
+        auto lo = hi >= 0 ? hex(s[i + 2]) : -1;
+        if (lo < 0)
+            throw system_error(asio::error::invalid_argument,
+                               "invalid percent encoding");
+        result += char(hi * 16 + lo);
+        i += 2;
+    }
+    return result;
+}
+
+// A url whose authority is a unix domain socket, or nullopt if url is not one
+std::optional< url_parts >
+decode_local_url(std::string const &url)
+{
+    using boost::algorithm::iequals;
+
+    static auto local_regex = std::regex(
+        R"regex((ws|wss)\+unix://([^/ ?#]+)(/?[^ #?]*)\x3f?([^ #]*)#?([^ ]*))regex",
+        std::regex_constants::icase);
+    auto match = std::smatch();
+    if (not std::regex_match(url, match, local_regex))
+        return std::nullopt;
+
+    auto &protocol = match[1];
+    auto &path     = match[3];
+    auto &query    = match[4];
+    auto &fragment = match[5];
+
+    return url_parts { .hostname  = "localhost",
+                       .service   = percent_decode(match[2]),
+                       .path_etc  = build_target(path, query, fragment),
+                       .transport = iequals(protocol.str(), "wss")
+                                        ? transport_type::local_tls
+                                        : transport_type::local };
+}
+
 }   // namespace
 
 url_parts
@@ -103,6 +165,9 @@ decode_url(std::string const &url)
     // username/password prefex on the authority (which you should not be using
     // anyway)
     //
+    if (auto local = decode_local_url(url))
+        return *std::move(local);
+
     static auto url_regex = std::regex(
         R"regex((ws|wss|http|https)://([^/ :]+):?([^/ ]*)(/?[^ #?]*)\x3f?([^ #]*)#?([^ ]*))regex",
         std::regex_constants::icase);
@@ -123,6 +188,22 @@ decode_url(std::string const &url)
                        .transport = deduce_transport(protocol, port_ind) };
 }
 
+std::string
+local_root(std::string const &path, bool tls)
+{
+    // everything but the unreserved characters is encoded, so that the path
+    // cannot be mistaken for the start of the target
+    auto result = std::string(tls ? "wss+unix://" : "ws+unix://");
+    for (unsigned char c : path)
+    {
+        if (std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~')
+            result += char(c);
+        else
+            result += fmt::format("%{:02X}", c);
+    }
+    return result;
+}
+
 std::ostream &
 operator<<(std::ostream &os, transport_type tt)
 {
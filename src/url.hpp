@@ -18,16 +18,34 @@
 namespace blog
 {
 
+/// How a url is reached. The local transports connect to a unix domain
+/// socket rather than over TCP, with or without TLS.
 enum class transport_type
 {
     tcp,
-    tls
+    tls,
+    local,
+    local_tls
 };
 std::ostream &
 operator<<(std::ostream &, transport_type);
 
-BOOST_DESCRIBE_ENUM(transport_type, tcp, tls)
+BOOST_DESCRIBE_ENUM(transport_type, tcp, tls, local, local_tls)
 
+inline bool
+is_tls(transport_type tt)
+{
+    return tt == transport_type::tls || tt == transport_type::local_tls;
+}
+
+inline bool
+is_local(transport_type tt)
+{
+    return tt == transport_type::local || tt == transport_type::local_tls;
+}
+
+/// For a local transport, service is the path of the socket and hostname is
+/// "localhost", which is what the Host header and SNI are given.
 struct url_parts
 {
     std::string    hostname;
@@ -40,10 +58,19 @@ BOOST_DESCRIBE_STRUCT(url_parts, (), (hostname, service, path_etc, transport))
 std::ostream &
 operator<<(std::ostream &, const url_parts &);
 
-/// decode a url into component parts that we can use
+/// decode a url into component parts that we can use.
+///
+/// Besides ws, wss, http and https urls, this understands ws+unix and
+/// wss+unix, whose authority is the percent-encoded path of a unix domain
+/// socket, for example ws+unix://%2Frun%2Fapp.sock/websocket-4
 url_parts
 decode_url(std::string const &url);
 
+/// The root url of a websocket server listening on the unix domain socket at
+/// path, to which a target may be appended as for any other root
+std::string
+local_root(std::string const &path, bool tls);
+
 }   // namespace blog
 
 #endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_URL_HPP
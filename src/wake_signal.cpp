@@ -0,0 +1,47 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "wake_signal.hpp"
+
+namespace blog
+{
+
+wake_signal::wake_signal(asio::any_io_executor exec)
+: timer_(exec, asio::steady_timer::time_point::max())
+{
+}
+
+asio::awaitable< void >
+wake_signal::wait()
+{
+    using asio::redirect_error;
+    using asio::use_awaitable;
+
+    waiting_ = true;
+    timer_.expires_at(asio::steady_timer::time_point::max());
+    auto ec = error_code();
+    co_await timer_.async_wait(redirect_error(use_awaitable, ec));
+    waiting_ = false;
+
+    // a wakeup arrives as operation_aborted, so the only way to tell it from
+    // a cancellation of this coroutine is the state itself
+    if (auto cs = co_await asio::this_coro::cancellation_state;
+        cs.cancelled() != asio::cancellation_type::none)
+        throw system_error(asio::error::operation_aborted);
+}
+
+void
+wake_signal::wake()
+{
+    // only pay for the wakeup if the waiter is actually asleep
+    if (waiting_)
+        timer_.cancel();
+}
+
+}   // namespace blog
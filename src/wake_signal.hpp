@@ -0,0 +1,53 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_WAKE_SIGNAL_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_WAKE_SIGNAL_HPP
+
+#include "config.hpp"
+
+namespace blog
+{
+
+/// Lets one coroutine sleep until another on the same executor has work for
+/// it.
+///
+/// The sleeper waits on a timer that never expires, and a wakeup cancels the
+/// wait. Waking nobody costs nothing, so the waker need not know whether the
+/// other side is asleep. The waiter rechecks its own condition on waking,
+/// since a wakeup carries no state.
+///
+/// Not thread safe. Both sides must run on the signal's executor.
+struct wake_signal
+{
+    explicit wake_signal(asio::any_io_executor exec);
+
+    /// Sleep until wake() is called. Throws operation_aborted if the calling
+    /// coroutine is cancelled instead.
+    asio::awaitable< void >
+    wait();
+
+    /// Wake the waiter, if there is one
+    void
+    wake();
+
+    bool
+    waiting() const
+    {
+        return waiting_;
+    }
+
+  private:
+    asio::steady_timer timer_;
+    bool               waiting_ = false;
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_WAKE_SIGNAL_HPP
@@ -9,6 +9,8 @@
 
 #include "websock_connection.hpp"
 
+#include "mapped_file.hpp"
+
 namespace blog
 {
 namespace
@@ -26,14 +28,26 @@ overloaded(Ts...) -> overloaded< Ts... >;
 asio::awaitable< std::string >
 websock_connection::receive_text()
 {
-    using asio::use_awaitable;
+    auto result = co_await visit(
+        [&](auto &ws) { return read_text(ws, rxbuffer_); }, var_);
+    if (keepalive_)
+        keepalive_->activity();
+    tap_.received(opcode_of(got_text()), asio::buffer(result));
+    if (metrics_)
+        metrics_->on_message_in(result.size());
+    co_return result;
+}
 
-    auto rxsize = co_await visit(
-        [&](auto &ws) { return ws.async_read(rxbuffer_, use_awaitable); },
-        var_);
-    auto is_text = visit([](auto &ws) { return ws.got_text(); }, var_);
-    auto result  = beast::buffers_to_string(rxbuffer_.data());
-    rxbuffer_.consume(rxsize);
+asio::awaitable< std::string_view >
+websock_connection::receive_view()
+{
+    auto result = co_await visit(
+        [&](auto &ws) { return read_view(ws, rxbuffer_); }, var_);
+    if (keepalive_)
+        keepalive_->activity();
+    tap_.received(opcode_of(got_text()), asio::buffer(result));
+    if (metrics_)
+        metrics_->on_message_in(result.size());
     co_return result;
 }
 
@@ -42,13 +56,42 @@ websock_connection::send_text(std::string const &msg)
 {
     using asio::use_awaitable;
 
-    return visit(
+    auto n = co_await visit(
         [&](auto &ws)
         {
             ws.text();
             return ws.async_write(asio::buffer(msg), use_awaitable);
         },
         var_);
+    tap_.sent(frame_opcode::text, asio::buffer(msg));
+    if (metrics_)
+        metrics_->on_message_out(msg.size());
+    co_return n;
+}
+
+asio::awaitable< std::size_t >
+websock_connection::send_file(std::string path,
+                              bool        text,
+                              std::size_t fragment_size)
+{
+    auto file = mapped_file(path);
+    auto n    = co_await visit(
+        [&](auto &ws)
+        {
+            return write_fragmented(ws,
+                                    file.buffer(),
+                                    text,
+                                    fragment_size,
+                                    [&file](std::size_t sent)
+                                    { file.release_prefix(sent); });
+        },
+        var_);
+
+    // recording reads back the pages that were released as they were sent
+    tap_.sent(opcode_of(text), file.buffer());
+    if (metrics_)
+        metrics_->on_message_out(file.size());
+    co_return n;
 }
 
 asio::awaitable< void >
@@ -56,28 +99,105 @@ websock_connection::close(beast::websocket::close_reason const &reason)
 {
     using asio::use_awaitable;
 
-    return visit(
+    co_await visit(
         [&](auto &ws) { return ws.async_close(reason, use_awaitable); }, var_);
+    tap_.sent(frame_opcode::close,
+              asio::buffer(reason.reason.data(), reason.reason.size()));
+}
+
+void
+websock_connection::start_keepalive(timer_wheel      &wheel,
+                                    keepalive_options options)
+{
+    keepalive_.reset();
+    keepalive_ = std::make_unique< keepalive >(wheel, options, ping_stats_);
+    if (metrics_)
+        keepalive_->on_rtt([m = metrics_](auto rtt) { m->on_rtt(rtt); });
+    visit([&](auto &ws) { keepalive_->attach(ws); }, var_);
+}
+
+void
+websock_connection::report_to(connection_metrics &metrics)
+{
+    metrics_ = &metrics;
+    metrics_->on_open(timings_);
+    if (keepalive_)
+        keepalive_->on_rtt([m = metrics_](auto rtt) { m->on_rtt(rtt); });
+}
+
+bool
+websock_connection::got_text() const
+{
+    return visit([](auto const &ws) { return ws.got_text(); }, var_);
 }
 
 tcp::socket &
 websock_connection::sock()
 {
-    return visit(overloaded { [](ws_stream &ws) -> tcp::socket &
-                              { return ws.next_layer(); },
-                              [](wss_stream &wss) -> tcp::socket &
-                              { return wss.next_layer().next_layer(); } },
-                 var_);
+    return visit(
+        overloaded { [](ws_stream &ws) -> tcp::socket &
+                     { return ws.next_layer(); },
+                     [](wss_stream &wss) -> tcp::socket &
+                     { return wss.next_layer().next_layer(); },
+                     [](h2_websocket &h2) -> tcp::socket &
+                     { return h2.session().socket(); },
+                     [](auto &) -> tcp::socket &
+                     {
+                         throw system_error(
+                             asio::error::operation_not_supported,
+                             "not a tcp connection");
+                     } },
+        var_);
+}
+
+local_stream::socket &
+websock_connection::local_sock()
+{
+    return visit(
+        overloaded { [](local_ws_stream &ws) -> local_stream::socket &
+                     { return ws.next_layer(); },
+                     [](local_wss_stream &wss) -> local_stream::socket &
+                     { return wss.next_layer().next_layer(); },
+                     [](auto &) -> local_stream::socket &
+                     {
+                         throw system_error(
+                             asio::error::operation_not_supported,
+                             "not a unix domain connection");
+                     } },
+        var_);
+}
+
+bool
+websock_connection::is_open()
+{
+    return visit(
+        overloaded { [](h2_websocket &h2)
+                     { return h2.session().socket().is_open(); },
+                     [](auto &ws)
+                     { return beast::get_lowest_layer(ws).is_open(); } },
+        var_);
 }
 
 ssl::stream< tcp::socket > *
 websock_connection::query_ssl()
 {
     return visit(
-        overloaded { [](ws_stream &ws) -> ssl::stream< tcp::socket > *
-                     { return nullptr; },
-                     [](wss_stream &wss) -> ssl::stream< tcp::socket > *
-                     { return &wss.next_layer(); } },
+        overloaded { [](wss_stream &wss) -> ssl::stream< tcp::socket > *
+                     { return &wss.next_layer(); },
+                     [](auto &) -> ssl::stream< tcp::socket > *
+                     { return nullptr; } },
+        var_);
+}
+
+ssl::stream< local_stream::socket > *
+websock_connection::query_local_ssl()
+{
+    return visit(
+        overloaded {
+            [](local_wss_stream &wss) -> ssl::stream< local_stream::socket > *
+            { return &wss.next_layer(); },
+            [](auto &) -> ssl::stream< local_stream::socket > *
+            { return nullptr; } },
         var_);
 }
 
@@ -11,17 +11,103 @@
 #define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_WEBSOCK_CONNECTION_HPP
 
 #include "config.hpp"
+#include "connection_stats.hpp"
+#include "h2_websocket.hpp"
+#include "keepalive.hpp"
+#include "session_log.hpp"
 
 #include <boost/variant2.hpp>
 
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
 namespace blog
 {
 
+/// Read the next message from ws and return a copy of it. This is the body of
+/// websock_connection::receive_text, usable on any websocket stream type.
+template < class WebSocketStream >
+asio::awaitable< std::string >
+read_text(WebSocketStream &ws, beast::flat_buffer &rxbuf)
+{
+    using asio::use_awaitable;
+
+    auto rxsize = co_await ws.async_read(rxbuf, use_awaitable);
+    auto result = beast::buffers_to_string(rxbuf.data());
+    rxbuf.consume(rxsize);
+    co_return result;
+}
+
+/// Read the next message from ws into rxbuf and return a view of it, valid
+/// until rxbuf is next modified. This is the body of
+/// websock_connection::receive_view.
+template < class WebSocketStream >
+asio::awaitable< std::string_view >
+read_view(WebSocketStream &ws, beast::flat_buffer &rxbuf)
+{
+    using asio::use_awaitable;
+
+    rxbuf.clear();
+    auto rxsize = co_await ws.async_read(rxbuf, use_awaitable);
+    auto data   = rxbuf.cdata();
+    co_return std::string_view(static_cast< char const * >(data.data()),
+                               rxsize);
+}
+
+/// Write buffers to ws as a single message made of frames whose payloads are
+/// at most fragment_size bytes. Frames are written straight from the buffers,
+/// which must remain valid until the write completes. After each frame,
+/// on_progress is called with the number of payload bytes sent so far.
+template < class WebSocketStream, class ConstBufferSequence, class OnProgress >
+asio::awaitable< std::size_t >
+write_fragmented(WebSocketStream    &ws,
+                 ConstBufferSequence buffers,
+                 bool                text,
+                 std::size_t         fragment_size,
+                 OnProgress          on_progress)
+{
+    using asio::use_awaitable;
+
+    using suffix = beast::buffers_suffix< ConstBufferSequence >;
+
+    auto const total     = beast::buffer_bytes(buffers);
+    auto       remaining = suffix(buffers);
+    auto       sent      = std::size_t(0);
+
+    fragment_size = std::max< std::size_t >(fragment_size, 1);
+    ws.text(text);
+    for (;;)
+    {
+        auto n   = std::min(fragment_size, total - sent);
+        auto fin = sent + n == total;
+        co_await ws.async_write_some(
+            fin, beast::buffers_prefix(n, remaining), use_awaitable);
+        remaining.consume(n);
+        sent += n;
+        on_progress(sent);
+        if (fin)
+            break;
+    }
+    co_return sent;
+}
+
 struct websock_connection
 {
+    static constexpr std::size_t default_fragment_size = 64 * 1024;
+
     using ws_stream  = beast::websocket::stream< tcp::socket >;
     using wss_stream = beast::websocket::stream< ssl::stream< tcp::socket > >;
-    using var_type   = boost::variant2::variant< ws_stream, wss_stream >;
+    using local_ws_stream = beast::websocket::stream< local_stream::socket >;
+    using local_wss_stream =
+        beast::websocket::stream< ssl::stream< local_stream::socket > >;
+    using var_type = boost::variant2::variant< ws_stream,
+                                               wss_stream,
+                                               h2_websocket,
+                                               local_ws_stream,
+                                               local_wss_stream >;
 
     websock_connection(tcp::socket sock)
     : var_(ws_stream(std::move(sock)))
@@ -33,12 +119,47 @@ struct websock_connection
     {
     }
 
+    /// A websocket on a stream of a shared HTTP/2 connection
+    websock_connection(h2_websocket ws)
+    : var_(std::move(ws))
+    {
+    }
+
+    /// A websocket over a unix domain socket, for a client on the same host
+    websock_connection(local_stream::socket sock)
+    : var_(local_ws_stream(std::move(sock)))
+    {
+    }
+
+    websock_connection(ssl::stream< local_stream::socket > stream)
+    : var_(local_wss_stream(std::move(stream)))
+    {
+    }
+
+    /// The socket carrying the connection, which for HTTP/2 is shared with
+    /// the other websockets on it. Throws if the connection is over a unix
+    /// domain socket.
     tcp::socket &
     sock();
 
+    /// The unix domain socket carrying the connection. Throws if the
+    /// connection is over TCP.
+    local_stream::socket &
+    local_sock();
+
+    /// Whether the underlying socket is still open
+    bool
+    is_open();
+
+    /// The TLS stream to handshake before the websocket handshake, or null
+    /// if there is none or it is not this connection's alone
     ssl::stream< tcp::socket > *
     query_ssl();
 
+    /// As query_ssl, for a connection over a unix domain socket
+    ssl::stream< local_stream::socket > *
+    query_local_ssl();
+
     asio::awaitable< void >
     try_handshake(error_code                      &ec,
                   beast::websocket::response_type &response,
@@ -48,14 +169,95 @@ struct websock_connection
     asio::awaitable< std::size_t >
     send_text(std::string const &msg);
 
+    /// Send a sequence of buffers as one message, fragmented into frames of
+    /// at most fragment_size bytes, without gathering it into a string first.
+    /// The buffers must remain valid until the send completes.
+    template < class ConstBufferSequence >
+    asio::awaitable< std::size_t >
+    send_buffers(ConstBufferSequence const &buffers,
+                 bool                       text = false,
+                 std::size_t fragment_size       = default_fragment_size)
+    {
+        auto n = co_await visit(
+            [&](auto &ws)
+            {
+                return write_fragmented(
+                    ws, buffers, text, fragment_size, [](std::size_t) {});
+            },
+            var_);
+        tap_.sent(opcode_of(text), buffers);
+        if (metrics_)
+            metrics_->on_message_out(beast::buffer_bytes(buffers));
+        co_return n;
+    }
+
+    /// Send the contents of a file as one message, fragmented into frames of
+    /// at most fragment_size bytes. The file is memory mapped and sent in
+    /// place, and pages are released as they are sent, so memory use does not
+    /// grow with the size of the file.
+    asio::awaitable< std::size_t >
+    send_file(std::string path,
+              bool        text          = false,
+              std::size_t fragment_size = default_fragment_size);
+
     asio::awaitable< std::string >
     receive_text();
 
+    /// Whether the last message received was text rather than binary
+    bool
+    got_text() const;
+
+    /// Receive the next message into rxbuffer_ and return a view of it rather
+    /// than a copy. The view is valid until the next receive.
+    asio::awaitable< std::string_view >
+    receive_view();
+
     asio::awaitable< void >
     close(beast::websocket::close_reason const &reason);
 
-    var_type           var_;
-    beast::flat_buffer rxbuffer_;
+    /// Ping the server whenever the connection has been quiet for
+    /// options.ping_interval, and close it if a pong does not follow. Pongs
+    /// are only seen during a receive, so keep one outstanding. The wheel
+    /// must run on the thread that uses this connection.
+    void
+    start_keepalive(timer_wheel &wheel, keepalive_options options = {});
+
+    keepalive_stats const &
+    ping_stats() const
+    {
+        return ping_stats_;
+    }
+
+    /// How long connect_websock took to open this connection
+    connect_timings const &
+    timings() const
+    {
+        return timings_;
+    }
+
+    /// Count this connection's opening, its messages and bytes, and the
+    /// round trip time of its keepalive pings in metrics, from now on.
+    /// metrics may be shared by connections on the same thread, to total
+    /// them, and must outlive the connection.
+    void
+    report_to(connection_metrics &metrics);
+
+    /// Record every message sent and received from now on, and the close,
+    /// as a new session in recorder's log. The recorder must outlive the
+    /// connection.
+    void
+    record_to(session_recorder &recorder)
+    {
+        tap_ = session_tap(&recorder);
+    }
+
+    var_type                     var_;
+    beast::flat_buffer           rxbuffer_;
+    keepalive_stats              ping_stats_;
+    std::unique_ptr< keepalive > keepalive_;
+    session_tap                  tap_;
+    connect_timings              timings_;
+    connection_metrics          *metrics_ = nullptr;
 };
 
 }   // namespace blog
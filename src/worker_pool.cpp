@@ -0,0 +1,96 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#include "worker_pool.hpp"
+
+#include <algorithm>
+
+namespace blog
+{
+
+worker_pool::worker_pool(std::size_t threads)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    for (std::size_t i = 0; i < threads; ++i)
+        workers_.push_back(std::make_unique< worker >());
+}
+
+worker_pool::~worker_pool()
+{
+    if (!running_)
+        return;
+
+    // the stop marker is queued behind any outstanding messages, so they
+    // are still handled and their results delivered
+    for (std::size_t i = 0; i < workers_.size(); ++i)
+        submit(i, &workers_[i]->stop);
+    for (auto &w : workers_)
+        w->thread.join();
+}
+
+void
+worker_pool::submit(std::size_t i, job *j)
+{
+    std::call_once(started_,
+                   [this]
+                   {
+                       for (auto &w : workers_)
+                           w->thread = std::thread([this, &w] { run(*w); });
+                       running_ = true;
+                   });
+
+    auto &w = *workers_[i % workers_.size()];
+    w.queue.push(j);
+
+    // the worker only sleeps when its depth is zero, so only the push that
+    // ends that needs to wake it
+    if (w.depth.fetch_add(1, std::memory_order_release) == 0)
+        w.depth.notify_one();
+}
+
+void
+worker_pool::run(worker &w)
+{
+    for (;;)
+    {
+        if (w.depth.load(std::memory_order_acquire) == 0)
+        {
+            w.depth.wait(0, std::memory_order_acquire);
+            continue;
+        }
+
+        auto *n = w.queue.pop();
+        if (!n)
+        {
+            // a push is half way through
+            std::this_thread::yield();
+            continue;
+        }
+        w.depth.fetch_sub(1, std::memory_order_relaxed);
+
+        auto *j = static_cast< job * >(n);
+        if (!j->handler)
+            return;
+
+        auto ep    = std::exception_ptr();
+        auto reply = false;
+        try
+        {
+            reply = j->handler->handle_offloaded(*j->message, j->queued_at);
+        }
+        catch (...)
+        {
+            ep = std::current_exception();
+        }
+        j->complete(j, ep, reply);
+    }
+}
+
+}   // namespace blog
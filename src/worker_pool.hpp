@@ -0,0 +1,154 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+#ifndef BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_WORKER_POOL_HPP
+#define BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_WORKER_POOL_HPP
+
+#include "config.hpp"
+#include "message_handler.hpp"
+#include "mpsc_queue.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace blog
+{
+
+/// Threads on which message handlers run, away from the I/O threads.
+///
+/// Each worker has its own lock free queue, into which any thread may post,
+/// and sleeps on its queue depth when it has nothing to do. A connection is
+/// assigned one worker for its lifetime, so its messages are handled in the
+/// order they arrived. The result of each message is posted back to the
+/// executor of the operation that sent it, which keeps that executor's
+/// io_context running while the message is out.
+///
+/// The threads are started when the first message is offloaded, so a server
+/// whose handlers all run inline never starts them.
+struct worker_pool
+{
+    using clock = registered_handler::clock;
+
+    /// threads workers, or one per hardware thread if threads is zero
+    explicit worker_pool(std::size_t threads);
+
+    worker_pool(worker_pool const &) = delete;
+
+    worker_pool &
+    operator=(worker_pool const &) = delete;
+
+    /// Finishes the messages already queued, then stops the workers
+    ~worker_pool();
+
+    std::size_t
+    size() const
+    {
+        return workers_.size();
+    }
+
+    /// The worker for a new connection
+    std::size_t
+    assign()
+    {
+        return next_.fetch_add(1, std::memory_order_relaxed) % size();
+    }
+
+    /// Run h's handler on m on the given worker. Completes with the
+    /// signature void(std::exception_ptr, bool), the bool being the handler's
+    /// result. m must remain valid until then.
+    template < class CompletionToken >
+    auto
+    async_offload(std::size_t         worker,
+                  registered_handler &h,
+                  ws_message         &m,
+                  CompletionToken   &&token)
+    {
+        return asio::async_initiate< CompletionToken,
+                                     void(std::exception_ptr, bool) >(
+            [this, worker, &h, &m](auto handler)
+            {
+                using handler_type = std::decay_t< decltype(handler) >;
+                auto *j = new job_impl< handler_type >(std::move(handler));
+                j->handler   = &h;
+                j->message   = &m;
+                j->queued_at = clock::now();
+                h.on_queued();
+                submit(worker, j);
+            },
+            token);
+    }
+
+  private:
+    // A queued message. A job without a handler tells the worker to stop.
+    struct job : mpsc_node
+    {
+        registered_handler *handler = nullptr;
+        ws_message         *message = nullptr;
+        clock::time_point   queued_at;
+
+        // deliver the result and destroy the job
+        void (*complete)(job *, std::exception_ptr, bool) = nullptr;
+    };
+
+    template < class Handler >
+    struct job_impl final : job
+    {
+        explicit job_impl(Handler h)
+        : completion(std::move(h))
+        , work(asio::prefer(asio::get_associated_executor(completion),
+                            asio::execution::outstanding_work.tracked))
+        {
+            this->complete = &deliver;
+        }
+
+        static void
+        deliver(job *base, std::exception_ptr ep, bool reply)
+        {
+            auto *self = static_cast< job_impl * >(base);
+            auto  h    = std::move(self->completion);
+            auto  ex   = std::move(self->work);
+            delete self;
+            asio::post(ex,
+                       [h = std::move(h), ep, reply]() mutable
+                       { std::move(h)(ep, reply); });
+        }
+
+        Handler               completion;
+        asio::any_io_executor work;
+    };
+
+    struct worker
+    {
+        mpsc_queue                   queue;
+        std::atomic< std::uint32_t > depth { 0 };
+        job                          stop;
+        std::thread                  thread;
+    };
+
+    void
+    submit(std::size_t i, job *j);
+
+    void
+    run(worker &w);
+
+    std::vector< std::unique_ptr< worker > > workers_;
+    std::once_flag                           started_;
+    bool                                     running_ = false;
+    std::atomic< std::size_t >               next_ { 0 };
+};
+
+}   // namespace blog
+
+#endif   // BLOG_2022_AUG_WEBSOCK_REDIRECT_SRC_WORKER_POOL_HPP
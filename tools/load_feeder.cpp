@@ -0,0 +1,175 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+// Publish a backend's load in a load table on its behalf, for a backend that
+// does not publish its own, or to try out a redirecting server's choices.
+//
+//   load_feeder <table> <root> [options]
+//
+//   --active N          connections the backend is serving (default 0)
+//   --handshake-us N    its TLS handshake time, in microseconds (default 0,
+//                       for none measured)
+//   --interval MS       heartbeat period (default 1000)
+//   --once              publish once and exit, leaving the backend to go
+//                       stale
+//
+//   load_feeder <table> --show
+//
+// prints the load of every backend in the table.
+//
+// The feeder claims the backend's slot, or takes it over, and beats its
+// heart until it is killed. A later publisher for the same root takes the
+// slot over in turn, after which the feeder's writes are ignored.
+
+#include "load_table.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace
+{
+using namespace blog;
+
+// as server_options::load_stale
+constexpr auto stale_after = std::chrono::seconds(3);
+
+struct feeder_options
+{
+    std::string               table;
+    std::string               root;
+    std::uint32_t             active = 0;
+    std::chrono::microseconds handshake { 0 };
+    std::chrono::milliseconds interval { 1000 };
+    bool                      once = false;
+    bool                      show = false;
+};
+
+void
+usage()
+{
+    fmt::print(stderr,
+               "usage: load_feeder <table> <root> [--active N]\n"
+               "                   [--handshake-us N] [--interval MS] "
+               "[--once]\n"
+               "       load_feeder <table> --show\n");
+}
+
+bool
+parse(int argc, char **argv, feeder_options &options)
+{
+    auto positional = std::vector< std::string >();
+    for (int i = 1; i < argc; ++i)
+    {
+        auto arg = std::string_view(argv[i]);
+        if (!arg.starts_with("--"))
+        {
+            positional.emplace_back(arg);
+            continue;
+        }
+        if (arg == "--once")
+        {
+            options.once = true;
+            continue;
+        }
+        if (arg == "--show")
+        {
+            options.show = true;
+            continue;
+        }
+        if (i + 1 == argc)
+            return false;
+
+        auto value = std::string(argv[++i]);
+        if (arg == "--active")
+            options.active = std::uint32_t(std::stoul(value));
+        else if (arg == "--handshake-us")
+            options.handshake = std::chrono::microseconds(std::stol(value));
+        else if (arg == "--interval")
+            options.interval = std::chrono::milliseconds(
+                std::max(std::stol(value), 1l));
+        else
+            return false;
+    }
+    if (positional.size() != (options.show ? 1 : 2))
+        return false;
+
+    options.table = positional[0];
+    if (!options.show)
+        options.root = positional[1];
+    return true;
+}
+
+void
+show(load_table const &table)
+{
+    for (auto &b : table.snapshot(stale_after))
+        fmt::print("{:<40} active {:>6}  pending {:>4}  handshake {:>6}us{}\n",
+                   b.root,
+                   b.active,
+                   b.pending,
+                   b.handshake.count(),
+                   b.live ? "" : "  (stale)");
+}
+
+}   // namespace
+
+int
+main(int argc, char **argv)
+{
+    using namespace blog;
+
+    auto options = feeder_options();
+    try
+    {
+        if (!parse(argc, argv, options))
+        {
+            usage();
+            return 1;
+        }
+    }
+    catch (std::exception &)
+    {
+        usage();
+        return 1;
+    }
+
+    try
+    {
+        auto table = load_table(options.table);
+        if (options.show)
+        {
+            show(table);
+            return 0;
+        }
+
+        auto lease = table.register_backend(options.root, stale_after);
+        for (;;)
+        {
+            if (options.handshake.count())
+                table.record_handshake(lease, options.handshake);
+            table.heartbeat(lease);
+            table.set_active(lease, options.active);
+            if (options.once)
+                return 0;
+            std::this_thread::sleep_for(options.interval);
+        }
+    }
+    catch (std::exception &e)
+    {
+        fmt::print(stderr, "load_feeder: {}\n", e.what());
+        return 1;
+    }
+}
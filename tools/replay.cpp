@@ -0,0 +1,356 @@
+//
+// Copyright (c) 2022 Richard Hodges (hodges.r@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/madmongo1/router
+//
+
+// Replay the sessions in a session log against a server, and report how
+// quickly it answered.
+//
+//   replay <log> <url> [options]
+//
+//   --connections N     sessions replayed at once (default 16)
+//   --threads N         threads, each with its own connections (default 1)
+//   --speed X           1 keeps the recorded gaps between messages, 2 halves
+//                       them; 0 sends each message as soon as the last has
+//                       gone (default 1)
+//   --replay received   send the messages the recorder received, as in a
+//                       log recorded by the server (the default)
+//   --replay sent       send the messages the recorder sent, as in a log
+//                       recorded by a websock_connection
+//
+// Every recorded session is replayed once, on a connection of its own, with
+// messages sent straight from the log's mapping. Latency is the time from
+// sending a message to receiving a reply, pairing them in order, which
+// assumes the server answers each message once, as the echo route does.
+
+#include "connect_websock.hpp"
+#include "session_log.hpp"
+
+#include <boost/asio/experimental/awaitable_operators.hpp>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+using namespace blog;
+
+using clock = std::chrono::steady_clock;
+
+struct replay_options
+{
+    std::string     log;
+    std::string     url;
+    std::size_t     connections = 16;
+    std::size_t     threads     = 1;
+    double          speed       = 1;
+    frame_direction replay      = frame_direction::received;
+};
+
+// the messages of one recorded session that are to be sent, in order
+using script = std::vector< frame_view >;
+
+struct results
+{
+    std::vector< std::int64_t > latencies;   // nanoseconds
+    std::uint64_t               sessions = 0;
+    std::uint64_t               failed   = 0;
+    std::uint64_t               sent     = 0;
+    std::uint64_t               replies  = 0;
+    std::uint64_t               bytes    = 0;
+
+    void
+    merge(results const &other)
+    {
+        latencies.insert(
+            latencies.end(), other.latencies.begin(), other.latencies.end());
+        sessions += other.sessions;
+        failed += other.failed;
+        sent += other.sent;
+        replies += other.replies;
+        bytes += other.bytes;
+    }
+};
+
+std::vector< script >
+load_scripts(session_log const &log, frame_direction replay)
+{
+    auto scripts = std::vector< script >();
+    auto index   = std::unordered_map< std::uint64_t, std::size_t >();
+    for (auto &frame : log)
+    {
+        if (frame.direction != replay || frame.opcode == frame_opcode::close)
+            continue;
+        auto [it, added] = index.try_emplace(frame.session, scripts.size());
+        if (added)
+            scripts.emplace_back();
+        scripts[it->second].push_back(frame);
+    }
+    return scripts;
+}
+
+asio::awaitable< void >
+replay_session(ssl::context         &sslctx,
+               script const         &frames,
+               replay_options const &options,
+               results              &out)
+{
+    using asio::redirect_error;
+    using asio::use_awaitable;
+    using namespace asio::experimental::awaitable_operators;
+
+    auto exec    = co_await asio::this_coro::executor;
+    auto conn    = co_await connect_websock(sslctx, options.url, 5, false);
+    auto pending = std::deque< clock::time_point >();
+    auto writing = true;
+    auto drained = asio::steady_timer(exec, clock::time_point::max());
+
+    auto writer = [&]() -> asio::awaitable< void >
+    {
+        auto pace  = asio::steady_timer(exec);
+        auto start = clock::now();
+        auto first = frames.front().time;
+        for (auto &frame : frames)
+        {
+            if (options.speed > 0)
+            {
+                pace.expires_at(
+                    start + std::chrono::duration_cast< clock::duration >(
+                                (frame.time - first) / options.speed));
+                co_await pace.async_wait(use_awaitable);
+            }
+            pending.push_back(clock::now());
+            co_await conn->send_buffers(asio::buffer(frame.payload),
+                                        frame.opcode == frame_opcode::text);
+            ++out.sent;
+            out.bytes += frame.payload.size();
+        }
+
+        // allow the replies to the last messages a while to arrive
+        writing = false;
+        if (!pending.empty())
+        {
+            auto ec = error_code();
+            drained.expires_after(std::chrono::seconds(5));
+            co_await drained.async_wait(redirect_error(use_awaitable, ec));
+        }
+        co_await conn->close(beast::websocket::close_reason(
+            beast::websocket::close_code::normal, "replay complete"));
+    };
+
+    auto reader = [&]() -> asio::awaitable< void >
+    {
+        try
+        {
+            for (;;)
+            {
+                co_await conn->receive_view();
+                ++out.replies;
+                if (!pending.empty())
+                {
+                    out.latencies.push_back(
+                        (clock::now() - pending.front()).count());
+                    pending.pop_front();
+                }
+                if (!writing && pending.empty())
+                    drained.cancel();
+            }
+        }
+        catch (system_error &e)
+        {
+            // a read still pending when our own close completes is aborted
+            auto ours = !writing && e.code() == asio::error::operation_aborted;
+            if (e.code() != beast::websocket::error::closed && !ours)
+                throw;
+        }
+    };
+
+    co_await (writer() && reader());
+}
+
+asio::awaitable< void >
+replay_worker(ssl::context                &sslctx,
+              std::vector< script > const &scripts,
+              std::atomic< std::size_t >  &next,
+              replay_options const        &options,
+              results                     &out)
+{
+    for (;;)
+    {
+        auto i = next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= scripts.size())
+            co_return;
+
+        try
+        {
+            co_await replay_session(sslctx, scripts[i], options, out);
+            ++out.sessions;
+        }
+        catch (std::exception &e)
+        {
+            ++out.failed;
+            fmt::print(stderr, "session {}: {}\n", i, e.what());
+        }
+    }
+}
+
+double
+percentile(std::vector< std::int64_t > const &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    auto i = std::size_t(p * double(sorted.size() - 1));
+    return double(sorted[i]) / 1000;
+}
+
+void
+usage()
+{
+    fmt::print(stderr,
+               "usage: replay <log> <url> [--connections N] [--threads N]\n"
+               "              [--speed X] [--replay received|sent]\n");
+}
+
+bool
+parse(int argc, char **argv, replay_options &options)
+{
+    auto positional = std::vector< std::string >();
+    for (int i = 1; i < argc; ++i)
+    {
+        auto arg = std::string_view(argv[i]);
+        if (!arg.starts_with("--"))
+        {
+            positional.emplace_back(arg);
+            continue;
+        }
+        if (i + 1 == argc)
+            return false;
+
+        auto value = std::string(argv[++i]);
+        if (arg == "--connections")
+            options.connections = std::stoul(value);
+        else if (arg == "--threads")
+            options.threads = std::stoul(value);
+        else if (arg == "--speed")
+            options.speed = std::stod(value);
+        else if (arg == "--replay" && value == "received")
+            options.replay = frame_direction::received;
+        else if (arg == "--replay" && value == "sent")
+            options.replay = frame_direction::sent;
+        else
+            return false;
+    }
+    if (positional.size() != 2)
+        return false;
+
+    options.log         = positional[0];
+    options.url         = positional[1];
+    options.connections = std::max< std::size_t >(options.connections, 1);
+    options.threads     = std::clamp< std::size_t >(
+        options.threads, 1, options.connections);
+    return true;
+}
+
+}   // namespace
+
+int
+main(int argc, char **argv)
+{
+    using namespace blog;
+
+    auto options = replay_options();
+    try
+    {
+        if (!parse(argc, argv, options))
+        {
+            usage();
+            return 1;
+        }
+    }
+    catch (std::exception &)
+    {
+        usage();
+        return 1;
+    }
+
+    try
+    {
+        auto log     = session_log(options.log);
+        auto scripts = load_scripts(log, options.replay);
+        fmt::print("replaying {} sessions from {} on {} connections\n",
+                   scripts.size(),
+                   options.log,
+                   options.connections);
+
+        auto next    = std::atomic< std::size_t >(0);
+        auto totals  = results();
+        auto partial = std::vector< results >(options.threads);
+        auto threads = std::vector< std::thread >();
+        auto start   = clock::now();
+        for (std::size_t t = 0; t < options.threads; ++t)
+            threads.emplace_back(
+                [&, t]
+                {
+                    // each thread has its own io_context and connections, so
+                    // that nothing but the session counter is shared
+                    auto ioc    = asio::io_context(1);
+                    auto sslctx = ssl::context(ssl::context::tls_client);
+                    auto share  = options.connections / options.threads +
+                                 (t < options.connections % options.threads);
+                    for (std::size_t c = 0; c < share; ++c)
+                        asio::co_spawn(
+                            ioc,
+                            replay_worker(
+                                sslctx, scripts, next, options, partial[t]),
+                            asio::detached);
+                    ioc.run();
+                });
+        for (auto &thread : threads)
+            thread.join();
+        auto elapsed =
+            std::chrono::duration< double >(clock::now() - start).count();
+
+        for (auto &p : partial)
+            totals.merge(p);
+        auto &lat = totals.latencies;
+        std::sort(lat.begin(), lat.end());
+
+        fmt::print("{} sessions, {} failed, in {:.3f}s\n",
+                   totals.sessions,
+                   totals.failed,
+                   elapsed);
+        fmt::print("sent {} messages, {} bytes: {:.0f} msg/s, {:.2f} MiB/s\n",
+                   totals.sent,
+                   totals.bytes,
+                   double(totals.sent) / elapsed,
+                   double(totals.bytes) / elapsed / (1024 * 1024));
+        fmt::print("received {} replies\n", totals.replies);
+        fmt::print("latency us: p50 {:.1f}  p90 {:.1f}  p99 {:.1f}  "
+                   "p99.9 {:.1f}  max {:.1f}\n",
+                   percentile(lat, 0.5),
+                   percentile(lat, 0.9),
+                   percentile(lat, 0.99),
+                   percentile(lat, 0.999),
+                   percentile(lat, 1));
+        return totals.failed ? 2 : 0;
+    }
+    catch (std::exception &e)
+    {
+        fmt::print(stderr, "replay: {}\n", e.what());
+        return 1;
+    }
+}